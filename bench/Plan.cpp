@@ -0,0 +1,136 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include "Plan.h"
+
+namespace SdH {
+
+	/// Country codes of one or two digits, the other two digit prefixes hold three digit codes
+	static const char *const shortcodes[] = {
+		"1", "7", "20", "27", "30", "31", "32", "33", "34", "36", "39", "40", "41", "43", "44", "45", "46", "47",
+		"48", "49", "51", "52", "53", "54", "55", "56", "57", "58", "60", "61", "62", "63", "64", "65", "66",
+		"81", "82", "84", "86", "90", "91", "92", "93", "94", "95", "98"
+	};
+
+	Plan::Plan(const size_t ported_i, const uint64_t seed_i)
+	: rnd_(seed_i)
+	{
+		std::vector<std::string> ccs(std::begin(shortcodes), std::end(shortcodes));
+		std::string nr;
+		size_t ndcs, kept;
+
+		// Three digit country codes below the two digit prefixes not in use
+		for (char a = '2'; a <= '9'; a++) {
+			for (char b = '0'; b <= '9'; b++) {
+				std::string p{ a, b };
+				if (std::find_if(ccs.begin(), ccs.end(), [&p](const std::string & c) {
+					return p.compare(0, c.size(), c) == 0;
+				}) != ccs.end()) continue;
+				for (char c = '0'; c <= '9'; c++) if (rnd_() % 3) ccs.push_back(p + c);
+			}
+		}
+
+		for (const auto & cc : ccs) {
+			country_t c;
+
+			c.cc = cc;
+			c.length = 12 - cc.size() - rnd_() % 3;
+			ndcs = cc.size() == 1 ? 300 : cc.size() == 2 ? 60 : 8;
+			for (size_t i = 0; i < ndcs; i++) {
+				nr.clear();
+				nr += '1' + rnd_() % 9;
+				digits_(nr, 1 + rnd_() % 2);
+				(rnd_() % 4 ? c.fixed : c.mobile).push_back(nr);
+			}
+			countries_.push_back(c);
+
+			// The country, its fixed networks and its mobile blocks of 10000 numbers
+			entries_.emplace_back(cc, carrier_());
+			for (const auto & f : c.fixed) entries_.emplace_back(cc + f, carrier_());
+			for (const auto & m : c.mobile) {
+				for (uint16_t b = 0; b < 100; b++) {
+					nr = cc + m;
+					nr += '0' + b / 10;
+					nr += '0' + b % 10;
+					entries_.emplace_back(nr, carrier_());
+				}
+			}
+		}
+
+		// Ported numbers, mostly mobile
+		for (size_t i = 0; i < ported_i; i++) {
+			const country_t & c = countries_[rnd_() % countries_.size()];
+			const std::vector<std::string> & ndc = c.mobile.empty() || rnd_() % 5 == 0 ? c.fixed : c.mobile;
+
+			if (ndc.empty()) continue;
+			nr = c.cc + ndc[rnd_() % ndc.size()];
+			digits_(nr, c.cc.size() + c.length - nr.size());
+			entries_.emplace_back(nr, carrier_());
+		}
+
+		// Later duplicates win, like setting them one after the other
+		std::stable_sort(entries_.begin(), entries_.end(), [](const auto & a, const auto & b) {
+			return a.first < b.first;
+		});
+		kept = 0;
+		for (size_t i = 0; i < entries_.size(); i++) {
+			if (kept && entries_[kept - 1].first == entries_[i].first) entries_[kept - 1].second = entries_[i].second;
+			else if (kept++ != i) entries_[kept - 1] = std::move(entries_[i]);
+		}
+		entries_.resize(kept);
+	}
+
+	void Plan::digits_(std::string & number_io, const size_t digits_i)
+	{
+		for (size_t i = 0; i < digits_i; i++) number_io += '0' + rnd_() % 10;
+	}
+
+	std::vector<std::string> Plan::queries(const size_t count_i)
+	{
+		std::vector<std::string> rv;
+		std::string nr;
+
+		rv.reserve(count_i);
+		while (rv.size() < count_i) {
+			const auto & e = entries_[rnd_() % entries_.size()];
+			const country_t & c = countries_[rnd_() % countries_.size()];
+
+			// Half of the numbers around entries of the plan, the rest anywhere in a country
+			nr = rnd_() % 2 ? e.first : c.cc;
+			if (nr.size() < 12) digits_(nr, 12 - nr.size() - rnd_() % 2);
+			rv.push_back(nr);
+		}
+		return rv;
+	}
+
+} // SdH namespace
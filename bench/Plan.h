@@ -0,0 +1,102 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SdH {
+
+	/** Generator of synthetic, but realistically shaped, numbering plans.
+	 * The plan consists of E.164 country codes of one to three digits,
+	 * national destination codes below them, dense mobile number blocks
+	 * handed out to carriers and full-length numbers ported between
+	 * carriers. Destinations are carrier numbers. The same seed always
+	 * gives the same plan. */
+	class Plan
+	{
+		protected:
+		/// Country with its codes
+		struct country_t {
+			/// Country code
+			std::string cc;
+
+			/// Number of digits of national numbers
+			uint8_t length;
+
+			/// National destination codes of fixed networks
+			std::vector<std::string> fixed;
+
+			/// National destination codes of mobile networks
+			std::vector<std::string> mobile;
+		};
+
+		/// Random generator
+		std::mt19937_64 rnd_;
+
+		/// Countries in the plan
+		std::vector<country_t> countries_;
+
+		/// Entries of the plan, sorted by prefix
+		std::vector<std::pair<std::string, uint64_t>> entries_;
+
+		/** Append random digits to a number.
+		 * @param number_io Number to append to.
+		 * @param digits_i Number of digits to append. */
+		void digits_(std::string & number_io, const size_t digits_i);
+
+		/** Pick a carrier.
+		 * @returns Carrier number, 1 up to 1000. */
+		inline uint64_t carrier_() { return 1 + rnd_() % 1000; }
+
+		public:
+		/** Constructor, generates the plan.
+		 * @param ported_i Number of ported full-length numbers.
+		 * @param seed_i Seed of the random generator. */
+		Plan(const size_t ported_i, const uint64_t seed_i = 1);
+
+		/** Get the entries of the plan.
+		 * @returns Prefixes with their destinations, sorted by prefix. */
+		inline const std::vector<std::pair<std::string, uint64_t>> & entries() const { return entries_; }
+
+		/** Generate full-length numbers to lookup. Most fall in the plan,
+		 * part of them on ported numbers, some in unassigned ranges.
+		 * @param count_i Number of numbers to generate.
+		 * @returns Numbers. */
+		std::vector<std::string> queries(const size_t count_i);
+	};
+
+} // SdH namespace
@@ -0,0 +1,333 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <thread>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include "BasicDecTree.h"
+#include "DecTree.h"
+#include "DecTreeBuilder.h"
+#include "Logger.h"
+#include "Plan.h"
+
+using namespace SdH;
+
+/// Clock used for all measurements
+typedef std::chrono::steady_clock clk;
+
+/** Get the number of seconds elapsed since a moment.
+ * @param start_i Moment to measure from.
+ * @returns Seconds. */
+static double since(const clk::time_point start_i)
+{
+	return std::chrono::duration<double>(clk::now() - start_i).count();
+}
+
+/** Get percentiles of latencies as JSON members.
+ * @param ns_io Latencies in nanoseconds, sorted by this function.
+ * @returns Members p50, p99 and p999. */
+static std::string percentiles(std::vector<uint32_t> & ns_io)
+{
+	std::sort(ns_io.begin(), ns_io.end());
+	return fmt::format("\"p50\": {}, \"p99\": {}, \"p999\": {}",
+		ns_io[ns_io.size() / 2], ns_io[ns_io.size() * 99 / 100], ns_io[ns_io.size() * 999 / 1000]);
+}
+
+/** Measure the latency and throughput of single lookups.
+ * @param queries_i Numbers to lookup.
+ * @param lookup_i Callable looking up a number.
+ * @returns JSON object with lookups per second and latency percentiles. */
+template <class LOOKUP>
+static std::string single(const std::vector<std::string> & queries_i, LOOKUP lookup_i)
+{
+	std::vector<uint32_t> ns(queries_i.size());
+	clk::time_point start, t;
+	uint64_t sum = 0;
+	double secs;
+
+	start = clk::now();
+	for (const auto & q : queries_i) sum += lookup_i(q);
+	secs = since(start);
+
+	for (size_t i = 0; i < queries_i.size(); i++) {
+		t = clk::now();
+		sum += lookup_i(queries_i[i]);
+		ns[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t).count();
+	}
+
+	// Keep the lookups from being optimized away
+	if (sum == 1) fputc(' ', stderr);
+	return fmt::format("{{ \"lookups_per_s\": {:.0f}, {} }}", queries_i.size() / secs, percentiles(ns));
+}
+
+/** Measure a BasicDecTree holding the entries of the plan, checking its
+ * lookups against a DecTree holding the same entries.
+ * @tparam SlotT Slot type.
+ * @param entries_i Entries of the plan.
+ * @param queries_i Numbers to lookup.
+ * @param tree_i Tree holding the same entries.
+ * @param mismatches_io Incremented for every lookup differing from @p tree_i.
+ * @returns JSON object with the insert rate, memory use and lookup latency. */
+template <class SlotT>
+static std::string basic(const std::vector<std::pair<std::string, uint64_t>> & entries_i,
+	const std::vector<std::string> & queries_i, const DecTree & tree_i, size_t & mismatches_io)
+{
+	BasicDecTree<SlotT> basic;
+	clk::time_point start;
+	double secs;
+
+	start = clk::now();
+	for (const auto & e : entries_i) basic(e.first, e.second);
+	secs = since(start);
+	for (const auto & q : queries_i) if (basic.lookup(q) != tree_i.lookup(q)) mismatches_io++;
+
+	return fmt::format("{{ \"entries_per_s\": {:.0f}, \"bytes\": {}, \"bytes_per_entry\": {:.1f}, \"lookup\": {} }}",
+		entries_i.size() / secs, basic.bytes(), static_cast<double>(basic.bytes()) / entries_i.size(),
+		single(queries_i, [&basic](const std::string & q) { return basic.lookup(q); }));
+}
+
+/** Show usage information.
+ * @param name_i Name of the executable. */
+static void usage(const char *name_i)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --ported N    Number of ported full-length numbers, default 2000000\n"
+		"  --queries N   Number of lookups per measurement, default 1000000\n"
+		"  --seed N      Seed of the plan generator, default 1\n"
+		"  --threads N   Maximum number of threads, default one per hardware thread\n"
+		"  --output F    Write the JSON results to file F instead of standard output\n",
+		name_i);
+}
+
+/** Runs the benchmarks, writing the results as JSON.
+ * @returns 0 on success, 1 on invalid arguments. */
+int main(int argc, char *argv[])
+{
+	size_t ported = 2000000, nqueries = 1000000, threads = std::thread::hardware_concurrency(), mismatches = 0;
+	uint64_t seed = 1;
+	std::string output;
+	std::vector<std::string> json;
+	clk::time_point start;
+	double secs;
+
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && strcmp(argv[i], "--ported") == 0) ported = strtoull(argv[++i], nullptr, 10);
+		else if (i + 1 < argc && strcmp(argv[i], "--queries") == 0) nqueries = strtoull(argv[++i], nullptr, 10);
+		else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[++i], nullptr, 10);
+		else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) threads = strtoull(argv[++i], nullptr, 10);
+		else if (i + 1 < argc && strcmp(argv[i], "--output") == 0) output = argv[++i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (threads == 0) threads = 1;
+	if (nqueries == 0) nqueries = 1;
+	Fs2a::Logger::instance()->stderror();
+
+	Plan plan(ported, seed);
+	const auto & entries = plan.entries();
+	std::vector<std::string> queries = plan.queries(nqueries);
+	json.push_back(fmt::format("\"plan\": {{ \"entries\": {}, \"ported\": {}, \"queries\": {}, \"seed\": {} }}",
+		entries.size(), ported, nqueries, seed));
+
+	// Setting the entries one by one, in random order
+	{
+		std::vector<size_t> order(entries.size());
+		std::mt19937_64 rnd(seed);
+		DecTree tree;
+
+		for (size_t i = 0; i < order.size(); i++) order[i] = i;
+		std::shuffle(order.begin(), order.end(), rnd);
+		start = clk::now();
+		for (const size_t i : order) tree(entries[i].first, entries[i].second);
+		secs = since(start);
+		json.push_back(fmt::format("\"insert\": {{ \"entries_per_s\": {:.0f}, \"ns_per_entry\": {:.1f} }}",
+			entries.size() / secs, secs * 1e9 / entries.size()));
+	}
+
+	DecTree tree;
+	DecTreeBuilder builder(threads);
+	for (const auto & e : entries) builder.add(e.first, e.second);
+	start = clk::now();
+	builder.build(tree);
+	secs = since(start);
+	json.push_back(fmt::format("\"bulkbuild\": {{ \"entries_per_s\": {:.0f}, \"threads\": {} }}",
+		entries.size() / secs, threads));
+
+	{
+		uint64_t bytes = 0;
+		auto levels = tree.levels();
+
+		for (const auto & l : levels) bytes += l.bytes;
+		json.push_back(fmt::format("\"memory\": {{ \"bytes\": {}, \"bytes_per_entry\": {:.1f}, \"levels\": {} }}",
+			bytes, static_cast<double>(bytes) / entries.size(), levels.size()));
+	}
+
+	// Enumerating every entry in order, as an export would
+	{
+		size_t bytes = 0, n;
+
+		start = clk::now();
+		n = tree.forEach([&bytes](const std::string_view p, const uint64_t d) { bytes += p.size() + sizeof(d); });
+		secs = since(start);
+		json.push_back(fmt::format("\"export\": {{ \"entries_per_s\": {:.0f}, \"bytes_per_s\": {:.0f} }}",
+			n / secs, bytes / secs));
+	}
+
+	json.push_back("\"lookup\": " + single(queries, [&tree](const std::string & q) { return tree.lookup(q); }));
+
+	{
+		std::vector<uint64_t> dest;
+
+		start = clk::now();
+		tree.lookup(queries, dest);
+		secs = since(start);
+		json.push_back(fmt::format("\"batch\": {{ \"lookups_per_s\": {:.0f} }}", queries.size() / secs));
+	}
+
+	// Every thread looks up all numbers
+	{
+		std::vector<std::string> scaling;
+
+		for (size_t n = 1; n <= threads; n = n * 2 > threads && n != threads ? threads : n * 2) {
+			std::vector<std::thread> workers;
+
+			start = clk::now();
+			for (size_t w = 0; w < n; w++) {
+				workers.emplace_back([&tree, &queries]() {
+					uint64_t sum = 0;
+
+					for (const auto & q : queries) sum += tree.lookup(q);
+					if (sum == 1) fputc(' ', stderr);
+				});
+			}
+			for (auto & w : workers) w.join();
+			secs = since(start);
+			scaling.push_back(fmt::format("{{ \"threads\": {}, \"lookups_per_s\": {:.0f} }}", n, n * queries.size() / secs));
+		}
+		json.push_back("\"scaling\": [ " + fmt::format("{}", fmt::join(scaling, ", ")) + " ]");
+	}
+
+	// Readers while a writer keeps reassigning entries
+	{
+		std::atomic<bool> done(false);
+		std::atomic<uint64_t> updates(0);
+		size_t readers = threads > 1 ? threads - 1 : 1;
+		std::vector<std::thread> workers;
+		std::thread writer([&]() {
+			std::mt19937_64 rnd(seed + 1);
+
+			while (!done.load(std::memory_order_relaxed)) {
+				const auto & e = entries[rnd() % entries.size()];
+				tree(e.first, 1 + rnd() % 1000);
+				updates.fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		start = clk::now();
+		for (size_t w = 0; w < readers; w++) {
+			workers.emplace_back([&tree, &queries]() {
+				uint64_t sum = 0;
+
+				for (const auto & q : queries) sum += tree.lookup(q);
+				if (sum == 1) fputc(' ', stderr);
+			});
+		}
+		for (auto & w : workers) w.join();
+		secs = since(start);
+		done = true;
+		writer.join();
+		json.push_back(fmt::format("\"concurrent\": {{ \"readers\": {}, \"lookups_per_s\": {:.0f}, \"updates_per_s\": {:.0f} }}",
+			readers, readers * queries.size() / secs, updates.load() / secs));
+	}
+
+	// Baselines, checking the tree against them on the way
+	{
+		std::map<std::string, uint64_t, std::less<>> map(entries.begin(), entries.end());
+		size_t exported;
+		auto mapfind = [&map](const std::string & q) -> uint64_t {
+			for (size_t l = q.size(); l > 0; l--) {
+				auto it = map.find(std::string_view(q).substr(0, l));
+				if (it != map.end()) return it->second;
+			}
+			return 0;
+		};
+		auto vecfind = [&entries](const std::string & q) -> uint64_t {
+			for (size_t l = q.size(); l > 0; l--) {
+				std::string_view p = std::string_view(q).substr(0, l);
+				auto it = std::lower_bound(entries.begin(), entries.end(), p, [](const auto & e, const std::string_view v) {
+					return std::string_view(e.first) < v;
+				});
+				if (it != entries.end() && it->first == p) return it->second;
+			}
+			return 0;
+		};
+
+		builder.build(tree);
+		for (const auto & q : queries) if (tree.lookup(q) != mapfind(q)) mismatches++;
+		exported = 0;
+		tree.forEach([&entries, &mismatches, &exported](const std::string_view p, const uint64_t d) {
+			if (exported >= entries.size() || entries[exported].first != p || entries[exported].second != d) mismatches++;
+			exported++;
+		});
+		if (exported != entries.size()) mismatches++;
+
+		json.push_back("\"baselines\": { \"map\": " + single(queries, mapfind) +
+			", \"sorted_vector\": " + single(queries, vecfind) + " }");
+	}
+
+	// The same plan in 32 and 64 bit slots, set in ascending order
+	json.push_back("\"basic\": { \"uint32\": " + basic<uint32_t>(entries, queries, tree, mismatches) +
+		", \"uint64\": " + basic<uint64_t>(entries, queries, tree, mismatches) + " }");
+	json.push_back(fmt::format("\"mismatches\": {}", mismatches));
+
+	std::string result = "{\n\t" + fmt::format("{}", fmt::join(json, ",\n\t")) + "\n}\n";
+	if (output.empty()) {
+		std::cout << result;
+	} else {
+		std::ofstream out(output);
+		out << result;
+	}
+	return mismatches ? 1 : 0;
+}
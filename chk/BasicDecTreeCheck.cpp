@@ -0,0 +1,221 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "BasicDecTree.h"
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks BasicDecTree with both slot widths and several radixes, against
+ * DecTree for decimal numbers and against a map for the others. */
+class BasicDecTreeCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(BasicDecTreeCheck);
+	CPPUNIT_TEST(plan);
+	CPPUNIT_TEST(decimal);
+	CPPUNIT_TEST(radixes);
+	CPPUNIT_TEST(destinations);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST(reuse);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Apply random sets and erases to a BasicDecTree and a reference map,
+	 * and compare them.
+	 * @tparam SlotT Slot type.
+	 * @tparam RADIX Radix. */
+	template <class SlotT, uint8_t RADIX>
+	static void random_()
+	{
+		std::mt19937_64 rnd(RADIX * sizeof(SlotT));
+		BasicDecTree<SlotT, RADIX> tree;
+		std::map<std::string, uint64_t> ref;
+		std::string nr, upper;
+
+		for (size_t i = 0; i < 20000; i++) {
+			nr = randomnumber(rnd, 6, RADIX);
+			if (rnd() % 4) {
+				tree(nr, 1 + i);
+				ref[nr] = 1 + i;
+			} else CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.erase(nr) > 0, tree.erase(nr));
+		}
+		for (size_t i = 0; i < 20000; i++) {
+			nr = randomnumber(rnd, 8, RADIX);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref, nr), tree.lookup(nr));
+			upper = nr;
+			std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(upper, reflookup(ref, nr), tree.lookup(upper));
+		}
+	}
+
+	/** Compare a decimal BasicDecTree with a DecTree under random sets
+	 * and erases.
+	 * @tparam SlotT Slot type. */
+	template <class SlotT>
+	static void decimal_()
+	{
+		std::mt19937_64 rnd(21);
+		BasicDecTree<SlotT> tree;
+		DecTree ref;
+		std::string nr;
+
+		for (size_t i = 0; i < 50000; i++) {
+			nr = randomnumber(rnd, 9);
+			if (rnd() % 3) {
+				tree(nr, 1 + i % 100000);
+				ref(nr, 1 + i % 100000);
+			} else CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.erase(nr), tree.erase(nr));
+			if (i % 16 == 0) CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.lookup(nr), tree.lookup(nr));
+		}
+		for (size_t i = 0; i < 50000; i++) {
+			nr = randomnumber(rnd, 12);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.lookup(nr), tree.lookup(nr));
+		}
+	}
+
+	public:
+	/// The check plan gives the same results as in DecTree, in less memory with 32 bit slots
+	void plan()
+	{
+		std::ifstream in(CHKPLAN);
+		BasicDecTree<uint32_t> narrow;
+		BasicDecTree<uint64_t> wide;
+		DecTree ref;
+		std::string line, nr;
+		size_t comma;
+		uint64_t dest;
+
+		while (std::getline(in, line)) {
+			comma = line.find(',');
+			if (comma == std::string::npos) continue;
+			nr = line.substr(0, comma);
+			dest = std::stoull(line.substr(comma + 1));
+			narrow(nr, dest);
+			wide(nr, dest);
+			ref(nr, dest);
+		}
+		in.clear();
+		in.seekg(0);
+		while (std::getline(in, line)) {
+			comma = line.find(',');
+			if (comma == std::string::npos) continue;
+			for (size_t len = 1; len <= comma + 2; len++) {
+				nr = line.substr(0, std::min(len, comma));
+				if (len > comma) nr += std::string(len - comma, '7');
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.lookup(nr), narrow.lookup(nr));
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.lookup(nr), wide.lookup(nr));
+			}
+		}
+		CPPUNIT_ASSERT(narrow.bytes() < wide.bytes());
+		CPPUNIT_ASSERT(narrow.bytes() < ref.stats().allocated);
+	}
+
+	/// Random decimal sets and erases, with both slot widths
+	void decimal()
+	{
+		decimal_<uint32_t>();
+		decimal_<uint64_t>();
+	}
+
+	/// Random sets and erases in several radixes, with both slot widths
+	void radixes()
+	{
+		random_<uint32_t, 2>();
+		random_<uint32_t, 8>();
+		random_<uint32_t, 16>();
+		random_<uint64_t, 2>();
+		random_<uint64_t, 8>();
+		random_<uint64_t, 16>();
+	}
+
+	/// Destinations are limited by the slot width, and 0 erases
+	void destinations()
+	{
+		BasicDecTree<uint32_t> narrow;
+		BasicDecTree<uint64_t> wide;
+
+		CPPUNIT_ASSERT_EQUAL((UINT64_C(1) << 30) - 1, BasicDecTree<uint32_t>::maxdest());
+		narrow("1", BasicDecTree<uint32_t>::maxdest());
+		CPPUNIT_ASSERT_EQUAL(BasicDecTree<uint32_t>::maxdest(), narrow.lookup("12"));
+		CPPUNIT_ASSERT_THROW(narrow("1", BasicDecTree<uint32_t>::maxdest() + 1), std::invalid_argument);
+		CPPUNIT_ASSERT_EQUAL(BasicDecTree<uint32_t>::maxdest(), narrow.lookup("12"));
+
+		wide("1", UINT64_C(1) << 40);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1) << 40, wide.lookup("12"));
+		wide("1", 0);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), wide.lookup("12"));
+	}
+
+	/// Characters that are not digits of the radix are refused
+	void invalid()
+	{
+		BasicDecTree<uint32_t, 8> octal;
+		BasicDecTree<uint64_t, 16> hex;
+
+		CPPUNIT_ASSERT_THROW(octal("", 1), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(octal("178", 1), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(octal.lookup("19"), std::invalid_argument);
+		hex("aF", 1);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), hex.lookup("Af0"));
+		CPPUNIT_ASSERT_THROW(hex("ag", 1), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(hex.erase("x"), std::invalid_argument);
+	}
+
+	/// Lists freed by erasing are reused, so churn does not grow the arena
+	void reuse()
+	{
+		std::mt19937_64 rnd(22);
+		std::vector<std::string> numbers;
+		BasicDecTree<uint32_t> tree;
+		uint64_t bytes = 0;
+
+		for (size_t i = 0; i < 500; i++) numbers.push_back(randomnumber(rnd, 8));
+		for (size_t round = 0; round < 5; round++) {
+			for (size_t i = 0; i < numbers.size(); i++) tree(numbers[i], i + 1);
+			for (const auto & nr : numbers) tree.erase(nr);
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup(numbers.front()));
+			if (round == 0) bytes = tree.bytes();
+			else CPPUNIT_ASSERT_EQUAL(bytes, tree.bytes());
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BasicDecTreeCheck);
@@ -0,0 +1,194 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks that lookups of a batch of numbers, which interleave the walks
+ * of several numbers, find the same destinations as single lookups. */
+class BatchCheck : public RandomFixture<17320>
+{
+	CPPUNIT_TEST_SUITE(BatchCheck);
+	CPPUNIT_TEST(sizes);
+	CPPUNIT_TEST(strides);
+	CPPUNIT_TEST(sparse);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Fill a tree with random numbers, with a dense block below 31 for
+	 * full lists and longer numbers elsewhere for sparse ones.
+	 * @param tree_io Tree to fill.
+	 * @returns Numbers set. */
+	std::vector<std::string> fill_(DecTree & tree_io)
+	{
+		std::vector<std::string> rv;
+		std::string nr;
+
+		for (uint64_t i = 0; i < 1000; i++) {
+			nr = i % 4 ? number_(10) : "31" + std::to_string(i);
+			tree_io(nr, i + 1);
+			rv.push_back(nr);
+		}
+		return rv;
+	}
+
+	/** Make a batch of numbers to lookup: numbers set, prefixes of them
+	 * that end inside a stride or on a sparse list, longer numbers below
+	 * them, random numbers and empty ones.
+	 * @param set_i Numbers set in the tree.
+	 * @param count_i Number of numbers in the batch.
+	 * @returns Batch. */
+	std::vector<std::string> batch_(const std::vector<std::string> & set_i, const size_t count_i)
+	{
+		std::vector<std::string> rv;
+		std::string nr;
+
+		for (size_t i = 0; i < count_i; i++) {
+			nr = set_i[rng_() % set_i.size()];
+			switch (rng_() % 5) {
+				case 0: nr = nr.substr(0, 1 + rng_() % nr.size()); break;
+				case 1: nr += number_(6); break;
+				case 2: nr = number_(12); break;
+				case 3: if (rng_() % 4 == 0) nr.clear(); break;
+				default: break;
+			}
+			rv.push_back(nr);
+		}
+		return rv;
+	}
+
+	/** Compare a batch lookup with single lookups.
+	 * @param tree_i Tree to lookup in.
+	 * @param numbers_i Numbers to lookup. */
+	static void compare_(const DecTree & tree_i, const std::vector<std::string> & numbers_i)
+	{
+		std::vector<uint64_t> found;
+
+		found.assign(numbers_i.size(), UINT64_MAX);
+		tree_i.lookup(numbers_i, found);
+		CPPUNIT_ASSERT_EQUAL(numbers_i.size(), found.size());
+		for (size_t i = 0; i < numbers_i.size(); i++) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(numbers_i[i], tree_i.lookup(numbers_i[i]), found[i]);
+		}
+	}
+
+	public:
+	/// Batches smaller than, as big as and bigger than the number of lookups in flight
+	void sizes()
+	{
+		DecTree tree;
+		std::vector<std::string> set = fill_(tree);
+
+		for (size_t count : { 0, 1, 2, 15, 16, 17, 31, 33, 100, 1000 }) compare_(tree, batch_(set, count));
+	}
+
+	/// Numbers ending inside a stride, at every level that has one
+	void strides()
+	{
+		const std::vector<std::vector<uint8_t>> profiles = { {}, { 1 }, { 3, 2, 1 }, { 2, 3, 3 }, { 1, 1, 2 } };
+
+		for (const auto & p : profiles) {
+			DecTree tree;
+			std::vector<std::string> set, batch;
+
+			tree.strides(p);
+			set = fill_(tree);
+			for (const auto & s : set) {
+				for (size_t len = 1; len <= s.size() && len <= 7; len++) batch.push_back(s.substr(0, len));
+			}
+			compare_(tree, batch);
+			compare_(tree, batch_(set, 500));
+		}
+	}
+
+	/// Numbers ending on sparse lists, and passing through them, before and after they become full
+	void sparse()
+	{
+		std::vector<std::string> batch;
+		DecTree tree;
+
+		for (uint8_t d = 0; d <= SPARSEMAX + 2; d++) {
+			tree("42" + std::to_string(d), d + 1);
+			batch.clear();
+			for (uint8_t e = 0; e < 10; e++) {
+				batch.push_back("42" + std::to_string(e));
+				batch.push_back("42" + std::to_string(e) + "123");
+			}
+			batch.push_back("42");
+			batch.push_back("4");
+			compare_(tree, batch);
+		}
+	}
+
+	/// An empty tree finds nothing, empty numbers find nothing either
+	void empty()
+	{
+		std::vector<std::string> batch(40, "");
+		std::vector<uint64_t> found;
+		DecTree tree;
+
+		batch[3] = "123";
+		compare_(tree, batch);
+		tree("1", 1);
+		compare_(tree, batch);
+		found.assign(batch.size(), UINT64_MAX);
+		tree.lookup(batch, found);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), found[0]);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), found[3]);
+	}
+
+	/// An invalid number anywhere in a batch is refused
+	void invalid()
+	{
+		DecTree tree;
+		std::vector<std::string> set = fill_(tree), batch;
+		std::vector<uint64_t> found;
+
+		for (size_t pos : { 0, 7, 16, 40, 99 }) {
+			batch = batch_(set, 100);
+			batch[pos] = "31a4";
+			CPPUNIT_ASSERT_THROW(tree.lookup(batch, found), std::invalid_argument);
+			batch[pos] = "3141";
+			compare_(tree, batch);
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BatchCheck);
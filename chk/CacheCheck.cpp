@@ -0,0 +1,145 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+#include "DecTreeBuilder.h"
+
+using namespace SdH;
+
+/** Checks that the per-thread lookup cache never returns a result from
+ * before a modification, whatever kind of modification, and that all
+ * lookup methods share it. */
+class CacheCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CacheCheck);
+	CPPUNIT_TEST(shared);
+	CPPUNIT_TEST(modifications);
+	CPPUNIT_TEST(transactions);
+	CPPUNIT_TEST(trees);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Cache the result of a lookup, modify the tree and check that all
+	 * lookup methods see the modification.
+	 * @param tree_io Tree with the cache enabled.
+	 * @param before_i Destination of 31415 before the modification.
+	 * @param modify_i Modification.
+	 * @param after_i Destination of 31415 after the modification. */
+	static void check_(DecTree & tree_io, const uint64_t before_i, const std::function<void()> & modify_i, const uint64_t after_i)
+	{
+		CPPUNIT_ASSERT_EQUAL(before_i, tree_io.lookup("31415"));
+		CPPUNIT_ASSERT_EQUAL(before_i, tree_io.lookup("31415"));
+		modify_i();
+		CPPUNIT_ASSERT_EQUAL(after_i, tree_io.lookup("31415"));
+		CPPUNIT_ASSERT_EQUAL(after_i, tree_io.lookupBCD(UINT64_C(0x31415FFFFFFFFFFF)));
+		CPPUNIT_ASSERT_EQUAL(after_i, tree_io.lookupInt(31415, 5));
+	}
+
+	public:
+	/// A result cached by one lookup method serves the others
+	void shared()
+	{
+#if DECTREESTATS
+		DecTree tree;
+
+		tree.cache(true);
+		tree("314", 1);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("31415"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookupBCD(UINT64_C(0x31415FFFFFFFFFFF)));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookupInt(31415, 5));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.stats().cached);
+
+		// Leading zeroes are part of the number
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookupInt(31415, 6));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.stats().cached);
+#endif
+	}
+
+	/// Every kind of modification invalidates cached results
+	void modifications()
+	{
+		std::string image = std::string(P_tmpdir) + "/cachecheck." + std::to_string(getpid()) + ".img";
+		DecTree tree;
+
+		tree.cache(true);
+		check_(tree, 0, [&tree]() { tree("314", 1); }, 1);
+		check_(tree, 1, [&tree]() { tree("3141", 2); }, 2);
+		check_(tree, 2, [&tree]() { tree.erase("3141"); }, 1);
+		check_(tree, 1, [&tree]() { tree.setRange("31400", "31419", 3); }, 3);
+		check_(tree, 3, [&tree]() { tree.apply({ { "31415", 0, 4 } }); }, 4);
+		check_(tree, 4, [&tree]() { tree.consolidate(); }, 4);
+		check_(tree, 4, [&tree, &image]() { tree.save(image); tree("31415", 5); }, 5);
+		check_(tree, 5, [&tree, &image]() { tree.load(image); }, 4);
+		check_(tree, 4, [&tree]() {
+			DecTreeBuilder builder(1);
+
+			builder.add("3", 6);
+			builder.build(tree);
+		}, 6);
+		check_(tree, 6, [&tree]() { tree.clear(); }, 0);
+		unlink(image.c_str());
+	}
+
+	/// Lookups keep the cached result during a transaction, and see the commit
+	void transactions()
+	{
+		DecTree tree;
+
+		tree.cache(true);
+		tree("314", 1);
+		check_(tree, 1, [&tree]() { tree.begin(); tree("31415", 2); }, 1);
+		check_(tree, 1, [&tree]() { tree.commit(); }, 2);
+		check_(tree, 2, [&tree]() { tree.begin(); tree.erase("31415"); tree.rollback(); }, 2);
+	}
+
+	/// Trees never get each other's cached results
+	void trees()
+	{
+		DecTree a, b;
+
+		a.cache(true);
+		b.cache(true);
+		a("31415", 1);
+		b("31415", 2);
+		for (size_t i = 0; i < 3; i++) {
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(1), a.lookup("31415"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(2), b.lookup("31415"));
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CacheCheck);
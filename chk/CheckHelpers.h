@@ -0,0 +1,89 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <cppunit/TestFixture.h>
+
+namespace SdH {
+
+	/** Look up the longest prefix of a number in a reference map, the way
+	 * a tree should.
+	 * @param ref_i Reference map of prefixes to destinations.
+	 * @param number_i Number to look up.
+	 * @returns Destination of the longest prefix, 0 if none. */
+	inline uint64_t reflookup(const std::map<std::string, uint64_t> & ref_i, const std::string & number_i)
+	{
+		for (size_t len = number_i.size(); len > 0; len--) {
+			auto it = ref_i.find(number_i.substr(0, len));
+			if (it != ref_i.end()) return it->second;
+		}
+		return 0;
+	}
+
+	/** Make a random number.
+	 * @param rnd_io Random generator.
+	 * @param digits_i Maximum number of digits.
+	 * @param radix_i Radix, digits above 9 are written as a through f.
+	 * @returns Number of 1 up to @p digits_i digits. */
+	inline std::string randomnumber(std::mt19937_64 & rnd_io, const size_t digits_i, const uint8_t radix_i = 10)
+	{
+		std::string rv(1 + rnd_io() % digits_i, '0');
+
+		for (auto & c : rv) c = "0123456789abcdef"[rnd_io() % radix_i];
+		return rv;
+	}
+
+	/** Fixture of checks with random modifications, which are the same
+	 * for every run of a check.
+	 * @tparam SEED Seed of the random generator. */
+	template <uint64_t SEED>
+	class RandomFixture : public CppUnit::TestFixture
+	{
+		protected:
+		/// Random generator, seeded the same for every check
+		std::mt19937_64 rng_;
+
+		/** Make a random decimal number.
+		 * @param digits_i Maximum number of digits.
+		 * @returns Number of 1 up to @p digits_i digits. */
+		std::string number_(const size_t digits_i) { return randomnumber(rng_, digits_i); }
+
+		public:
+		void setUp() { rng_.seed(SEED); }
+	};
+
+} // SdH namespace
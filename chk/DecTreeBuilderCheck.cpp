@@ -0,0 +1,194 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+#include "DecTreeBuilder.h"
+
+using namespace SdH;
+
+/** Checks that a tree built by DecTreeBuilder agrees with one filled a
+ * number at a time, and that a failing build leaves the tree intact. */
+class DecTreeBuilderCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(DecTreeBuilderCheck);
+	CPPUNIT_TEST(plan);
+	CPPUNIT_TEST(rebuild);
+	CPPUNIT_TEST(exhausted);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Entries of the check plan, in ascending order
+	std::vector<std::pair<std::string, uint64_t>> plan_;
+
+	/** Compare two trees for numbers around every entry of a plan.
+	 * @param a_i First tree.
+	 * @param b_i Second tree.
+	 * @param plan_i Entries to compare around. */
+	static void compare_(const DecTree & a_i, const DecTree & b_i, const std::vector<std::pair<std::string, uint64_t>> & plan_i)
+	{
+		std::string nr;
+
+		for (const auto & e : plan_i) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(e.first, a_i.lookup(e.first), b_i.lookup(e.first));
+			for (char d = '0'; d <= '9'; d++) {
+				nr = e.first + d;
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, a_i.lookup(nr), b_i.lookup(nr));
+			}
+			nr = e.first.substr(0, e.first.size() - 1);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, a_i.lookup(nr), b_i.lookup(nr));
+		}
+	}
+
+	public:
+	void setUp()
+	{
+		std::ifstream in(CHKPLAN);
+		std::string line;
+		size_t comma;
+
+		while (std::getline(in, line)) {
+			comma = line.find(',');
+			if (comma == std::string::npos) continue;
+			plan_.emplace_back(line.substr(0, comma), std::stoull(line.substr(comma + 1)));
+		}
+		std::sort(plan_.begin(), plan_.end());
+		CPPUNIT_ASSERT(!plan_.empty());
+	}
+
+	void tearDown()
+	{
+		plan_.clear();
+	}
+
+	/// The check plan, built with several stride profiles and thread counts
+	void plan()
+	{
+		const std::vector<std::vector<uint8_t>> profiles = { {}, { 2 }, { 2, 3 }, { 3, 3, 3 } };
+
+		for (const auto & p : profiles) {
+			for (size_t threads = 1; threads <= 4; threads *= 2) {
+				DecTree built, single;
+				DecTreeBuilder builder(threads);
+
+				built.strides(p);
+				single.strides(p);
+				for (const auto & e : plan_) {
+					builder.add(e.first, e.second);
+					single(e.first, e.second);
+				}
+				builder.build(built);
+				compare_(built, single, plan_);
+			}
+		}
+	}
+
+	/// Building replaces the contents, which can be modified afterwards
+	void rebuild()
+	{
+		const std::string marker("99999999999999999");
+		DecTree tree, reference;
+		DecTreeBuilder builder(2);
+
+		tree(marker, 7);
+		for (const auto & e : plan_) {
+			builder.add(e.first, e.second);
+			reference(e.first, e.second);
+		}
+		builder.build(tree);
+		compare_(tree, reference, plan_);
+		CPPUNIT_ASSERT_EQUAL(reference.lookup(marker), tree.lookup(marker));
+
+		tree(marker, 7);
+		reference(marker, 7);
+		CPPUNIT_ASSERT(tree.erase(plan_.back().first));
+		CPPUNIT_ASSERT(reference.erase(plan_.back().first));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(7), tree.lookup(marker + "1"));
+		compare_(tree, reference, plan_);
+	}
+
+	/// A build that does not fit in the arena leaves the tree as it was
+	void exhausted()
+	{
+		std::vector<std::pair<std::string, uint64_t>> small(plan_.begin(), plan_.begin() + plan_.size() / 2);
+		DecTree tree(ARENACHUNK), reference;
+		DecTreeBuilder builder(2);
+		std::mt19937_64 rnd(10);
+		std::string nr;
+		uint64_t allocated, free;
+
+		for (const auto & e : small) {
+			tree(e.first, e.second);
+			reference(e.first, e.second);
+		}
+		// Leave nodes waiting for reuse behind
+		for (size_t i = 0; i < small.size(); i += 4) {
+			tree.erase(small[i].first);
+			reference.erase(small[i].first);
+		}
+		allocated = tree.stats().allocated;
+		free = tree.stats().free;
+		CPPUNIT_ASSERT(free > 0);
+
+		for (size_t i = 0; i < 200000; i++) {
+			nr = std::to_string(UINT64_C(100000000000) + i * 4999);
+			builder.add(nr, 1 + i);
+		}
+		CPPUNIT_ASSERT_THROW(builder.build(tree), std::bad_alloc);
+
+		CPPUNIT_ASSERT_EQUAL(allocated, tree.stats().allocated);
+		CPPUNIT_ASSERT_EQUAL(free, tree.stats().free);
+		compare_(tree, reference, plan_);
+
+		// New nodes come from the free lists and the end of the arena, not from live ones
+		for (size_t i = 0; i < 2000; i++) {
+			nr = std::to_string(rnd() % 1000000000);
+			tree(nr, i + 1);
+			reference(nr, i + 1);
+		}
+		for (size_t i = 1; i < small.size(); i += 4) {
+			tree.erase(small[i].first);
+			reference.erase(small[i].first);
+		}
+		compare_(tree, reference, plan_);
+		CPPUNIT_ASSERT(tree.lookup(nr) != 0);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DecTreeBuilderCheck);
@@ -0,0 +1,252 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks diff() against a comparison of the contents of two trees, and
+ * that apply() of its result makes them equal. */
+class DiffCheck : public RandomFixture<27182>
+{
+	CPPUNIT_TEST_SUITE(DiffCheck);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(roundtrip);
+	CPPUNIT_TEST(strides);
+	CPPUNIT_TEST(again);
+	CPPUNIT_TEST(reuse);
+	CPPUNIT_TEST(version);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Get the contents of a tree.
+	 * @param tree_i Tree to enumerate.
+	 * @returns Prefixes with their destination. */
+	static std::map<std::string, uint64_t> contents_(const DecTree & tree_i)
+	{
+		std::map<std::string, uint64_t> rv;
+
+		tree_i.forEach([&rv](const std::string_view p, const uint64_t d) { rv.emplace(p, d); });
+		return rv;
+	}
+
+	/** Compare the result of diff() with the differences of the contents.
+	 * @param from_i Contents compared from.
+	 * @param to_i Contents compared to.
+	 * @param delta_i Differences found by diff(). */
+	static void compare_(const std::map<std::string, uint64_t> & from_i, const std::map<std::string, uint64_t> & to_i,
+		const std::vector<DecTree::change_t> & delta_i)
+	{
+		std::map<std::string, std::pair<uint64_t, uint64_t>> want;
+		size_t i = 0;
+
+		for (const auto & f : from_i) want[f.first].first = f.second;
+		for (const auto & t : to_i) want[t.first].second = t.second;
+		for (const auto & w : want) {
+			if (w.second.first == w.second.second) continue;
+			CPPUNIT_ASSERT_MESSAGE(w.first, i < delta_i.size());
+			CPPUNIT_ASSERT_EQUAL(w.first, delta_i[i].prefix);
+			CPPUNIT_ASSERT_EQUAL(w.second.first, delta_i[i].from);
+			CPPUNIT_ASSERT_EQUAL(w.second.second, delta_i[i].to);
+			i++;
+		}
+		CPPUNIT_ASSERT_EQUAL(i, delta_i.size());
+	}
+
+	/** Make a number of random modifications to a tree.
+	 * @param tree_io Tree to modify.
+	 * @param count_i Number of modifications. */
+	void modify_(DecTree & tree_io, const size_t count_i)
+	{
+		std::string nr;
+
+		for (size_t i = 0; i < count_i; i++) {
+			nr = number_(6);
+			switch (rng_() % 4) {
+				case 0:
+					tree_io.erase(nr);
+					break;
+				case 1:
+					tree_io.setRange(nr + "00", nr + "49", 1 + rng_() % 5);
+					break;
+				default:
+					tree_io(nr, 1 + rng_() % 5);
+			}
+		}
+	}
+
+	public:
+	/// Empty and unmodified trees have no differences, a tree with itself neither
+	void empty()
+	{
+		DecTree a, b;
+
+		CPPUNIT_ASSERT(a.diff(b).empty());
+		a("31", 1);
+		CPPUNIT_ASSERT(a.diff(a).empty());
+		compare_(contents_(a), {}, a.diff(b));
+		compare_({}, contents_(a), b.diff(a));
+		a.erase("31");
+		CPPUNIT_ASSERT(a.diff(b).empty());
+	}
+
+	/// Applying the differences to the tree compared from makes it equal to the other
+	void roundtrip()
+	{
+		std::vector<DecTree::change_t> delta;
+		DecTree a, b;
+
+		for (size_t round = 0; round < 10; round++) {
+			modify_(a, 300);
+			modify_(b, 300);
+			delta = a.diff(b);
+			compare_(contents_(a), contents_(b), delta);
+			CPPUNIT_ASSERT_EQUAL(delta.size(), a.apply(delta));
+			CPPUNIT_ASSERT(contents_(a) == contents_(b));
+			CPPUNIT_ASSERT(a.diff(b).empty());
+			CPPUNIT_ASSERT(b.diff(a).empty());
+		}
+	}
+
+	/// Trees with the same contents have no differences, whatever their strides
+	void strides()
+	{
+		DecTree a, b, c;
+
+		b.strides({ 2 });
+		c.strides({ 3, 2 });
+		for (size_t i = 0; i < 500; i++) {
+			std::string nr = number_(7);
+			uint64_t dest = 1 + rng_() % 5;
+
+			a(nr, dest);
+			b(nr, dest);
+			c(nr, dest);
+		}
+		CPPUNIT_ASSERT(a.diff(b).empty());
+		CPPUNIT_ASSERT(c.diff(a).empty());
+		b("123", 9);
+		c.erase("4");
+		compare_(contents_(b), contents_(c), b.diff(c));
+		compare_(contents_(c), contents_(a), c.diff(a));
+		b.consolidate();
+		compare_(contents_(a), contents_(b), a.diff(b));
+	}
+
+	/// Comparing again after modifications in place of either tree finds just those
+	void again()
+	{
+		DecTree a, b;
+
+		modify_(a, 1000);
+		modify_(b, 1000);
+		b.apply(b.diff(a));
+		for (size_t round = 0; round < 20; round++) {
+			CPPUNIT_ASSERT(a.diff(b).empty());
+			switch (round % 4) {
+				case 0:
+					modify_(a, 5);
+					break;
+				case 1:
+					b.begin();
+					modify_(b, 5);
+					b.commit();
+					break;
+				case 2:
+					a.consolidate();
+					modify_(a, 5);
+					break;
+				default:
+					modify_(b, 5);
+			}
+			compare_(contents_(a), contents_(b), a.diff(b));
+			compare_(contents_(b), contents_(a), b.diff(a));
+			a.apply(a.diff(b));
+		}
+		b.clear();
+		compare_(contents_(a), {}, a.diff(b));
+	}
+
+	/// Nodes freed by erasing or by transactions and reused by later modifications are compared again
+	void reuse()
+	{
+		DecTree a, b;
+
+		for (uint64_t i = 0; i < 100; i++) {
+			a(std::to_string(5000 + i), i + 1);
+			b(std::to_string(5000 + i), i + 1);
+		}
+		CPPUNIT_ASSERT(a.diff(b).empty());
+		for (size_t round = 0; round < 10; round++) {
+			// Nodes a transaction copies keep their contents until they are reused
+			if (round % 2) a.begin();
+			for (uint64_t i = 0; i < 100; i++) a.erase(std::to_string(5000 + i));
+			if (round % 2) a.commit();
+			for (uint64_t i = 0; i < 100; i++) a(std::to_string(7000 + i) + std::to_string(round), i + 1);
+			compare_(contents_(a), contents_(b), a.diff(b));
+			for (uint64_t i = 0; i < 100; i++) a.erase(std::to_string(7000 + i) + std::to_string(round));
+			for (uint64_t i = 0; i < 100; i++) a(std::to_string(5000 + i), i + 1 + round % 2);
+			compare_(contents_(a), contents_(b), a.diff(b));
+			b.apply(b.diff(a));
+		}
+	}
+
+	/// A pinned version compared with the tree finds the modifications since, also those outside transactions
+	void version()
+	{
+		std::map<std::string, uint64_t> before;
+		DecTree tree, copy;
+
+		modify_(tree, 500);
+		copy.apply(copy.diff(tree));
+		{
+			DecTree::Version v = tree.version();
+
+			before = contents_(tree);
+			CPPUNIT_ASSERT(tree.diff(v).empty());
+			modify_(tree, 50);
+			compare_(before, contents_(tree), tree.diff(v));
+
+			// The differences since the version bring a copy of it up to date
+			copy.apply(tree.diff(v));
+			CPPUNIT_ASSERT(contents_(copy) == contents_(tree));
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DiffCheck);
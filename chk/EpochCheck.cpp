@@ -0,0 +1,196 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+#include "Epoch.h"
+
+using namespace SdH;
+
+/** Checks epoch based reclamation: the epochs guards protect, and
+ * lookups on reader threads while a writer keeps setting, erasing and
+ * consolidating, so nodes and arenas are retired and reused under them. */
+class EpochCheck : public RandomFixture<28284>
+{
+	CPPUNIT_TEST_SUITE(EpochCheck);
+	CPPUNIT_TEST(guard);
+	CPPUNIT_TEST(nested);
+	CPPUNIT_TEST(churn);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Make the destination of a prefix, from which the prefix can be
+	 * told again.
+	 * @param lead_i Leading digit, 8 for stable prefixes and 9 for others.
+	 * @param prefix_i Prefix to make the destination of.
+	 * @returns Destination. */
+	static uint64_t dest_(const char lead_i, const std::string & prefix_i)
+	{
+		return std::stoull(lead_i + prefix_i);
+	}
+
+	/** Make a number below one of the first 50 blocks of the plan.
+	 * @param rnd_io Random generator.
+	 * @returns Number of 7 digits. */
+	static std::string block_(std::mt19937_64 & rnd_io)
+	{
+		return "2" + std::to_string(1000 + rnd_io() % 50).substr(1) + std::to_string(1000 + rnd_io() % 1000).substr(1);
+	}
+
+	public:
+	/// A guard keeps memory retired after it was entered from being released
+	void guard()
+	{
+		std::atomic<int> step(0);
+		uint64_t retired;
+		std::thread reader;
+
+		reader = std::thread([&step]() {
+			Epoch::Guard eg;
+
+			step = 1;
+			while (step != 2) std::this_thread::yield();
+		});
+		while (step != 1) std::this_thread::yield();
+		retired = Epoch::advance();
+		Epoch::advance();
+		CPPUNIT_ASSERT(!(retired < Epoch::safe()));
+		step = 2;
+		reader.join();
+		Epoch::advance();
+		CPPUNIT_ASSERT(retired < Epoch::safe());
+	}
+
+	/// Leaving a nested guard keeps the outer one in effect
+	void nested()
+	{
+		std::atomic<int> step(0);
+		uint64_t retired;
+		std::thread reader;
+
+		reader = std::thread([&step]() {
+			Epoch::Guard outer;
+
+			{
+				Epoch::Guard inner;
+
+				step = 1;
+				while (step != 2) std::this_thread::yield();
+			}
+			step = 3;
+			while (step != 4) std::this_thread::yield();
+		});
+		while (step != 1) std::this_thread::yield();
+		retired = Epoch::advance();
+		step = 2;
+		while (step != 3) std::this_thread::yield();
+		Epoch::advance();
+		CPPUNIT_ASSERT(!(retired < Epoch::safe()));
+		step = 4;
+		reader.join();
+		Epoch::advance();
+		CPPUNIT_ASSERT(retired < Epoch::safe());
+	}
+
+	/** Readers only ever find the destination of a prefix of the number
+	 * they look up: of the stable one below it, or of a longer one the
+	 * writer sets and erases. */
+	void churn()
+	{
+		std::map<std::string, uint64_t> ref;
+		std::set<std::string> vol;
+		std::atomic<bool> stop(false);
+		std::atomic<size_t> wrong(0), lookups(0), seed(0);
+		std::vector<std::thread> readers;
+		std::string nr;
+		DecTree tree;
+
+		// Stable prefixes of 4 digits, for every third block
+		for (uint64_t b = 0; b < 1000; b += 3) {
+			nr = "2" + std::to_string(1000 + b).substr(1);
+			tree(nr, dest_('8', nr));
+			ref[nr] = dest_('8', nr);
+		}
+		for (size_t r = 0; r < 3; r++) {
+			readers.emplace_back([&tree, &ref, &stop, &wrong, &lookups, &seed]() {
+				std::mt19937_64 rnd(seed++);
+				std::string nr, found;
+				uint64_t dest;
+
+				while (!stop) {
+					nr = block_(rnd);
+					dest = tree.lookup(nr);
+					lookups++;
+					if (dest == 0) {
+						if (reflookup(ref, nr) != 0) wrong++;
+						continue;
+					}
+					found = std::to_string(dest);
+					if (nr.compare(0, found.size() - 1, found, 1) != 0) wrong++;
+					else if (found[0] == '8' && dest != reflookup(ref, nr)) wrong++;
+					else if (found[0] == '9' && found.size() <= 5) wrong++;
+					else if (found[0] != '8' && found[0] != '9') wrong++;
+				}
+			});
+		}
+
+		// Longer prefixes below the first 50 blocks, set, erased and compacted
+		for (size_t i = 0; i < 30000 || lookups < 1000; i++) {
+			nr = block_(rng_);
+			nr.resize(5 + rng_() % 3);
+			if (rng_() % 2) {
+				tree(nr, dest_('9', nr));
+				vol.insert(nr);
+			} else CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, vol.erase(nr) > 0, tree.erase(nr));
+			if (i % 5000 == 4999) tree.consolidate();
+		}
+		stop = true;
+		for (auto & t : readers) t.join();
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), wrong.load());
+
+		for (const auto & v : vol) ref[v] = dest_('9', v);
+		for (uint64_t n = 0; n < 50000; n++) {
+			nr = "2" + std::to_string(1000000 + n).substr(1);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref, nr), tree.lookup(nr));
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EpochCheck);
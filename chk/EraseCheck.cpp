@@ -0,0 +1,233 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks erasing numbers, with sparse lists growing into full ones and
+ * shrinking again, pruning of emptied paths and reuse of freed nodes. */
+class EraseCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(EraseCheck);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(sparse);
+	CPPUNIT_TEST(dense);
+	CPPUNIT_TEST(prune);
+	CPPUNIT_TEST(reuse);
+	CPPUNIT_TEST(random);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Compare a tree with a reference map for all numbers of a length
+	 * below a prefix.
+	 * @param tree_i Tree to check.
+	 * @param ref_i Reference map of prefixes to destinations.
+	 * @param prefix_i Prefix of the numbers to compare.
+	 * @param digits_i Number of digits to append to the prefix. */
+	static void compare_(const DecTree & tree_i, const std::map<std::string, uint64_t> & ref_i, const std::string & prefix_i, const uint8_t digits_i)
+	{
+		std::string nr;
+		uint64_t n, count = 1;
+
+		for (uint8_t i = 0; i < digits_i; i++) count *= 10;
+		for (n = 0; n < count; n++) {
+			nr = std::to_string(n + count);
+			nr = prefix_i + nr.substr(1);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref_i, nr), tree_i.lookup(nr));
+		}
+	}
+
+	/** Number of sparse lists in a tree.
+	 * @param tree_i Tree to count in.
+	 * @returns Number of sparse lists over all levels. */
+	static uint64_t sparse_(const DecTree & tree_i)
+	{
+		uint64_t rv = 0;
+
+		for (const auto & l : tree_i.levels()) rv += l.sparse;
+		return rv;
+	}
+
+	public:
+	/// Erasing from a tree that has never been modified changes nothing
+	void empty()
+	{
+		DecTree tree;
+
+		CPPUNIT_ASSERT(!tree.erase("123"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.stats().updates);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.stats().allocated);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("123"));
+
+		tree("12", 1);
+		CPPUNIT_ASSERT(!tree.erase("123"));
+		CPPUNIT_ASSERT(!tree.erase("1"));
+		CPPUNIT_ASSERT(tree.erase("12"));
+		CPPUNIT_ASSERT(!tree.erase("12"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("12"));
+	}
+
+	/// A sparse list shrinks and stays sparse while children are erased
+	void sparse()
+	{
+		std::map<std::string, uint64_t> ref;
+		DecTree tree;
+		std::string nr;
+
+		tree("1", 1);
+		ref["1"] = 1;
+		for (char d = '0'; d < '0' + SPARSEMAX; d++) {
+			nr = std::string("1") + d + "5";
+			tree(nr, 10 + d);
+			ref[nr] = 10 + d;
+			CPPUNIT_ASSERT(sparse_(tree) > 0);
+		}
+		compare_(tree, ref, "1", 3);
+
+		for (char d = '0'; d < '0' + SPARSEMAX; d++) {
+			nr = std::string("1") + d + "5";
+			CPPUNIT_ASSERT(tree.erase(nr));
+			ref.erase(nr);
+			compare_(tree, ref, "1", 3);
+		}
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("1999"));
+	}
+
+	/// A sparse list becomes full when it outgrows SPARSEMAX children, and stays full
+	void dense()
+	{
+		std::map<std::string, uint64_t> ref;
+		DecTree tree;
+		std::string nr;
+		uint64_t before;
+
+		tree("2", 2);
+		ref["2"] = 2;
+		before = sparse_(tree);
+		for (char d = '0'; d <= '9'; d++) {
+			nr = std::string("2") + d;
+			tree(nr, 20 + d);
+			ref[nr] = 20 + d;
+		}
+		CPPUNIT_ASSERT_EQUAL(before, sparse_(tree));
+		compare_(tree, ref, "2", 2);
+
+		for (char d = '9'; d >= '0'; d -= 2) {
+			nr = std::string("2") + d;
+			CPPUNIT_ASSERT(tree.erase(nr));
+			ref.erase(nr);
+			compare_(tree, ref, "2", 2);
+		}
+		for (char d = '0'; d <= '9'; d += 2) {
+			nr = std::string("2") + d + "77";
+			tree(nr, 200 + d);
+			ref[nr] = 200 + d;
+		}
+		compare_(tree, ref, "2", 4);
+	}
+
+	/// Erasing the only entry below a list prunes the path up to the root
+	void prune()
+	{
+		DecTree tree;
+		uint64_t live;
+
+		tree("9", 9);
+		live = tree.stats().live;
+		tree("9876543210", 1);
+		CPPUNIT_ASSERT(tree.stats().live > live);
+		CPPUNIT_ASSERT(tree.erase("9876543210"));
+		CPPUNIT_ASSERT_EQUAL(live, tree.stats().live);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(9), tree.lookup("9876543210"));
+
+		// A list left with only its own destination becomes a leaf
+		tree("98", 98);
+		tree("987", 987);
+		CPPUNIT_ASSERT(tree.erase("987"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(98), tree.lookup("9876"));
+		CPPUNIT_ASSERT(tree.erase("98"));
+		CPPUNIT_ASSERT_EQUAL(live, tree.stats().live);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(9), tree.lookup("9876"));
+	}
+
+	/// Nodes freed by erasing are reused, so churn does not grow the arena
+	void reuse()
+	{
+		std::mt19937_64 rnd(11);
+		std::vector<std::string> numbers;
+		DecTree tree;
+		uint64_t allocated = 0;
+
+		for (size_t i = 0; i < 500; i++) numbers.push_back(std::to_string(rnd() % 100000000));
+		for (size_t round = 0; round < 5; round++) {
+			for (size_t i = 0; i < numbers.size(); i++) tree(numbers[i], i + 1);
+			for (const auto & nr : numbers) tree.erase(nr);
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup(numbers.front()));
+			if (round == 0) allocated = tree.stats().allocated;
+			else CPPUNIT_ASSERT_EQUAL(allocated, tree.stats().allocated);
+		}
+	}
+
+	/// Random sets and erases with several stride profiles, checked against a map
+	void random()
+	{
+		const std::vector<std::vector<uint8_t>> profiles = { {}, { 2 }, { 3, 2 } };
+		std::map<std::string, uint64_t> ref;
+		std::string nr;
+
+		for (const auto & p : profiles) {
+			std::mt19937_64 rnd(12);
+			DecTree tree;
+
+			ref.clear();
+			tree.strides(p);
+			for (size_t i = 0; i < 20000; i++) {
+				nr = std::to_string(rnd() % 100000);
+				nr = nr.substr(0, 1 + rnd() % nr.size());
+				if (rnd() % 3) {
+					tree(nr, i + 1);
+					ref[nr] = i + 1;
+				} else CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref.erase(nr) > 0, tree.erase(nr));
+			}
+			compare_(tree, ref, "", 5);
+		}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EraseCheck);
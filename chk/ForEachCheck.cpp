@@ -0,0 +1,239 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks that forEach() and forEachUnder() visit exactly the prefixes with
+ * a destination, in ascending order, whatever the strides and list kinds. */
+class ForEachCheck : public RandomFixture<16180>
+{
+	CPPUNIT_TEST_SUITE(ForEachCheck);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(order);
+	CPPUNIT_TEST(under);
+	CPPUNIT_TEST(deep);
+	CPPUNIT_TEST(modified);
+	CPPUNIT_TEST(version);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Entries visited, in order of visiting
+	typedef std::vector<std::pair<std::string, uint64_t>> visited_t;
+
+	/// Stride profiles to check with
+	static const std::vector<std::vector<uint8_t>> profiles_;
+
+	/** Enumerate a tree, or the part of it below a prefix.
+	 * @param tree_i Tree to enumerate.
+	 * @param prefix_i Prefix to enumerate below, nullptr for all.
+	 * @returns Entries in order of visiting. */
+	static visited_t each_(const DecTree & tree_i, const char *prefix_i = nullptr)
+	{
+		visited_t rv;
+		size_t count;
+		auto visit = [&rv](const std::string_view p, const uint64_t d) { rv.emplace_back(p, d); };
+
+		count = prefix_i ? tree_i.forEachUnder(prefix_i, visit) : tree_i.forEach(visit);
+		CPPUNIT_ASSERT_EQUAL(rv.size(), count);
+		return rv;
+	}
+
+	/** Get the entries of a reference map starting with a prefix, which
+	 * std::map keeps in ascending order.
+	 * @param ref_i Reference map.
+	 * @param prefix_i Prefix, empty for all.
+	 * @returns Entries in ascending order. */
+	static visited_t expect_(const std::map<std::string, uint64_t> & ref_i, const std::string & prefix_i = "")
+	{
+		visited_t rv;
+
+		for (auto it = ref_i.lower_bound(prefix_i); it != ref_i.end() && it->first.compare(0, prefix_i.size(), prefix_i) == 0; ++it) {
+			rv.push_back(*it);
+		}
+		return rv;
+	}
+
+	/** Fill a tree and a reference map with the same random numbers, dense
+	 * enough at the top for full lists and sparse enough below for
+	 * sparse ones.
+	 * @param tree_io Tree to fill.
+	 * @param ref_io Reference map to fill.
+	 * @param count_i Number of numbers to set. */
+	void fill_(DecTree & tree_io, std::map<std::string, uint64_t> & ref_io, const size_t count_i)
+	{
+		std::string nr;
+		uint64_t dest;
+
+		for (size_t i = 0; i < count_i; i++) {
+			nr = number_(i % 3 ? 4 : 9);
+			dest = 1 + rng_() % 1000;
+			tree_io(nr, dest);
+			ref_io[nr] = dest;
+		}
+	}
+
+	public:
+	/// An empty tree visits nothing, nor does a prefix without anything below it
+	void empty()
+	{
+		DecTree tree;
+
+		CPPUNIT_ASSERT(each_(tree).empty());
+		CPPUNIT_ASSERT(each_(tree, "31").empty());
+		tree("31", 1);
+		tree.erase("31");
+		CPPUNIT_ASSERT(each_(tree).empty());
+		tree("4", 2);
+		CPPUNIT_ASSERT(each_(tree, "3").empty());
+		CPPUNIT_ASSERT(each_(tree, "41").empty());
+	}
+
+	/// All prefixes are visited in ascending order, shorter ones before longer ones
+	void order()
+	{
+		for (const auto & p : profiles_) {
+			std::map<std::string, uint64_t> ref;
+			DecTree tree;
+
+			tree.strides(p);
+			fill_(tree, ref, 3000);
+			CPPUNIT_ASSERT(each_(tree) == expect_(ref));
+		}
+	}
+
+	/// Only the prefix itself and those starting with it are visited, also for prefixes inside a stride
+	void under()
+	{
+		const std::vector<std::string> prefixes = { "", "3", "31", "314", "3141", "31415", "0", "00", "999", "123456789", "1234567890" };
+
+		for (const auto & p : profiles_) {
+			std::map<std::string, uint64_t> ref;
+			DecTree tree;
+
+			tree.strides(p);
+			fill_(tree, ref, 3000);
+			tree("31415", 7);
+			ref["31415"] = 7;
+			tree("123456789", 8);
+			ref["123456789"] = 8;
+			for (const auto & u : prefixes) CPPUNIT_ASSERT_MESSAGE(u, each_(tree, u.c_str()) == expect_(ref, u));
+			for (size_t i = 0; i < 200; i++) {
+				std::string u = number_(5);
+
+				CPPUNIT_ASSERT_MESSAGE(u, each_(tree, u.c_str()) == expect_(ref, u));
+			}
+		}
+	}
+
+	/// Numbers longer than the stack is reserved for grow it
+	void deep()
+	{
+		std::map<std::string, uint64_t> ref;
+		std::string nr;
+		DecTree tree;
+
+		for (uint64_t i = 1; i <= 3 * EACHDEPTH; i++) {
+			nr.push_back('0' + i % 10);
+			if (i % 5 == 0) {
+				tree(nr, i);
+				ref[nr] = i;
+			}
+		}
+		tree(nr.substr(0, 40) + "5", 1000);
+		ref[nr.substr(0, 40) + "5"] = 1000;
+		CPPUNIT_ASSERT(each_(tree) == expect_(ref));
+		CPPUNIT_ASSERT(each_(tree, nr.substr(0, 40).c_str()) == expect_(ref, nr.substr(0, 40)));
+	}
+
+	/// The order holds after erasing, with sparse lists shrinking, and after consolidating
+	void modified()
+	{
+		std::map<std::string, uint64_t> ref;
+		std::vector<std::string> numbers;
+		DecTree tree;
+
+		tree.strides({ 2 });
+		fill_(tree, ref, 2000);
+		for (const auto & r : ref) numbers.push_back(r.first);
+		for (size_t i = 0; i < numbers.size(); i += 2) {
+			tree.erase(numbers[i]);
+			ref.erase(numbers[i]);
+		}
+		CPPUNIT_ASSERT(each_(tree) == expect_(ref));
+		tree.consolidate();
+		CPPUNIT_ASSERT(each_(tree) == expect_(ref));
+		CPPUNIT_ASSERT(each_(tree, "5") == expect_(ref, "5"));
+	}
+
+	/// A pinned version enumerates what it pinned
+	void version()
+	{
+		std::map<std::string, uint64_t> ref;
+		visited_t got;
+		DecTree tree;
+
+		fill_(tree, ref, 1000);
+		DecTree::Version v = tree.version();
+		tree("5", 1);
+		tree.erase(ref.begin()->first);
+		v.forEach([&got](const std::string_view p, const uint64_t d) { got.emplace_back(p, d); });
+		CPPUNIT_ASSERT(got == expect_(ref));
+		got.clear();
+		v.forEachUnder("7", [&got](const std::string_view p, const uint64_t d) { got.emplace_back(p, d); });
+		CPPUNIT_ASSERT(got == expect_(ref, "7"));
+	}
+
+	/// A prefix with anything but digits is refused
+	void invalid()
+	{
+		DecTree tree;
+
+		tree("31", 1);
+		CPPUNIT_ASSERT_THROW(each_(tree, "3a"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(each_(tree, "-1"), std::invalid_argument);
+	}
+};
+
+const std::vector<std::vector<uint8_t>> ForEachCheck::profiles_ = { {}, { 2 }, { 3, 2 }, { 1, 3 } };
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ForEachCheck);
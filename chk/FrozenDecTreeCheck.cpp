@@ -0,0 +1,166 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <array>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+#include "FrozenDecTree.h"
+#include "FrozenPlan.h"
+
+using namespace SdH;
+
+/** Checks that a FrozenDecTree, generated by dectreegen from CHKPLAN, and a
+ * DecTree filled at runtime from the same plan agree. */
+class FrozenDecTreeCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(FrozenDecTreeCheck);
+	CPPUNIT_TEST(entries);
+	CPPUNIT_TEST(numbers);
+	CPPUNIT_TEST(constant);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Entries of the plan
+	std::vector<std::pair<std::string, uint64_t>> plan_;
+
+	/// Tree filled one entry at a time, so laid out differently
+	DecTree *tree_;
+
+	/** Check one number through every lookup method.
+	 * @param number_i Number to check. */
+	void check_(const std::string & number_i)
+	{
+		std::array<DecTree::match_t, 8> runtime, frozen;
+		size_t n;
+		uint64_t bcd = 0;
+
+		CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, tree_->lookup(number_i), plan_t::lookup(number_i));
+
+		n = tree_->lookupAll(number_i, runtime);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, n, plan_t::lookupAll(number_i, frozen));
+		for (size_t i = 0; i < n; i++) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, runtime[i].digits, frozen[i].digits);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, runtime[i].destination, frozen[i].destination);
+		}
+
+		if (number_i.size() <= 16) {
+			for (size_t i = 0; i < 16; i++) bcd = (bcd << 4) | (i < number_i.size() ? number_i[i] - '0' : 0xF);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, tree_->lookupBCD(bcd), plan_t::lookupBCD(bcd));
+		}
+		if (number_i.size() <= 19) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i,
+				tree_->lookupInt(std::stoull("0" + number_i), number_i.size()),
+				plan_t::lookupInt(std::stoull("0" + number_i), number_i.size()));
+		}
+	}
+
+	public:
+	void setUp()
+	{
+		std::ifstream in(CHKPLAN);
+		std::string line;
+		size_t comma;
+
+		tree_ = new DecTree();
+		tree_->strides({ 2, 3 });
+		while (std::getline(in, line)) {
+			comma = line.find(',');
+			if (comma == std::string::npos) continue;
+			plan_.emplace_back(line.substr(0, comma), std::stoull(line.substr(comma + 1)));
+			(*tree_)(plan_.back().first, plan_.back().second);
+		}
+		CPPUNIT_ASSERT(!plan_.empty());
+	}
+
+	void tearDown()
+	{
+		delete tree_;
+		tree_ = nullptr;
+		plan_.clear();
+	}
+
+	/// Every entry of the plan, and every number one digit longer
+	void entries()
+	{
+		for (const auto & e : plan_) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(e.first, e.second, plan_t::lookup(e.first));
+			check_(e.first);
+			for (char d = '0'; d <= '9'; d++) check_(e.first + d);
+		}
+	}
+
+	/// Numbers of all lengths, most of them sharing a prefix with an entry
+	void numbers()
+	{
+		std::mt19937_64 rnd(20);
+		std::string number;
+
+		for (size_t i = 0; i < 100000; i++) {
+			number = i % 4 ? plan_[rnd() % plan_.size()].first : std::string();
+			number.resize(1 + rnd() % 20, '0');
+			for (size_t p = i % 4 ? number.size() / 2 : 0; p < number.size(); p++) number[p] = '0' + rnd() % 10;
+			check_(number);
+		}
+		check_("");
+	}
+
+	/// Lookups of constant numbers are evaluated by the compiler
+	void constant()
+	{
+		constexpr uint64_t dest = plan_t::lookup("31612345678");
+		constexpr uint64_t none = plan_t::lookup("");
+
+		CPPUNIT_ASSERT_EQUAL(tree_->lookup("31612345678"), dest);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), none);
+		CPPUNIT_ASSERT_EQUAL(sizeof(plan_arena), plan_t::bytes());
+	}
+
+	/// Invalid digits are refused like DecTree does
+	void invalid()
+	{
+		CPPUNIT_ASSERT_THROW(plan_t::lookup("31a"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(plan_t::lookupBCD(UINT64_C(0x31AFFFFFFFFFFFFF)), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(plan_t::lookupInt(123, 2), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(plan_t::lookupInt(5, 0), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(plan_t::lookupInt(UINT64_MAX, 19), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(plan_t::lookupInt(0, 21), std::invalid_argument);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FrozenDecTreeCheck);
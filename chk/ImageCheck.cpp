@@ -0,0 +1,256 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks saving images, mapping them read-only with open() and reading
+ * them with load(), and refusing files that are not valid images. */
+class ImageCheck : public RandomFixture<14142>
+{
+	CPPUNIT_TEST_SUITE(ImageCheck);
+	CPPUNIT_TEST(opened);
+	CPPUNIT_TEST(loaded);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(readonly);
+	CPPUNIT_TEST(cleared);
+	CPPUNIT_TEST(rejected);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Path of the image
+	std::string path_;
+
+	/// Contents of the tree saved
+	std::map<std::string, uint64_t> ref_;
+
+	/** Fill a tree with random numbers, in part in a transaction, so the
+	 * root has moved away from where images keep it.
+	 * @param tree_io Tree to fill. */
+	void fill_(DecTree & tree_io)
+	{
+		std::string nr;
+
+		for (size_t i = 0; i < 2000; i++) {
+			if (i == 1000) tree_io.begin();
+			nr = number_(9);
+			tree_io(nr, i + 1);
+			ref_[nr] = i + 1;
+		}
+		tree_io.commit();
+	}
+
+	/** Compare a tree with the contents saved, by lookups of the saved
+	 * numbers and of random ones.
+	 * @param tree_i Tree to check. */
+	void compare_(const DecTree & tree_i)
+	{
+		std::string nr;
+
+		for (const auto & r : ref_) CPPUNIT_ASSERT_EQUAL_MESSAGE(r.first, r.second, tree_i.lookup(r.first));
+		for (size_t i = 0; i < 2000; i++) {
+			nr = number_(12);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref_, nr), tree_i.lookup(nr));
+		}
+	}
+
+	/** Overwrite part of the image.
+	 * @param offset_i Offset in the file.
+	 * @param data_i Bytes to write.
+	 * @param bytes_i Number of bytes. */
+	void patch_(const off_t offset_i, const void *data_i, const size_t bytes_i)
+	{
+		int fd = ::open(path_.c_str(), O_WRONLY);
+
+		CPPUNIT_ASSERT(fd >= 0);
+		CPPUNIT_ASSERT_EQUAL(static_cast<ssize_t>(bytes_i), pwrite(fd, data_i, bytes_i, offset_i));
+		::close(fd);
+	}
+
+	public:
+	void setUp()
+	{
+		RandomFixture<14142>::setUp();
+		path_ = std::string(P_tmpdir) + "/imagecheck." + std::to_string(getpid()) + ".img";
+		unlink(path_.c_str());
+	}
+
+	void tearDown()
+	{
+		unlink(path_.c_str());
+		ref_.clear();
+	}
+
+	/// An opened image serves the same lookups as the tree saved, with any strides
+	void opened()
+	{
+		for (const std::vector<uint8_t> & strides : { std::vector<uint8_t>(), std::vector<uint8_t>({ 2, 3 }) }) {
+			DecTree saved, mapped;
+
+			ref_.clear();
+			saved.strides(strides);
+			fill_(saved);
+			saved.save(path_);
+			mapped.open(path_);
+			CPPUNIT_ASSERT(mapped.readonly());
+			CPPUNIT_ASSERT(!saved.readonly());
+			compare_(mapped);
+			CPPUNIT_ASSERT(mapped.diff(saved).empty());
+		}
+	}
+
+	/// A loaded image can be modified, and saved again
+	void loaded()
+	{
+		DecTree saved, loaded, again;
+
+		fill_(saved);
+		saved.save(path_);
+		loaded.load(path_);
+		CPPUNIT_ASSERT(!loaded.readonly());
+		compare_(loaded);
+		loaded("5", 5);
+		ref_["5"] = 5;
+		loaded.save(path_);
+		again.open(path_);
+		compare_(again);
+	}
+
+	/// An empty tree saves an image without arena, which opens as an empty tree
+	void empty()
+	{
+		DecTree saved, mapped;
+
+		saved.save(path_);
+		mapped("1", 1);
+		mapped.open(path_);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), mapped.lookup("1"));
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), mapped.forEach([](const std::string_view, const uint64_t) { }));
+	}
+
+	/// A tree opened from an image refuses every modification and keeps its contents
+	void readonly()
+	{
+		DecTree saved, mapped;
+
+		fill_(saved);
+		saved.save(path_);
+		mapped.open(path_);
+		CPPUNIT_ASSERT_THROW(mapped("1", 1), std::logic_error);
+		CPPUNIT_ASSERT_THROW(mapped.erase(ref_.begin()->first), std::logic_error);
+		CPPUNIT_ASSERT_THROW(mapped.setRange("100", "199", 1), std::logic_error);
+		CPPUNIT_ASSERT_THROW(mapped.begin(), std::logic_error);
+		CPPUNIT_ASSERT_THROW(mapped.apply({ { "1", 0, 1 } }), std::logic_error);
+		CPPUNIT_ASSERT_THROW(mapped.consolidate(), std::logic_error);
+		CPPUNIT_ASSERT(mapped.readonly());
+		compare_(mapped);
+	}
+
+	/// Clearing an opened tree makes it writable again, loading over it too
+	void cleared()
+	{
+		DecTree saved, mapped;
+
+		fill_(saved);
+		saved.save(path_);
+		mapped.open(path_);
+		mapped.clear();
+		CPPUNIT_ASSERT(!mapped.readonly());
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), mapped.lookup(ref_.begin()->first));
+		mapped("1", 1);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), mapped.lookup("123"));
+
+		mapped.open(path_);
+		CPPUNIT_ASSERT(mapped.readonly());
+		mapped.load(path_);
+		CPPUNIT_ASSERT(!mapped.readonly());
+		compare_(mapped);
+	}
+
+	/// Truncated files and headers of another format or version are refused, leaving the tree alone
+	void rejected()
+	{
+		const uint32_t version = IMAGEVERSION + 1;
+		DecTree saved, tree;
+		off_t size;
+		int fd;
+
+		fill_(saved);
+		tree("1", 1);
+
+		// A file that is no image at all
+		fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		CPPUNIT_ASSERT(fd >= 0);
+		CPPUNIT_ASSERT_EQUAL(static_cast<ssize_t>(10), write(fd, "SdHDecTr..", 10));
+		::close(fd);
+		CPPUNIT_ASSERT_THROW(tree.open(path_), std::runtime_error);
+		CPPUNIT_ASSERT_THROW(tree.load(path_), std::runtime_error);
+		CPPUNIT_ASSERT_THROW(tree.open(path_ + ".missing"), std::runtime_error);
+
+		// An arena cut short
+		saved.save(path_);
+		fd = ::open(path_.c_str(), O_RDWR);
+		CPPUNIT_ASSERT(fd >= 0);
+		size = lseek(fd, 0, SEEK_END);
+		CPPUNIT_ASSERT_EQUAL(0, ftruncate(fd, size - 8));
+		::close(fd);
+		CPPUNIT_ASSERT_THROW(tree.open(path_), std::runtime_error);
+		CPPUNIT_ASSERT_THROW(tree.load(path_), std::runtime_error);
+
+		// Another version, after the magic and byte order marker
+		saved.save(path_);
+		patch_(16, &version, sizeof(version));
+		CPPUNIT_ASSERT_THROW(tree.open(path_), std::runtime_error);
+		CPPUNIT_ASSERT_THROW(tree.load(path_), std::runtime_error);
+
+		// Another magic
+		saved.save(path_);
+		patch_(0, "SdHJourn", 8);
+		CPPUNIT_ASSERT_THROW(tree.open(path_), std::runtime_error);
+
+		CPPUNIT_ASSERT(!tree.readonly());
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("123"));
+		tree("2", 2);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ImageCheck);
@@ -0,0 +1,420 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <csignal>
+#include <cstdio>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks recovering a tree from a snapshot and a journal, with
+ * transactions, torn or corrupted records at the end and modifications
+ * that fail. */
+class JournalCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(JournalCheck);
+	CPPUNIT_TEST(replay);
+	CPPUNIT_TEST(transactions);
+	CPPUNIT_TEST(truncated);
+	CPPUNIT_TEST(corrupt);
+	CPPUNIT_TEST(failed);
+	CPPUNIT_TEST(rollback);
+	CPPUNIT_TEST(apply);
+	CPPUNIT_TEST(checkpoint);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Path of the snapshot
+	std::string snapshot_;
+
+	/// Path of the journal
+	std::string journal_;
+
+	/// Numbers to compare trees with
+	std::vector<std::string> numbers_;
+
+	/// Limit of the file size before limit_() lowered it
+	struct rlimit fsize_;
+
+	/** Let writes to the journal fail beyond a number of bytes more than
+	 * it holds now, as if the disk were full.
+	 * @param bytes_i Number of bytes that can still be written. */
+	void limit_(const uint64_t bytes_i)
+	{
+		struct rlimit rl = fsize_;
+		struct stat st;
+
+		CPPUNIT_ASSERT_EQUAL(0, stat(journal_.c_str(), &st));
+		rl.rlim_cur = st.st_size + bytes_i;
+		CPPUNIT_ASSERT_EQUAL(0, setrlimit(RLIMIT_FSIZE, &rl));
+	}
+
+	/// Let writes to the journal succeed again
+	void unlimit_()
+	{
+		CPPUNIT_ASSERT_EQUAL(0, setrlimit(RLIMIT_FSIZE, &fsize_));
+	}
+
+	/** Compare two trees for all numbers in numbers_.
+	 * @param a_i First tree.
+	 * @param b_i Second tree. */
+	void compare_(const DecTree & a_i, const DecTree & b_i)
+	{
+		for (const auto & nr : numbers_) CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, a_i.lookup(nr), b_i.lookup(nr));
+	}
+
+	/** Apply the same random modifications to a tree and a reference.
+	 * @param tree_io Journaling tree.
+	 * @param ref_io Reference tree.
+	 * @param seed_i Seed of the modifications.
+	 * @param count_i Number of modifications. */
+	static void modify_(DecTree & tree_io, DecTree & ref_io, const uint64_t seed_i, const size_t count_i)
+	{
+		std::mt19937_64 rnd(seed_i);
+		std::string nr, to;
+
+		for (size_t i = 0; i < count_i; i++) {
+			nr = std::to_string(rnd() % 1000000);
+			switch (rnd() % 4) {
+				case 0:
+					tree_io.erase(nr.substr(0, 3));
+					ref_io.erase(nr.substr(0, 3));
+					break;
+				case 1:
+					to = nr;
+					to[to.size() - 1] = '9';
+					tree_io.setRange(nr, to, i + 1);
+					ref_io.setRange(nr, to, i + 1);
+					break;
+				default:
+					tree_io(nr.substr(0, 1 + i % nr.size()), i + 1);
+					ref_io(nr.substr(0, 1 + i % nr.size()), i + 1);
+					break;
+			}
+		}
+	}
+
+	/** Size of the journal file.
+	 * @returns Size in bytes. */
+	off_t size_()
+	{
+		struct stat st;
+
+		CPPUNIT_ASSERT_EQUAL(0, stat(journal_.c_str(), &st));
+		return st.st_size;
+	}
+
+	public:
+	void setUp()
+	{
+		std::string base = std::string(P_tmpdir) + "/journalcheck." + std::to_string(getpid());
+
+		snapshot_ = base + ".img";
+		journal_ = base + ".jnl";
+		unlink(snapshot_.c_str());
+		unlink(journal_.c_str());
+		getrlimit(RLIMIT_FSIZE, &fsize_);
+
+		// Writing beyond the file size limit fails with EFBIG instead
+		signal(SIGXFSZ, SIG_IGN);
+		for (size_t i = 0; i < 2000; i++) numbers_.push_back(std::to_string(UINT64_C(1000000) + i * 499).substr(1));
+	}
+
+	void tearDown()
+	{
+		setrlimit(RLIMIT_FSIZE, &fsize_);
+		signal(SIGXFSZ, SIG_DFL);
+		unlink(snapshot_.c_str());
+		unlink(journal_.c_str());
+		numbers_.clear();
+	}
+
+	/// Every kind of modification is replayed
+	void replay()
+	{
+		DecTree ref;
+
+		{
+			DecTree tree;
+
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.journal(snapshot_, journal_));
+			modify_(tree, ref, 1, 500);
+			tree.clear();
+			ref.clear();
+			modify_(tree, ref, 2, 500);
+		}
+
+		DecTree tree;
+
+		CPPUNIT_ASSERT(tree.journal(snapshot_, journal_) > 0);
+		compare_(tree, ref);
+	}
+
+	/// Only committed transactions are replayed, an unfinished one is dropped
+	void transactions()
+	{
+		DecTree ref;
+
+		{
+			DecTree tree;
+
+			tree.journal(snapshot_, journal_, 1);
+			tree("31", 1);
+			ref("31", 1);
+			tree.begin();
+			tree("3120", 2);
+			tree.erase("31");
+			tree.commit();
+			ref("3120", 2);
+			ref.erase("31");
+			tree.begin();
+			tree("32", 3);
+			tree.rollback();
+			tree.begin();
+			tree("33", 4);
+			tree.sync();
+		}
+
+		DecTree tree;
+
+		tree.journal(snapshot_, journal_, 1);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("33"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("32"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.lookup("31209"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("3119"));
+		compare_(tree, ref);
+
+		// Records after the dropped transaction follow the complete ones
+		tree("34", 5);
+		ref("34", 5);
+		tree.sync();
+		DecTree again;
+		again.journal(snapshot_, journal_);
+		compare_(again, ref);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(5), again.lookup("345"));
+	}
+
+	/// A record torn by a crash is cut off
+	void truncated()
+	{
+		DecTree ref;
+		off_t size;
+
+		{
+			DecTree tree;
+
+			tree.journal(snapshot_, journal_, 1);
+			modify_(tree, ref, 3, 200);
+			tree("4444", 44);
+		}
+		size = size_();
+		CPPUNIT_ASSERT_EQUAL(0, ::truncate(journal_.c_str(), size - 3));
+
+		DecTree tree;
+
+		tree.journal(snapshot_, journal_);
+		CPPUNIT_ASSERT_EQUAL(ref.lookup("4444"), tree.lookup("4444"));
+		compare_(tree, ref);
+		CPPUNIT_ASSERT(size_() < size - 3);
+
+		tree("4445", 45);
+		ref("4445", 45);
+		tree.sync();
+		DecTree again;
+		again.journal(snapshot_, journal_);
+		compare_(again, ref);
+	}
+
+	/// A record with a wrong checksum ends the replay
+	void corrupt()
+	{
+		DecTree ref;
+		FILE *f;
+		int c;
+
+		{
+			DecTree tree;
+
+			tree.journal(snapshot_, journal_, 1);
+			modify_(tree, ref, 4, 200);
+			tree("5555", 55);
+		}
+		f = fopen(journal_.c_str(), "r+b");
+		CPPUNIT_ASSERT(f != nullptr);
+		fseek(f, -1, SEEK_END);
+		c = fgetc(f);
+		fseek(f, -1, SEEK_END);
+		fputc(c ^ 0x5A, f);
+		fclose(f);
+
+		DecTree tree;
+
+		tree.journal(snapshot_, journal_);
+		CPPUNIT_ASSERT_EQUAL(ref.lookup("5555"), tree.lookup("5555"));
+		compare_(tree, ref);
+	}
+
+	/// A modification that fails is not replayed, or only the part that was made
+	void failed()
+	{
+		std::vector<std::string> recorded;
+		std::vector<uint64_t> found;
+		std::mt19937_64 rnd(5);
+		std::string nr;
+		bool full = false;
+
+		{
+			DecTree tree(ARENACHUNK);
+
+			tree.journal(snapshot_, journal_, 1);
+			for (size_t i = 0; !full; i++) {
+				nr = std::to_string(rnd() % UINT64_C(1000000000000));
+				try {
+					if (i % 8) tree(nr, i + 1);
+					else tree.setRange(nr.substr(0, 6) + "000000", nr.substr(0, 6) + "999999", i + 1);
+				} catch (const std::bad_alloc &) {
+					full = true;
+				}
+				recorded.push_back(nr);
+			}
+			CPPUNIT_ASSERT_THROW(tree.setRange("123456789012", "987654321098", 1), std::bad_alloc);
+			for (const auto & n : recorded) found.push_back(tree.lookup(n));
+			for (const auto & n : numbers_) found.push_back(tree.lookup(n));
+		}
+
+		DecTree tree;
+
+		tree.journal(snapshot_, journal_);
+		for (size_t i = 0; i < recorded.size(); i++) CPPUNIT_ASSERT_EQUAL_MESSAGE(recorded[i], found[i], tree.lookup(recorded[i]));
+		for (size_t i = 0; i < numbers_.size(); i++) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(numbers_[i], found[recorded.size() + i], tree.lookup(numbers_[i]));
+		}
+	}
+
+	/// A rollback that cannot be journaled still ends the transaction, and replay drops it
+	void rollback()
+	{
+		{
+			DecTree tree;
+
+			tree.journal(snapshot_, journal_, 1);
+			tree("31", 1);
+			tree.begin();
+			tree("32", 2);
+			limit_(0);
+			tree.rollback();
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("32"));
+			unlimit_();
+
+			// Writers of other threads do not wait for the dropped transaction
+			std::thread([&tree]() { tree("33", 3); }).join();
+			tree.begin();
+			tree("34", 4);
+			tree.commit();
+		}
+
+		DecTree tree;
+
+		tree.journal(snapshot_, journal_);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("31"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("32"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(3), tree.lookup("33"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(4), tree.lookup("34"));
+	}
+
+	/// An apply() that cannot journal its changes or its commit reports that, not the failed rollback
+	void apply()
+	{
+		// A begin record takes 6 bytes, setting a single digit 15
+		for (const uint64_t bytes : { UINT64_C(6), UINT64_C(21) }) {
+			{
+				DecTree tree;
+
+				tree.journal(snapshot_, journal_, 1);
+				tree("5", 1);
+				limit_(bytes);
+				CPPUNIT_ASSERT_THROW(tree.apply({ { "5", 1, 2 } }), std::runtime_error);
+				unlimit_();
+				CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("5"));
+
+				// The transaction has ended, so this thread can begin another and others can write
+				tree.begin();
+				tree.rollback();
+				std::thread([&tree]() { tree("6", 6); }).join();
+				CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), tree.apply({ { "5", 1, 3 } }));
+			}
+
+			DecTree tree;
+
+			tree.journal(snapshot_, journal_);
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(3), tree.lookup("5"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(6), tree.lookup("6"));
+			tree.clear();
+			tree.checkpoint();
+		}
+	}
+
+	/// A checkpoint empties the journal, and later records are replayed on top of the snapshot
+	void checkpoint()
+	{
+		DecTree ref;
+		off_t empty;
+
+		{
+			DecTree tree;
+
+			tree.journal(snapshot_, journal_);
+			empty = size_();
+			modify_(tree, ref, 6, 300);
+			tree.checkpoint();
+			CPPUNIT_ASSERT_EQUAL(empty, size_());
+			modify_(tree, ref, 7, 300);
+		}
+
+		DecTree tree;
+
+		CPPUNIT_ASSERT(tree.journal(snapshot_, journal_) <= 300);
+		compare_(tree, ref);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(JournalCheck);
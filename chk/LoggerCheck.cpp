@@ -0,0 +1,131 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Logger.h"
+
+/** Checks the output of the logging macros in synchronous and asynchronous
+ * mode. Asynchronous mode cannot be left again, so the checks run in that
+ * order and log to stderr again when done. */
+class LoggerCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(LoggerCheck);
+	CPPUNIT_TEST(sync);
+	CPPUNIT_TEST(async);
+	CPPUNIT_TEST(dropped);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Stream logged to
+	std::ostringstream out_;
+
+	/** Count the lines of the output containing a string.
+	 * @param what_i String to look for.
+	 * @returns Number of lines. */
+	size_t count_(const std::string & what_i)
+	{
+		std::istringstream in(out_.str());
+		std::string line;
+		size_t rv = 0;
+
+		while (std::getline(in, line)) if (line.find(what_i) != std::string::npos) rv++;
+		return rv;
+	}
+
+	public:
+	void setUp()
+	{
+		out_.str("");
+		Fs2a::Logger::instance()->stream(&out_);
+	}
+
+	void tearDown()
+	{
+		Fs2a::Logger::instance()->flush();
+		Fs2a::Logger::instance()->stderror();
+	}
+
+	/// Entries are written before the macros return
+	void sync()
+	{
+		LI("printf %d", 1);
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), count_("INFO printf 1"));
+		FW("fmt {}", 2);
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), count_("WARNING fmt 2"));
+		try {
+			FCET(false, std::runtime_error, "thrown {}", 3);
+		} catch (const std::runtime_error & e) {
+			CPPUNIT_ASSERT(std::string(e.what()).find("ERROR thrown 3") != std::string::npos);
+		}
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), count_("ERROR thrown 3"));
+	}
+
+	/// Entries are written by the background thread, in order and with their levels
+	void async()
+	{
+		Fs2a::Logger::instance()->async(16);
+		LI("printf %d", 1);
+		FW("fmt {}", 2);
+		try {
+			FCET(false, std::runtime_error, "thrown {}", 3);
+		} catch (const std::runtime_error & e) {
+			CPPUNIT_ASSERT(std::string(e.what()).find("LoggerCheck.cpp") != std::string::npos);
+			CPPUNIT_ASSERT(std::string(e.what()).find("thrown 3") != std::string::npos);
+		}
+		Fs2a::Logger::instance()->flush();
+
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), count_("INFO printf 1"));
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), count_("WARNING fmt 2"));
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), count_("ERROR thrown 3"));
+		CPPUNIT_ASSERT(out_.str().find("printf 1") < out_.str().find("fmt 2"));
+		CPPUNIT_ASSERT(out_.str().find("fmt 2") < out_.str().find("thrown 3"));
+	}
+
+	/// Entries that do not fit in a full ring are dropped and counted
+	void dropped()
+	{
+		uint64_t before = Fs2a::Logger::instance()->dropped();
+
+		// A new thread gets a ring of the size asked for above
+		std::thread([]() {
+			for (size_t i = 0; i < 10000; i++) FI("entry {}", i);
+		}).join();
+		Fs2a::Logger::instance()->flush();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(10000), count_("INFO entry ") + Fs2a::Logger::instance()->dropped() - before);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LoggerCheck);
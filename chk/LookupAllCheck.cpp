@@ -0,0 +1,170 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <array>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks lookups of all matching prefixes of a number, against a
+ * reference map and with buffers too small to hold them all. */
+class LookupAllCheck : public RandomFixture<24494>
+{
+	CPPUNIT_TEST_SUITE(LookupAllCheck);
+	CPPUNIT_TEST(reference);
+	CPPUNIT_TEST(small);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Get the matching prefixes of a number from a reference map.
+	 * @param ref_i Reference map of prefixes to destinations.
+	 * @param number_i Number to look up.
+	 * @returns Matches, shortest first. */
+	static std::vector<DecTree::match_t> matches_(const std::map<std::string, uint64_t> & ref_i, const std::string & number_i)
+	{
+		std::vector<DecTree::match_t> rv;
+
+		for (size_t len = 1; len <= number_i.size(); len++) {
+			auto it = ref_i.find(number_i.substr(0, len));
+			if (it != ref_i.end()) rv.push_back({ len, it->second });
+		}
+		return rv;
+	}
+
+	/** Compare the matches found in a tree with the expected ones.
+	 * @param number_i Number looked up, for messages.
+	 * @param expected_i Expected matches, shortest first.
+	 * @param found_i Matches found.
+	 * @param count_i Number of matches found. */
+	static void compare_(const std::string & number_i, const std::vector<DecTree::match_t> & expected_i, const DecTree::match_t *found_i, const size_t count_i)
+	{
+		CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, expected_i.size(), count_i);
+		for (size_t i = 0; i < count_i; i++) {
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, expected_i[i].digits, found_i[i].digits);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(number_i, expected_i[i].destination, found_i[i].destination);
+		}
+	}
+
+	public:
+	/// All matches of random numbers equal those of a reference map, with several stride profiles
+	void reference()
+	{
+		const std::vector<std::vector<uint8_t>> profiles = { {}, { 2 }, { 3, 2 }, { 1, 3, 3 } };
+		std::array<DecTree::match_t, 20> found;
+		std::map<std::string, uint64_t> ref;
+		std::vector<DecTree::match_t> expected;
+		std::string nr;
+		size_t n;
+
+		for (const auto & p : profiles) {
+			DecTree tree;
+
+			ref.clear();
+			tree.strides(p);
+			for (uint64_t i = 1; i <= 3000; i++) {
+				nr = number_(7);
+				tree(nr, i);
+				ref[nr] = i;
+			}
+			for (size_t i = 0; i < 5000; i++) {
+				nr = number_(12);
+				expected = matches_(ref, nr);
+				n = tree.lookupAll(nr, found);
+				compare_(nr, expected, found.data(), n);
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, tree.lookup(nr), n ? found[n - 1].destination : UINT64_C(0));
+			}
+		}
+	}
+
+	/// A buffer that is too small keeps the most specific matches, still shortest first
+	void small()
+	{
+		const std::string chain = "3141592653";
+		std::vector<DecTree::match_t> expected, found;
+		std::map<std::string, uint64_t> ref;
+		DecTree tree;
+		size_t n;
+
+		for (size_t len = 1; len <= chain.size(); len += len % 3 ? 1 : 2) {
+			tree(chain.substr(0, len), len);
+			ref[chain.substr(0, len)] = len;
+		}
+		for (const std::string & nr : { chain, chain + "58", chain.substr(0, 5), std::string("27") }) {
+			for (size_t cap = 0; cap <= chain.size() + 1; cap++) {
+				expected = matches_(ref, nr);
+				if (expected.size() > cap) expected.erase(expected.begin(), expected.end() - cap);
+				found.assign(cap + 1, { 99, 99 });
+				n = tree.lookupAll(nr, found.data(), cap);
+				compare_(nr, expected, found.data(), n);
+
+				// Nothing is written beyond the capacity
+				CPPUNIT_ASSERT_EQUAL(size_t(99), found[cap].digits);
+			}
+		}
+	}
+
+	/// An empty tree or number matches nothing
+	void empty()
+	{
+		std::array<DecTree::match_t, 4> found;
+		DecTree tree;
+
+		CPPUNIT_ASSERT_EQUAL(size_t(0), tree.lookupAll("3141", found));
+		tree("3", 3);
+		CPPUNIT_ASSERT_EQUAL(size_t(0), tree.lookupAll("", found));
+		CPPUNIT_ASSERT_EQUAL(size_t(0), tree.lookupAll("4", found));
+		CPPUNIT_ASSERT_EQUAL(size_t(1), tree.lookupAll("3", found));
+	}
+
+	/// Numbers with a non-digit are refused, also after the last match
+	void invalid()
+	{
+		std::array<DecTree::match_t, 4> found;
+		DecTree tree;
+
+		tree("31", 31);
+		CPPUNIT_ASSERT_THROW(tree.lookupAll("a1", found), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(tree.lookupAll("31x", found), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(tree.lookupAll("3141 ", found), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(tree.lookupAll("31:", found.data(), 0), std::invalid_argument);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LookupAllCheck);
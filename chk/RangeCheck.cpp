@@ -0,0 +1,185 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks that setRange() and cover() give the same result as setting
+ * every number of a range one by one. */
+class RangeCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(RangeCheck);
+	CPPUNIT_TEST(fullWidth);
+	CPPUNIT_TEST(aligned);
+	CPPUNIT_TEST(single);
+	CPPUNIT_TEST(random);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Stride profiles to check every range with
+	std::vector<std::vector<uint8_t>> profiles_;
+
+	/** Format a number with leading zeroes.
+	 * @param number_i Number.
+	 * @param digits_i Number of digits.
+	 * @returns Number as string. */
+	static std::string number_(const uint64_t number_i, const size_t digits_i)
+	{
+		std::string rv = std::to_string(number_i);
+
+		return std::string(digits_i - rv.size(), '0') + rv;
+	}
+
+	/** Set a range in trees of every profile, and every number of the range
+	 * in reference trees, then compare all numbers of the same length.
+	 * @param from_i First number of the range.
+	 * @param to_i Last number of the range. */
+	void check_(const std::string & from_i, const std::string & to_i)
+	{
+		const size_t digits = from_i.size();
+		const uint64_t lo = std::stoull(from_i), hi = std::stoull(to_i);
+		uint64_t end = 1;
+		std::string msg;
+
+		for (size_t i = 0; i < digits; i++) end *= 10;
+		for (const auto & p : profiles_) {
+			DecTree range, single;
+
+			range.strides(p);
+			single.strides(p);
+			// A longer number, which keeps its own destination
+			range("999999", 2);
+			single("999999", 2);
+
+			CPPUNIT_ASSERT_EQUAL(DecTree::cover(from_i, to_i).size(), range.setRange(from_i, to_i, 1));
+			for (uint64_t n = lo; n <= hi; n++) single(number_(n, digits), 1);
+
+			for (uint64_t n = 0; n < end; n++) {
+				msg = from_i + "-" + to_i + " at " + number_(n, digits);
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(msg, single.lookup(number_(n, digits)), range.lookup(number_(n, digits)));
+			}
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(2), range.lookup("999999"));
+		}
+	}
+
+	public:
+	void setUp()
+	{
+		profiles_ = { {}, { 2 }, { 3, 2 }, { 1, 3 } };
+	}
+
+	void tearDown()
+	{
+		profiles_.clear();
+	}
+
+	/// Ranges spanning all numbers of their length, which have no common prefix
+	void fullWidth()
+	{
+		std::vector<std::string> c;
+
+		for (size_t digits = 1; digits <= 4; digits++) {
+			c = DecTree::cover(std::string(digits, '0'), std::string(digits, '9'));
+			CPPUNIT_ASSERT_EQUAL(size_t(10), c.size());
+			for (char d = '0'; d <= '9'; d++) CPPUNIT_ASSERT_EQUAL(std::string(1, d), c[d - '0']);
+			check_(std::string(digits, '0'), std::string(digits, '9'));
+		}
+		CPPUNIT_ASSERT_EQUAL(size_t(10), DecTree::cover(std::string(15, '0'), std::string(15, '9')).size());
+	}
+
+	/// Ranges starting and ending on a digit boundary
+	void aligned()
+	{
+		CPPUNIT_ASSERT(DecTree::cover("3140000", "3149999") == std::vector<std::string>({ "314" }));
+		CPPUNIT_ASSERT(DecTree::cover("3100", "3599") == std::vector<std::string>({ "31", "32", "33", "34", "35" }));
+		CPPUNIT_ASSERT(DecTree::cover("3141900000", "3141949999") ==
+			std::vector<std::string>({ "314190", "314191", "314192", "314193", "314194" }));
+
+		check_("3000", "3999");
+		check_("3100", "3599");
+		check_("0000", "4999");
+		check_("5000", "9999");
+		check_("1200", "1299");
+	}
+
+	/// Ranges of a single number
+	void single()
+	{
+		CPPUNIT_ASSERT(DecTree::cover("31415", "31415") == std::vector<std::string>({ "31415" }));
+		CPPUNIT_ASSERT(DecTree::cover("0", "0") == std::vector<std::string>({ "0" }));
+
+		check_("0", "0");
+		check_("9", "9");
+		check_("0000", "0000");
+		check_("3141", "3141");
+		check_("9999", "9999");
+	}
+
+	/// Ranges with arbitrary bounds
+	void random()
+	{
+		std::mt19937_64 rnd(9);
+		uint64_t a, b, end;
+		size_t digits;
+
+		for (size_t i = 0; i < 40; i++) {
+			digits = 1 + rnd() % 4;
+			end = digits == 1 ? 10 : digits == 2 ? 100 : digits == 3 ? 1000 : 10000;
+			a = rnd() % end;
+			b = rnd() % end;
+			if (a > b) std::swap(a, b);
+			check_(number_(a, digits), number_(b, digits));
+		}
+	}
+
+	/// Ranges that are empty, of different lengths or not numbers at all
+	void invalid()
+	{
+		DecTree tree;
+
+		CPPUNIT_ASSERT_THROW(DecTree::cover("", ""), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(DecTree::cover("12", "123"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(DecTree::cover("19", "10"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(DecTree::cover("1a", "19"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(tree.setRange("19", "10", 1), std::invalid_argument);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("15"));
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RangeCheck);
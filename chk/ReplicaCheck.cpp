@@ -0,0 +1,255 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "Arena.h"
+#include "CheckHelpers.h"
+#include "DecTree.h"
+#include "DecTreeBuilder.h"
+
+using namespace SdH;
+
+/** Checks that a tree reading from replicas agrees with one that does not.
+ * Replicas use plain memory on hosts with a single NUMA node or without
+ * libnuma, so this runs everywhere. */
+class ReplicaCheck : public RandomFixture<31415>
+{
+	CPPUNIT_TEST_SUITE(ReplicaCheck);
+	CPPUNIT_TEST(updates);
+	CPPUNIT_TEST(transactions);
+	CPPUNIT_TEST(consolidate);
+	CPPUNIT_TEST(clear);
+	CPPUNIT_TEST(change);
+	CPPUNIT_TEST(builder);
+	CPPUNIT_TEST(pinned);
+	CPPUNIT_TEST(readers);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Make the same random modification to two trees.
+	 * @param a_io First tree.
+	 * @param b_io Second tree. */
+	void modify_(DecTree & a_io, DecTree & b_io)
+	{
+		std::string nr = number_(6), last;
+		uint64_t dest = 1 + rng_() % 1000;
+
+		switch (rng_() % 4) {
+			case 0:
+				CPPUNIT_ASSERT_EQUAL(b_io.erase(nr), a_io.erase(nr));
+				break;
+			case 1:
+				last = nr + std::string(3, '9');
+				nr += "000";
+				a_io.setRange(nr, last, dest);
+				b_io.setRange(nr, last, dest);
+				break;
+			default:
+				a_io(nr, dest);
+				b_io(nr, dest);
+		}
+	}
+
+	/** Compare a replicated tree with a reference tree, by their contents
+	 * and by lookups of random numbers.
+	 * @param tree_i Replicated tree.
+	 * @param ref_i Reference tree. */
+	void compare_(const DecTree & tree_i, const DecTree & ref_i)
+	{
+		std::vector<std::pair<std::string, uint64_t>> got, want;
+		std::string nr;
+
+		tree_i.forEach([&got](const std::string_view p, const uint64_t d) { got.emplace_back(p, d); });
+		ref_i.forEach([&want](const std::string_view p, const uint64_t d) { want.emplace_back(p, d); });
+		CPPUNIT_ASSERT(got == want);
+		for (size_t i = 0; i < 1000; i++) {
+			nr = number_(10);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, ref_i.lookup(nr), tree_i.lookup(nr));
+		}
+	}
+
+	public:
+	/// Modifications outside transactions reach the replicas
+	void updates()
+	{
+		DecTree tree, ref;
+
+		tree.replicas(Arena::nodes() + 1);
+		for (size_t round = 0; round < 20; round++) {
+			for (size_t i = 0; i < 100; i++) modify_(tree, ref);
+			compare_(tree, ref);
+		}
+	}
+
+	/// Committed transactions reach the replicas, rolled back ones do not
+	void transactions()
+	{
+		DecTree tree, ref;
+
+		tree.replicas(2);
+		for (size_t i = 0; i < 200; i++) modify_(tree, ref);
+		for (size_t round = 0; round < 10; round++) {
+			tree.begin();
+			ref.begin();
+			for (size_t i = 0; i < 50; i++) modify_(tree, ref);
+			if (round % 3 == 0) {
+				tree.rollback();
+				ref.rollback();
+			} else {
+				tree.commit();
+				ref.commit();
+			}
+			compare_(tree, ref);
+		}
+	}
+
+	/// The replicas follow the new arena of a consolidation, and modifications after it
+	void consolidate()
+	{
+		DecTree tree, ref;
+
+		tree.replicas(2);
+		for (size_t i = 0; i < 500; i++) modify_(tree, ref);
+		tree.consolidate();
+		compare_(tree, ref);
+		for (size_t i = 0; i < 200; i++) modify_(tree, ref);
+		compare_(tree, ref);
+		ref.consolidate();
+		tree.consolidate();
+		compare_(tree, ref);
+	}
+
+	/// A cleared tree replicates again once modified
+	void clear()
+	{
+		DecTree tree, ref;
+
+		tree.replicas(2);
+		for (size_t i = 0; i < 200; i++) modify_(tree, ref);
+		tree.clear();
+		ref.clear();
+		compare_(tree, ref);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("1"));
+		for (size_t i = 0; i < 200; i++) modify_(tree, ref);
+		compare_(tree, ref);
+	}
+
+	/// Changing the number of replicas, or stopping and restarting, keeps the contents
+	void change()
+	{
+		DecTree tree, ref;
+
+		for (uint32_t replicas : { 1, 3, 0, 2, 2 }) {
+			tree.replicas(replicas);
+			CPPUNIT_ASSERT_EQUAL(replicas, tree.replicas());
+			for (size_t i = 0; i < 100; i++) modify_(tree, ref);
+			compare_(tree, ref);
+		}
+	}
+
+	/// A bulk load replaces the replicas, and modifications after it reach them
+	void builder()
+	{
+		DecTree tree, ref;
+		DecTreeBuilder build(2);
+
+		tree.replicas(2);
+		tree("1", 1);
+		for (uint64_t i = 0; i < 1000; i++) {
+			build.add(std::to_string(100000 + i * 7), i + 1);
+			ref(std::to_string(100000 + i * 7), i + 1);
+		}
+		build.build(tree);
+		compare_(tree, ref);
+		for (size_t i = 0; i < 200; i++) modify_(tree, ref);
+		compare_(tree, ref);
+	}
+
+	/// A pinned version reads replicas that later modifications do not change
+	void pinned()
+	{
+		DecTree tree;
+
+		tree.replicas(2);
+		tree("31", 1);
+		tree("3141", 2);
+		{
+			DecTree::Version v = tree.version();
+
+			tree("31", 10);
+			tree.erase("3141");
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(1), v.lookup("319"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(2), v.lookup("31415"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(10), tree.lookup("31415"));
+		}
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(10), tree.lookup("31415"));
+	}
+
+	/// Lookups during modifications never see a destination that was not set
+	void readers()
+	{
+		std::atomic<bool> stop(false);
+		std::atomic<size_t> wrong(0);
+		std::vector<std::thread> readers;
+		DecTree tree;
+
+		tree.replicas(2);
+		for (uint64_t i = 0; i < 100; i++) tree(std::to_string(1000 + i), 1);
+		for (size_t r = 0; r < 3; r++) {
+			readers.emplace_back([&tree, &stop, &wrong]() {
+				uint64_t dest;
+
+				while (!stop) {
+					for (uint64_t i = 0; i < 100; i++) {
+						dest = tree.lookup(std::to_string(1000 + i) + "5");
+						if (dest == 0 || dest > 200) wrong++;
+					}
+				}
+			});
+		}
+		for (uint64_t n = 2; n <= 200; n++) {
+			if (n % 2) tree.setRange("10000", "10999", n);
+			else tree(std::to_string(1000 + n % 100), n);
+		}
+		stop = true;
+		for (auto & t : readers) t.join();
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), wrong.load());
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ReplicaCheck);
@@ -0,0 +1,197 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+#include "ShardedDecTree.h"
+
+using namespace SdH;
+
+/// Address space to reserve per shard, as there are up to 1000 of them
+#define SHARDRESERVE   (4 * ARENACHUNK)
+
+/** Checks that a ShardedDecTree of every depth dispatches numbers to the
+ * right shard and front-end table, by comparing it with a DecTree. */
+class ShardedDecTreeCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ShardedDecTreeCheck);
+	CPPUNIT_TEST(prefixes);
+	CPPUNIT_TEST(random);
+	CPPUNIT_TEST(ranges);
+	CPPUNIT_TEST(parallel);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Compare a sharded tree with a tree for all numbers of up to a
+	 * number of digits.
+	 * @param sharded_i Sharded tree.
+	 * @param tree_i Tree.
+	 * @param digits_i Maximum number of digits. */
+	static void compare_(const ShardedDecTree & sharded_i, const DecTree & tree_i, const uint8_t digits_i)
+	{
+		std::string nr;
+		uint64_t count = 1;
+
+		for (uint8_t d = 1; d <= digits_i; d++) {
+			count *= 10;
+			for (uint64_t n = 0; n < count; n++) {
+				nr = std::to_string(n + count).substr(1);
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, tree_i.lookup(nr), sharded_i.lookup(nr));
+			}
+		}
+	}
+
+	public:
+	/// Prefixes shorter than, as long as and longer than the depth fall back on each other
+	void prefixes()
+	{
+		for (uint8_t depth = 1; depth <= SHARDDEPTH; depth++) {
+			ShardedDecTree sharded(depth, SHARDRESERVE);
+			DecTree tree;
+
+			CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(std::pow(10, depth)), sharded.shards());
+			for (const auto & p : { "3", "31", "314", "3141", "31415", "4", "42", "420" }) {
+				sharded(p, std::stoull(p));
+				tree(p, std::stoull(p));
+			}
+			compare_(sharded, tree, 5);
+
+			for (const auto & p : { "31", "3141", "42", "7" }) CPPUNIT_ASSERT_EQUAL(tree.erase(p), sharded.erase(p));
+			compare_(sharded, tree, 5);
+
+			sharded.clear();
+			tree.clear();
+			compare_(sharded, tree, 4);
+		}
+	}
+
+	/// Random sets and erases of every length
+	void random()
+	{
+		std::string nr;
+
+		for (uint8_t depth = 1; depth <= SHARDDEPTH; depth++) {
+			std::mt19937_64 rnd(13 + depth);
+			ShardedDecTree sharded(depth, SHARDRESERVE);
+			DecTree tree;
+
+			for (size_t i = 0; i < 20000; i++) {
+				nr = std::to_string(rnd() % 100000);
+				nr = nr.substr(0, 1 + rnd() % nr.size());
+				if (rnd() % 4) {
+					sharded(nr, i + 1);
+					tree(nr, i + 1);
+				} else CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, tree.erase(nr), sharded.erase(nr));
+			}
+			compare_(sharded, tree, 5);
+			for (size_t i = 0; i < 1000; i++) {
+				nr = std::to_string(rnd());
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, tree.lookup(nr), sharded.lookup(nr));
+			}
+		}
+	}
+
+	/// Ranges spanning several shards and the front-end tables
+	void ranges()
+	{
+		const std::vector<std::pair<std::string, std::string>> ranges = {
+			{ "00000", "99999" }, { "31400", "31499" }, { "12345", "67890" }, { "09990", "10009" }, { "55555", "55555" }
+		};
+
+		for (uint8_t depth = 1; depth <= SHARDDEPTH; depth++) {
+			ShardedDecTree sharded(depth, SHARDRESERVE);
+			DecTree tree;
+			uint64_t dest = 1;
+
+			for (const auto & r : ranges) {
+				CPPUNIT_ASSERT_EQUAL(tree.setRange(r.first, r.second, dest), sharded.setRange(r.first, r.second, dest));
+				dest++;
+			}
+			compare_(sharded, tree, 5);
+		}
+	}
+
+	/// Writers of different shards run at the same time
+	void parallel()
+	{
+		ShardedDecTree sharded(2, SHARDRESERVE);
+		std::vector<std::thread> writers;
+		DecTree tree;
+
+		for (uint8_t w = 0; w < 4; w++) {
+			writers.emplace_back([&sharded, w]() {
+				std::mt19937_64 rnd(w);
+				std::string nr;
+
+				for (size_t i = 0; i < 10000; i++) {
+					nr = std::to_string(w) + std::to_string(rnd() % 10000000);
+					sharded(nr.substr(0, 2 + i % 6), i + 1);
+				}
+			});
+		}
+		for (auto & t : writers) t.join();
+
+		for (uint8_t w = 0; w < 4; w++) {
+			std::mt19937_64 rnd(w);
+			std::string nr;
+
+			for (size_t i = 0; i < 10000; i++) {
+				nr = std::to_string(w) + std::to_string(rnd() % 10000000);
+				tree(nr.substr(0, 2 + i % 6), i + 1);
+			}
+		}
+		compare_(sharded, tree, 5);
+	}
+
+	/// Invalid depths and numbers are refused
+	void invalid()
+	{
+		ShardedDecTree sharded(2, SHARDRESERVE);
+
+		CPPUNIT_ASSERT_THROW(ShardedDecTree(0, SHARDRESERVE), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(ShardedDecTree(SHARDDEPTH + 1, SHARDRESERVE), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(sharded("", 1), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(sharded("12a4", 1), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(sharded.erase("1b"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(sharded.lookup("x"), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(sharded.setRange("19", "10", 1), std::invalid_argument);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ShardedDecTreeCheck);
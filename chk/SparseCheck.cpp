@@ -0,0 +1,193 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks sparse lists turning into full ones when they get their
+ * SPARSEMAX + 1st child, in any order of digits and during lookups. */
+class SparseCheck : public RandomFixture<26457>
+{
+	CPPUNIT_TEST_SUITE(SparseCheck);
+	CPPUNIT_TEST(transition);
+	CPPUNIT_TEST(subtrees);
+	CPPUNIT_TEST(racing);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Compare a tree with a reference map for all numbers of a length
+	 * below a prefix.
+	 * @param tree_i Tree to check.
+	 * @param ref_i Reference map of prefixes to destinations.
+	 * @param prefix_i Prefix of the numbers to compare.
+	 * @param digits_i Number of digits to append to the prefix. */
+	static void compare_(const DecTree & tree_i, const std::map<std::string, uint64_t> & ref_i, const std::string & prefix_i, const uint8_t digits_i)
+	{
+		std::string nr;
+		uint64_t n, count = 1;
+
+		for (uint8_t i = 0; i < digits_i; i++) count *= 10;
+		for (n = 0; n < count; n++) {
+			nr = prefix_i + std::to_string(n + count).substr(1);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref_i, nr), tree_i.lookup(nr));
+		}
+	}
+
+	/** Random order of the ten digits.
+	 * @returns Digits '0' through '9', shuffled. */
+	std::string digits_()
+	{
+		std::string rv = "0123456789";
+
+		std::shuffle(rv.begin(), rv.end(), rng_);
+		return rv;
+	}
+
+	public:
+	/// The list is sparse up to SPARSEMAX children and full from the next one on, whatever their order
+	void transition()
+	{
+		std::map<std::string, uint64_t> ref;
+		std::vector<DecTree::level_t> lvls;
+		std::string order, nr;
+
+		for (size_t round = 0; round < 20; round++) {
+			DecTree tree;
+
+			ref.clear();
+			order = digits_();
+			tree("5", 5);
+			ref["5"] = 5;
+			for (size_t c = 1; c <= order.size(); c++) {
+				nr = std::string("5") + order[c - 1];
+				tree(nr, 50 + c);
+				ref[nr] = 50 + c;
+				lvls = tree.levels();
+				CPPUNIT_ASSERT(lvls.size() > 1);
+				CPPUNIT_ASSERT_EQUAL(UINT64_C(1), lvls[1].lists);
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(order.substr(0, c), uint64_t(c <= SPARSEMAX ? 1 : 0), lvls[1].sparse);
+				CPPUNIT_ASSERT_EQUAL(uint64_t(c), lvls[1].children);
+				compare_(tree, ref, "5", 2);
+			}
+		}
+	}
+
+	/// Subtrees and the destination of a list survive its transition unchanged
+	void subtrees()
+	{
+		std::map<std::string, uint64_t> ref;
+		std::string order, nr;
+		DecTree tree;
+		uint64_t dest = 1;
+
+		// Siblings at both sides of the transitioning list, and a destination on it
+		tree("77", 77);
+		ref["77"] = 77;
+		for (const char *s : { "7612", "78", "789" }) {
+			tree(s, ++dest);
+			ref[s] = dest;
+		}
+		order = digits_();
+		for (size_t c = 0; c < order.size(); c++) {
+			for (size_t len = 1; len <= 3; len++) {
+				nr = std::string("77") + order[c] + number_(len);
+				tree(nr, ++dest);
+				ref[nr] = dest;
+			}
+			if (c == SPARSEMAX - 1 || c == SPARSEMAX) compare_(tree, ref, "7", 5);
+		}
+		compare_(tree, ref, "7", 5);
+	}
+
+	/// Lookups while lists become full find the destinations set before, or the new ones
+	void racing()
+	{
+		std::atomic<bool> stop(false);
+		std::atomic<size_t> ready(0), wrong(0), seed(0);
+		std::vector<std::thread> readers;
+		std::vector<DecTree::level_t> lvls;
+		DecTree tree;
+
+		/* List i is "5" followed by i in two digits, with destination
+		 * 1000 * (i + 1) + 10. Child d of it gets 1000 * (i + 1) + d, and
+		 * children 0 through 2 are set before the list is ready. */
+		tree("4", 4);
+		for (size_t r = 0; r < 3; r++) {
+			readers.emplace_back([&tree, &stop, &ready, &wrong, &seed]() {
+				std::mt19937_64 rnd(seed++);
+				std::string nr;
+				uint64_t i, d, dest;
+
+				while (!stop) {
+					if (ready == 0) continue;
+					i = ready - 1 - (rnd() % 4 == 0 ? rnd() % ready : 0);
+					d = rnd() % 10;
+					nr = "5" + std::to_string(100 + i).substr(1) + char('0' + d) + randomnumber(rnd, 4);
+					dest = tree.lookup(nr);
+					if (d < 3) {
+						if (dest != 1000 * (i + 1) + d) wrong++;
+					} else if (dest != 1000 * (i + 1) + d && dest != 1000 * (i + 1) + 10) wrong++;
+					if (tree.lookup("4999") != 4) wrong++;
+				}
+			});
+		}
+		for (uint64_t i = 0; i < 100; i++) {
+			const std::string list = "5" + std::to_string(100 + i).substr(1);
+
+			tree(list, 1000 * (i + 1) + 10);
+			for (char d = '0'; d < '3'; d++) tree(list + d, 1000 * (i + 1) + (d - '0'));
+			ready = i + 1;
+			for (char d : digits_()) {
+				if (d >= '3') tree(list + d, 1000 * (i + 1) + (d - '0'));
+			}
+		}
+		stop = true;
+		for (auto & t : readers) t.join();
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), wrong.load());
+		lvls = tree.levels();
+		CPPUNIT_ASSERT(lvls.size() > 3);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(100), lvls[3].lists);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), lvls[3].sparse);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1000), lvls[3].children);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SparseCheck);
@@ -0,0 +1,192 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks the memory accounting and the lookup and update counters that
+ * stats() reports. */
+class StatsCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(StatsCheck);
+	CPPUNIT_TEST(empty);
+	CPPUNIT_TEST(memory);
+	CPPUNIT_TEST(consolidated);
+	CPPUNIT_TEST(counters);
+	CPPUNIT_TEST(threads);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Check that the bytes of a tree add up.
+	 * @param stats_i Statistics of the tree. */
+	static void balance_(const DecTree::stats_t & stats_i)
+	{
+		uint64_t bytes = 0;
+
+		for (const auto & l : stats_i.levels) bytes += l.bytes;
+		CPPUNIT_ASSERT(stats_i.live >= bytes);
+		CPPUNIT_ASSERT_EQUAL(stats_i.allocated, stats_i.live + stats_i.free + stats_i.garbage);
+		CPPUNIT_ASSERT(stats_i.committed >= stats_i.allocated);
+		CPPUNIT_ASSERT(stats_i.fragmentation >= 0.0 && stats_i.fragmentation < 1.0);
+	}
+
+	public:
+	/// A tree that has never been modified uses nothing
+	void empty()
+	{
+		DecTree tree;
+		DecTree::stats_t s = tree.stats();
+
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.live);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.allocated);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.free);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.garbage);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.lookups);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.updates);
+	}
+
+	/// Live, reusable and garbage bytes add up to the allocated ones under churn
+	void memory()
+	{
+		std::mt19937_64 rnd(16);
+		std::vector<std::string> numbers;
+		DecTree tree;
+		uint64_t live;
+
+		for (size_t i = 0; i < 5000; i++) numbers.push_back(std::to_string(rnd() % 1000000000));
+		for (size_t i = 0; i < numbers.size(); i++) tree(numbers[i], i + 1);
+		balance_(tree.stats());
+		live = tree.stats().live;
+		CPPUNIT_ASSERT(live > 0);
+
+		for (size_t i = 0; i < numbers.size(); i += 2) tree.erase(numbers[i]);
+		balance_(tree.stats());
+		CPPUNIT_ASSERT(tree.stats().live < live);
+		CPPUNIT_ASSERT(tree.stats().free > 0);
+		CPPUNIT_ASSERT(tree.stats().fragmentation > 0.0);
+
+		// Erasing everything leaves the root list and the stride profile
+		for (size_t i = 1; i < numbers.size(); i += 2) tree.erase(numbers[i]);
+		balance_(tree.stats());
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), tree.stats().levels.size());
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.stats().levels[0].lists);
+	}
+
+	/// Consolidating leaves no unused space
+	void consolidated()
+	{
+		std::mt19937_64 rnd(17);
+		DecTree tree;
+		DecTree::stats_t s;
+
+		tree.strides({ 2 });
+		for (size_t i = 0; i < 5000; i++) tree(std::to_string(rnd() % 1000000000), i + 1);
+		for (size_t i = 0; i < 2000; i++) tree.erase(std::to_string(rnd() % 1000000000).substr(0, 5));
+		tree.consolidate();
+		s = tree.stats();
+		balance_(s);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.free);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.garbage);
+		CPPUNIT_ASSERT_EQUAL(s.allocated, s.live);
+		CPPUNIT_ASSERT_EQUAL(0.0, s.fragmentation);
+		CPPUNIT_ASSERT_EQUAL(static_cast<uint8_t>(2), s.levels[0].stride);
+	}
+
+	/// Lookups, hits, misses, cached lookups, updates and depths are counted
+	void counters()
+	{
+#if DECTREESTATS
+		DecTree tree;
+		DecTree::stats_t s;
+
+		tree("31415", 1);
+		tree.setRange("27000", "27999", 2);
+		tree.erase("31415");
+		tree.erase("31415");
+		s = tree.stats();
+		// A range counts once per prefix, an erase also when there was nothing to erase
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(4), s.updates);
+
+		tree("31415", 1);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("9"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("314159"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.lookup("27123"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("3141"));
+		s = tree.stats();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(5), s.updates);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(4), s.lookups);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), s.hits);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), s.misses);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), s.cached);
+		CPPUNIT_ASSERT_EQUAL(s.lookups, std::accumulate(s.depths.begin(), s.depths.end(), UINT64_C(0)));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), s.depths[0]);
+
+		// The second lookup of the same number is served from the cache
+		tree.cache(true);
+		tree.lookup("314159");
+		tree.lookup("314159");
+		s = tree.stats();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(6), s.lookups);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), s.cached);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(4), s.hits);
+		CPPUNIT_ASSERT_EQUAL(s.lookups - s.cached, std::accumulate(s.depths.begin(), s.depths.end(), UINT64_C(0)));
+#endif
+	}
+
+	/// Counters of different threads add up
+	void threads()
+	{
+#if DECTREESTATS
+		std::vector<std::thread> readers;
+		DecTree tree;
+
+		tree("12", 12);
+		for (size_t t = 0; t < 4; t++) {
+			readers.emplace_back([&tree, t]() {
+				for (size_t i = 0; i < 10000; i++) tree.lookup(i % 2 ? "1234" : "5678");
+			});
+		}
+		for (auto & t : readers) t.join();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(40000), tree.stats().lookups);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(20000), tree.stats().hits);
+#endif
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(StatsCheck);
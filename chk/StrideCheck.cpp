@@ -0,0 +1,198 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "CheckHelpers.h"
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks prefixes that end inside a stride, whose destinations are kept
+ * in the inner slots of a list, and changing the strides of a tree. */
+class StrideCheck : public RandomFixture<22360>
+{
+	CPPUNIT_TEST_SUITE(StrideCheck);
+	CPPUNIT_TEST(inner);
+	CPPUNIT_TEST(nested);
+	CPPUNIT_TEST(erase);
+	CPPUNIT_TEST(change);
+	CPPUNIT_TEST(invalid);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/// Stride profiles to check, with the default one of one digit per level first
+	const std::vector<std::vector<uint8_t>> profiles_ = { {}, { 2 }, { 3 }, { 3, 2 }, { 2, 3, 3 }, { 1, 3, 1, 2 } };
+
+	/** Compare a tree with a reference map for all numbers of up to 4
+	 * digits, and for random longer ones.
+	 * @param tree_i Tree to check.
+	 * @param ref_i Reference map of prefixes to destinations. */
+	void compare_(const DecTree & tree_i, const std::map<std::string, uint64_t> & ref_i)
+	{
+		std::string nr;
+		uint64_t n, count;
+
+		for (count = 10; count <= 10000; count *= 10) {
+			for (n = 0; n < count; n++) {
+				nr = std::to_string(n + count).substr(1);
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref_i, nr), tree_i.lookup(nr));
+			}
+		}
+		for (n = 0; n < 1000; n++) {
+			nr = number_(12);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(nr, reflookup(ref_i, nr), tree_i.lookup(nr));
+		}
+	}
+
+	/** Fill a tree and a reference map with random prefixes of up to 6
+	 * digits, most of them ending inside the strides of the profiles.
+	 * @param tree_io Tree to fill.
+	 * @param ref_io Reference map to fill. */
+	void fill_(DecTree & tree_io, std::map<std::string, uint64_t> & ref_io)
+	{
+		std::string nr;
+
+		for (uint64_t i = 1; i <= 2000; i++) {
+			nr = number_(i % 5 ? 3 : 6);
+			tree_io(nr, i);
+			ref_io[nr] = i;
+		}
+	}
+
+	public:
+	/// Prefixes of every length below a stride, next to longer ones
+	void inner()
+	{
+		std::map<std::string, uint64_t> ref;
+
+		for (const auto & p : profiles_) {
+			DecTree tree;
+
+			ref.clear();
+			tree.strides(p);
+			fill_(tree, ref);
+			compare_(tree, ref);
+		}
+	}
+
+	/// A chain of prefixes, each one digit longer, set shortest and longest first
+	void nested()
+	{
+		const std::string chain = "3141592";
+		std::map<std::string, uint64_t> ref;
+
+		for (const auto & p : profiles_) {
+			for (bool longest : { false, true }) {
+				DecTree tree;
+
+				ref.clear();
+				tree.strides(p);
+				for (size_t i = 0; i < chain.size(); i++) {
+					size_t len = longest ? chain.size() - i : i + 1;
+
+					tree(chain.substr(0, len), len);
+					ref[chain.substr(0, len)] = len;
+				}
+				compare_(tree, ref);
+				for (size_t len = 1; len <= chain.size(); len++) {
+					CPPUNIT_ASSERT_EQUAL(uint64_t(len), tree.lookup(chain.substr(0, len) + "0"));
+				}
+			}
+		}
+	}
+
+	/// Erasing a prefix inside a stride falls back to a shorter one, and leaves longer ones alone
+	void erase()
+	{
+		std::map<std::string, uint64_t> ref;
+		std::vector<std::string> set;
+
+		for (const auto & p : profiles_) {
+			DecTree tree;
+
+			ref.clear();
+			tree.strides(p);
+			fill_(tree, ref);
+			set.clear();
+			for (const auto & e : ref) set.push_back(e.first);
+			for (size_t i = 0; i < set.size(); i += 3) {
+				CPPUNIT_ASSERT(tree.erase(set[i]));
+				ref.erase(set[i]);
+			}
+			compare_(tree, ref);
+			CPPUNIT_ASSERT(!tree.erase(set[0]));
+		}
+	}
+
+	/// The strides of a tree only change while it is empty, its contents then look up the same
+	void change()
+	{
+		std::map<std::string, uint64_t> ref;
+		DecTree tree;
+
+		for (const auto & p : profiles_) {
+			tree.strides(p);
+			CPPUNIT_ASSERT(tree.strides() == p);
+			ref.clear();
+			fill_(tree, ref);
+			compare_(tree, ref);
+
+			// Erasing everything does not make the tree empty, clearing does
+			for (const auto & e : ref) CPPUNIT_ASSERT(tree.erase(e.first));
+			CPPUNIT_ASSERT_THROW(tree.strides({ 2 }), std::logic_error);
+			CPPUNIT_ASSERT(tree.strides() == p);
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("3141"));
+			tree.clear();
+		}
+	}
+
+	/// Strides out of range, or for too many levels, are refused
+	void invalid()
+	{
+		DecTree tree;
+
+		CPPUNIT_ASSERT_THROW(tree.strides({ 0 }), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(tree.strides({ 2, MAXSTRIDE + 1 }), std::invalid_argument);
+		CPPUNIT_ASSERT_THROW(tree.strides(std::vector<uint8_t>(STRIDELEVELS + 1, 1)), std::invalid_argument);
+		CPPUNIT_ASSERT(tree.strides().empty());
+		tree.strides(std::vector<uint8_t>(STRIDELEVELS, MAXSTRIDE));
+		tree("12345", 5);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(5), tree.lookup("1234567"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("1234"));
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(StrideCheck);
@@ -0,0 +1,268 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+#include "DecTree.h"
+
+using namespace SdH;
+
+/** Checks transactions and pinned versions: what lookups see while they
+ * are open, and how writers of other threads wait for them. */
+class TransactionCheck : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(TransactionCheck);
+	CPPUNIT_TEST(isolation);
+	CPPUNIT_TEST(rollback);
+	CPPUNIT_TEST(pinned);
+	CPPUNIT_TEST(pinnedCommit);
+	CPPUNIT_TEST(unpinned);
+	CPPUNIT_TEST(waitCommit);
+	CPPUNIT_TEST(waitRollback);
+	CPPUNIT_TEST(owner);
+	CPPUNIT_TEST(readers);
+	CPPUNIT_TEST_SUITE_END();
+
+	private:
+	/** Let a writer of another thread set 42 to 2 while this thread has a
+	 * transaction open that sets 41 to 1, and end it.
+	 * @param commit_i True to commit the transaction, false to roll it back. */
+	static void contend_(const bool commit_i)
+	{
+		std::atomic<bool> done(false);
+		DecTree tree;
+
+		tree("40", 40);
+		tree.begin();
+		tree("41", 1);
+		std::thread writer([&tree, &done]() {
+			tree("42", 2);
+			done = true;
+		});
+
+		// The writer must not get into the transaction, nor finish before it ends
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CPPUNIT_ASSERT(!done);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("42"));
+		tree("43", 3);
+		if (commit_i) tree.commit();
+		else tree.rollback();
+		writer.join();
+
+		CPPUNIT_ASSERT(done);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.lookup("42"));
+		CPPUNIT_ASSERT_EQUAL(commit_i ? UINT64_C(1) : UINT64_C(0), tree.lookup("41"));
+		CPPUNIT_ASSERT_EQUAL(commit_i ? UINT64_C(3) : UINT64_C(0), tree.lookup("43"));
+	}
+
+	public:
+	/// Lookups see nothing of a transaction until it commits, then all of it
+	void isolation()
+	{
+		DecTree tree;
+
+		tree("31", 1);
+		tree("3141", 2);
+		tree.begin();
+		tree("31", 10);
+		tree.erase("3141");
+		tree.setRange("32000", "32999", 11);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.lookup("31415"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("319"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("32123"));
+		tree.commit();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(10), tree.lookup("31415"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(10), tree.lookup("319"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(11), tree.lookup("32123"));
+	}
+
+	/// A rolled back transaction leaves no trace, and its nodes are reused
+	void rollback()
+	{
+		DecTree tree;
+		uint64_t allocated;
+
+		tree("31", 1);
+		tree.begin();
+		tree("3141", 2);
+		tree.rollback();
+		allocated = tree.stats().allocated;
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("31415"));
+
+		tree.begin();
+		tree("3141", 2);
+		tree.rollback();
+		CPPUNIT_ASSERT_EQUAL(allocated, tree.stats().allocated);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("31415"));
+	}
+
+	/// Modifications outside a transaction do not change a pinned version
+	void pinned()
+	{
+		DecTree tree;
+		size_t count;
+
+		tree("31", 1);
+		tree("3141", 2);
+		tree("27", 3);
+		{
+			DecTree::Version v = tree.version();
+
+			tree("31", 10);
+			tree("314159", 11);
+			tree.erase("27");
+			tree.setRange("50000", "59999", 12);
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(1), v.lookup("319"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(2), v.lookup("3141592"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(3), v.lookup("271"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), v.lookup("51234"));
+			count = v.forEach([](const std::string_view, const uint64_t) { });
+			CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), count);
+
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(10), tree.lookup("319"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(11), tree.lookup("3141592"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("271"));
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(12), tree.lookup("51234"));
+		}
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(11), tree.lookup("3141592"));
+	}
+
+	/// A transaction committed while a version is pinned does not change it
+	void pinnedCommit()
+	{
+		DecTree tree;
+
+		tree("31", 1);
+		DecTree::Version v = tree.version();
+		tree.begin();
+		tree("31", 2);
+		tree("32", 3);
+		tree.commit();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), v.lookup("31"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), v.lookup("32"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(2), tree.lookup("31"));
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(3), tree.lookup("32"));
+	}
+
+	/// Without pinned versions modifications are made in place again
+	void unpinned()
+	{
+		DecTree tree;
+		uint64_t allocated;
+
+		tree("31", 1);
+		{
+			DecTree::Version v = tree.version();
+
+			tree("31", 2);
+			CPPUNIT_ASSERT_EQUAL(UINT64_C(1), v.lookup("31"));
+		}
+		allocated = tree.stats().allocated;
+		for (uint64_t i = 0; i < 100; i++) tree("31", i + 3);
+		CPPUNIT_ASSERT_EQUAL(allocated, tree.stats().allocated);
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(102), tree.lookup("31"));
+	}
+
+	/// A writer of another thread waits for a transaction that commits
+	void waitCommit()
+	{
+		contend_(true);
+	}
+
+	/// A writer of another thread waits for a transaction that is rolled back, and keeps its change
+	void waitRollback()
+	{
+		contend_(false);
+	}
+
+	/// Only the thread that began a transaction can end it
+	void owner()
+	{
+		DecTree tree;
+
+		tree.begin();
+		tree("1", 1);
+		CPPUNIT_ASSERT_THROW(tree.begin(), std::logic_error);
+		std::thread([&tree]() {
+			CPPUNIT_ASSERT_THROW(tree.commit(), std::logic_error);
+			tree.rollback();
+		}).join();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(0), tree.lookup("1"));
+		tree.commit();
+		CPPUNIT_ASSERT_EQUAL(UINT64_C(1), tree.lookup("1"));
+		CPPUNIT_ASSERT_THROW(tree.commit(), std::logic_error);
+	}
+
+	/// Readers holding a version keep seeing the same destinations while a writer changes them
+	void readers()
+	{
+		std::atomic<bool> stop(false);
+		std::atomic<size_t> changed(0);
+		std::vector<std::thread> readers;
+		DecTree tree;
+
+		for (uint64_t i = 0; i < 100; i++) tree(std::to_string(1000 + i), 1);
+		for (size_t r = 0; r < 3; r++) {
+			readers.emplace_back([&tree, &stop, &changed]() {
+				while (!stop) {
+					DecTree::Version v = tree.version();
+					uint64_t first = v.lookup("1000");
+
+					for (size_t round = 0; round < 10; round++) {
+						for (uint64_t i = 0; i < 100; i++) {
+							if (v.lookup(std::to_string(1000 + i)) != first) changed++;
+						}
+					}
+				}
+			});
+		}
+
+		// Every modification sets all numbers to the same destination, one by one
+		for (uint64_t n = 2; n < 200; n++) {
+			if (n % 2) {
+				tree.begin();
+				for (uint64_t i = 0; i < 100; i++) tree(std::to_string(1000 + i), n);
+				tree.commit();
+			} else tree.setRange("1000", "1099", n);
+		}
+		stop = true;
+		for (auto & t : readers) t.join();
+		CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), changed.load());
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TransactionCheck);
@@ -32,6 +32,7 @@
 
 #include <cppunit/extensions/TestFactoryRegistry.h>
 #include <cppunit/ui/text/TestRunner.h>
+#include "Logger.h"
 
 /** Runs the check application.
  * @returns 0 on success, 1 if a check failed. */
@@ -40,6 +41,9 @@ int main(void)
 	CppUnit::TextUi::TestRunner runner;
 	bool retval = false;
 
+	// Checks provoke errors on purpose, which are logged before being thrown
+	Fs2a::Logger::instance()->stderror();
+
 	// Set up test suite
 	CppUnit::TestFactoryRegistry & registry =
 		CppUnit::TestFactoryRegistry::getRegistry();
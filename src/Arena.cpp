@@ -0,0 +1,152 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sched.h>
+#include <sys/mman.h>
+#if DECTREENUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+#include "Arena.h"
+#include "Logger.h"
+#include "commondefs.h"
+
+namespace SdH {
+
+	Arena::Arena(const uint64_t reserve_i, const hugepages_t huge_i)
+	: base_(nullptr), map_(MAP_FAILED), mapsize_(0), reserved_(0), committed_(0), huge_(huge_i), readonly_(false)
+	{
+		uintptr_t aligned;
+
+		// Round up to whole chunks and reserve one more to be able to align
+		reserved_ = (reserve_i + ARENACHUNK - 1) & ~(ARENACHUNK - 1);
+		mapsize_ = reserved_ + ARENACHUNK;
+		map_ = mmap(nullptr, mapsize_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		FCEA(map_ != MAP_FAILED, throw std::bad_alloc(), "Unable to reserve {} bytes of address space", mapsize_);
+
+		aligned = (reinterpret_cast<uintptr_t>(map_) + ARENACHUNK - 1) & ~(ARENACHUNK - 1);
+		base_ = reinterpret_cast<uint8_t *>(aligned);
+
+#ifdef MADV_HUGEPAGE
+		if (huge_ == transparent) madvise(base_, reserved_, MADV_HUGEPAGE);
+#endif
+	}
+
+	Arena::Arena(const int fd_i, const uint64_t offset_i, const uint64_t bytes_i)
+	: base_(nullptr), map_(MAP_FAILED), mapsize_(offset_i + bytes_i), reserved_(bytes_i), committed_(bytes_i),
+	  huge_(nohuge), readonly_(true)
+	{
+		map_ = mmap(nullptr, mapsize_, PROT_READ, MAP_SHARED, fd_i, 0);
+		FCET(map_ != MAP_FAILED, std::runtime_error, "Unable to map {} bytes of file: {}", mapsize_, strerror(errno));
+		base_ = static_cast<uint8_t *>(map_) + offset_i;
+	}
+
+	Arena::~Arena()
+	{
+		if (map_ != MAP_FAILED) munmap(map_, mapsize_);
+	}
+
+	void Arena::commit(const uint64_t bytes_i)
+	{
+		uint64_t target;
+		int rv = -1;
+
+		if (bytes_i <= committed_) return;
+		FCET(!readonly_, std::logic_error, "Unable to grow a read-only arena");
+		FCEA(bytes_i <= reserved_, throw std::bad_alloc(), "Arena of {} bytes exhausted, {} bytes requested",
+			reserved_, bytes_i);
+
+		target = (bytes_i + ARENACHUNK - 1) & ~(ARENACHUNK - 1);
+		if (target > reserved_) target = reserved_;
+
+#ifdef MAP_HUGETLB
+		if (huge_ == explicithuge) {
+			if (mmap(base_ + committed_, target - committed_, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED) {
+				rv = 0;
+			} else {
+				// No huge pages configured on this host, use normal ones from now on
+				huge_ = nohuge;
+			}
+		}
+#endif
+		if (rv != 0) rv = mprotect(base_ + committed_, target - committed_, PROT_READ | PROT_WRITE);
+		FCEA(rv == 0, throw std::bad_alloc(), "Unable to commit {} bytes of memory", target - committed_);
+
+		committed_ = target;
+	}
+
+	bool Arena::bind(const unsigned node_i)
+	{
+#if DECTREENUMA
+		struct bitmask *mask;
+		long rv;
+
+		if (committed_ == 0 || numa_available() < 0 || node_i > static_cast<unsigned>(numa_max_node())) return false;
+
+		// Preferred rather than bound, so a node running out of memory does not fail allocations
+		mask = numa_allocate_nodemask();
+		numa_bitmask_setbit(mask, node_i);
+		rv = mbind(base_, committed_, MPOL_PREFERRED, mask->maskp, mask->size + 1, 0);
+		numa_free_nodemask(mask);
+		return rv == 0;
+#else
+		UNUSED(node_i);
+		return false;
+#endif
+	}
+
+	unsigned Arena::nodes()
+	{
+#if DECTREENUMA
+		if (numa_available() >= 0) return numa_max_node() + 1;
+#endif
+		return 1;
+	}
+
+	unsigned Arena::lookupnode_()
+	{
+		unsigned cpu, node;
+
+		return getcpu(&cpu, &node) == 0 ? node : 0;
+	}
+
+	void Arena::destroy(void *arena_i)
+	{
+		delete static_cast<Arena *>(arena_i);
+	}
+
+} // SdH namespace
@@ -0,0 +1,176 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <cstdint>
+
+/// Default amount of virtual address space to reserve for an arena: 64 GiB
+#define ARENARESERVE (UINT64_C(64) << 30)
+
+/// Granularity with which arena memory is committed: one huge page
+#define ARENACHUNK (UINT64_C(2) << 20)
+
+/// Number of calls after which node() looks up the NUMA node of a thread again
+#define ARENANODECHECK 1024
+
+namespace SdH {
+
+	/** Memory arena that never relocates.
+	 * A large range of virtual address space is reserved once, without any
+	 * access rights. Parts of it are committed on demand, front to back, so
+	 * the base address stays the same for the lifetime of the arena and
+	 * pointers into it never dangle while it grows. */
+	class Arena
+	{
+		private:
+		/// Copy construction not allowed
+		Arena(const Arena & obj_i) = delete;
+
+		/// Assignment construction not allowed
+		Arena & operator=(const Arena & obj_i) = delete;
+
+		public:
+		/// Use of huge pages to reduce TLB misses
+		enum hugepages_t : uint8_t {
+			/// Only use normal pages
+			nohuge,
+			/// Advise the kernel to back the arena with transparent huge pages
+			transparent,
+			/// Use explicit huge pages, falling back to normal pages if there are none
+			explicithuge
+		};
+
+		protected:
+		/// Start of the reserved range, aligned to ARENACHUNK
+		uint8_t *base_;
+
+		/// Start of the mapping as returned by mmap
+		void *map_;
+
+		/// Size of the mapping as passed to mmap
+		uint64_t mapsize_;
+
+		/// Number of bytes reserved from base_ onwards
+		uint64_t reserved_;
+
+		/// Number of bytes committed from base_ onwards
+		uint64_t committed_;
+
+		/// Huge page policy
+		hugepages_t huge_;
+
+		/// True if the arena is a read-only mapping of a file
+		bool readonly_;
+
+		/** Look up the NUMA node the calling thread runs on.
+		 * @returns Node number, 0 if unknown. */
+		static unsigned lookupnode_();
+
+		public:
+		/** Constructor, reserves address space without committing memory.
+		 * @param reserve_i Number of bytes of address space to reserve, which
+		 * is the maximum size the arena can grow to.
+		 * @param huge_i Huge page policy, default transparent.
+		 * @throws std::bad_alloc if the address space cannot be reserved. */
+		Arena(const uint64_t reserve_i = ARENARESERVE, const hugepages_t huge_i = transparent);
+
+		/** Constructor, maps part of a file read-only and shared, so all
+		 * processes mapping the same file use the same physical pages.
+		 * @param fd_i File descriptor of the file to map.
+		 * @param offset_i Offset in the file at which the arena starts, must
+		 * be a multiple of the page size.
+		 * @param bytes_i Number of bytes of arena in the file.
+		 * @throws std::runtime_error if the file cannot be mapped. */
+		Arena(const int fd_i, const uint64_t offset_i, const uint64_t bytes_i);
+
+		/// Destructor, unmaps all memory
+		~Arena();
+
+		/** Get the base address of the arena, which never changes.
+		 * @returns Base address. */
+		inline uint8_t *base() const { return base_; }
+
+		/** Get the number of bytes that can currently be used.
+		 * @returns Committed bytes. */
+		inline uint64_t committed() const { return committed_; }
+
+		/** Get the maximum number of bytes the arena can grow to.
+		 * @returns Reserved bytes. */
+		inline uint64_t reserved() const { return reserved_; }
+
+		/** Check whether the arena is a read-only file mapping.
+		 * @returns True if read-only, false if writable. */
+		inline bool readonly() const { return readonly_; }
+
+		/** Make sure at least a number of bytes from the base onwards can be
+		 * used. Newly committed memory is zeroed.
+		 * @param bytes_i Minimum number of usable bytes.
+		 * @throws std::bad_alloc if the reservation is exhausted or the
+		 * memory cannot be committed.
+		 * @throws std::logic_error if the arena is read-only. */
+		void commit(const uint64_t bytes_i);
+
+		/** Prefer memory of a NUMA node for the committed part of the arena,
+		 * for pages that have not been touched yet. Call it after commit(),
+		 * as committing explicit huge pages replaces the mapping.
+		 * @param node_i Node to allocate memory on.
+		 * @returns True if bound, false if built without libnuma, the host
+		 * has no NUMA support or the node does not exist. */
+		bool bind(const unsigned node_i);
+
+		/** Get the number of NUMA nodes of the host.
+		 * @returns Number of nodes, 1 if built without libnuma or the host
+		 * has no NUMA support. */
+		static unsigned nodes();
+
+		/** Get the NUMA node the calling thread runs on. It is looked up
+		 * again every ARENANODECHECK calls, so a thread that migrates to
+		 * another node follows it without a system call for every call.
+		 * @returns Node number, 0 if unknown. */
+		static inline unsigned node()
+		{
+			static thread_local unsigned node = 0, calls = 0;
+
+			if (calls-- == 0) {
+				node = lookupnode_();
+				calls = ARENANODECHECK - 1;
+			}
+			return node;
+		}
+
+		/** Delete an arena, usable as deleter of retired memory.
+		 * @param arena_i Arena to delete. */
+		static void destroy(void *arena_i);
+	};
+
+} // SdH namespace
@@ -0,0 +1,598 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+#include "DecTree.h"
+#include "Epoch.h"
+#include "Logger.h"
+#include "commondefs.h"
+
+namespace SdH {
+
+	/** Properties of a slot width. A slot holds a destination or a
+	 * reference to a list, tagged with VALIDTAG and LEAFTAG in its lowest
+	 * bits. References hold the offset of a list divided by ALIGN, so
+	 * narrow slots can still address a big arena. */
+	template <class SlotT> struct SlotTraits;
+
+	/// 64 bit slots, for destinations and arenas beyond the limits of 32 bit ones
+	template <> struct SlotTraits<uint64_t> {
+		/// Alignment of lists in bytes
+		static constexpr uint64_t ALIGN = 8;
+
+		/// Maximum number of bytes of an arena
+		static constexpr uint64_t MAXBYTES = UINT64_MAX;
+	};
+
+	/// 32 bit slots, halving the size of lists
+	template <> struct SlotTraits<uint32_t> {
+		/// Alignment of lists in bytes
+		static constexpr uint64_t ALIGN = 16;
+
+		/// Maximum number of bytes of an arena: 16 GiB
+		static constexpr uint64_t MAXBYTES = (UINT64_C(1) << 30) * ALIGN;
+	};
+
+	/** Decimal tree with a configurable slot width and radix. A list holds
+	 * RADIX child slots followed by the destination of the prefix leading
+	 * to it, padded to the alignment of the slot width. Below the root,
+	 * lists start out sparse as in DecTree: an occupancy bitmap, the
+	 * destination of the list and only the children that exist. The
+	 * bitmap is tagged with only LEAFTAG, which a child slot never is, so
+	 * a reader tells both kinds apart by the first slot it loads anyway. A
+	 * prefix without longer ones below it is not a separate leaf, but its
+	 * destination is kept in the child slot of its parent, tagged with
+	 * VALIDTAG and LEAFTAG. With 32 bit slots a full decimal list takes 48
+	 * instead of 88 bytes and a sparse one at most 32, and destinations
+	 * can be up to 30 bits.
+	 *
+	 * This format is its own with either slot width, not that of DecTree:
+	 * slots hold offsets divided by ALIGN, leaves live in the slot of
+	 * their parent and sparse bitmaps are tagged differently. It is not a
+	 * drop-in replacement for DecTree either. Like DecTree, lookups never
+	 * take a lock, a single writer at a time publishes fully initialized
+	 * lists with atomic stores, and replaced lists are reused once no
+	 * reader can be using them anymore, but the writer, arena handling,
+	 * epochs and free lists are a separate implementation. erase() only
+	 * clears destinations and never prunes lists, so a tree under constant
+	 * churn keeps growing until it is cleared. Strides, transactions,
+	 * versions, diffs, journaling, images and statistics are left out.
+	 * @tparam SlotT Slot type, uint32_t or uint64_t.
+	 * @tparam RADIX Number of digits, 2 through 16. Digits above 9 are
+	 * written as a through f, in either case. */
+	template <class SlotT, uint8_t RADIX = 10>
+	class BasicDecTree
+	{
+		static_assert(RADIX >= 2 && RADIX <= 16, "Radix must be in the range 2 through 16");
+
+		private:
+		/// Copy construction not allowed
+		BasicDecTree(const BasicDecTree & obj_i) = delete;
+
+		/// Assignment construction not allowed
+		BasicDecTree & operator=(const BasicDecTree & obj_i) = delete;
+
+		protected:
+		/// Alignment of lists in bytes
+		static constexpr uint64_t ALIGN = SlotTraits<SlotT>::ALIGN;
+
+		/// Number of bytes of a full list, padded to the alignment
+		static constexpr uint64_t LISTBYTES = ((RADIX + 1) * sizeof(SlotT) + ALIGN - 1) / ALIGN * ALIGN;
+
+		/// Slot of a full list holding its own destination
+		static constexpr uint8_t OWNSLOT = RADIX;
+
+		/// Slot of a sparse list holding its own destination, after the bitmap
+		static constexpr uint8_t SPARSEDEST = 1;
+
+		/// Slot of a sparse list holding its first child
+		static constexpr uint8_t SPARSEFIRST = 2;
+
+		/// Arena retired by a writer, to be released when no reader can use it
+		struct retired_t {
+			/// Epoch the arena was retired in
+			uint64_t epoch;
+
+			/// Arena to release
+			Arena *arena;
+		};
+
+		/// List unlinked by a writer, to be reused when no reader can use it
+		struct freed_t {
+			/// Epoch the list was unlinked in
+			uint64_t epoch;
+
+			/// Byte offset of the list
+			uint64_t offset;
+
+			/// Size of the list in bytes
+			uint64_t bytes;
+		};
+
+		/// Base address of data, stable for the lifetime of the arena
+		std::atomic<SlotT *> base_;
+
+		/// Arena holding all lists, only used by writers
+		Arena *arena_;
+
+		/// Number of bytes of address space to reserve for an arena
+		uint64_t reserve_;
+
+		/// Huge page policy for arenas
+		Arena::hugepages_t huge_;
+
+		/// Mutex to prevent simultaneous modifications
+		mutable std::mutex mux_;
+
+		/// Next free byte in allocated memory
+		uint64_t nextfree_;
+
+		/// Arenas retired by writers
+		std::vector<retired_t> retired_;
+
+		/// Lists unlinked from the current arena, waiting for readers to move on
+		std::vector<freed_t> freed_;
+
+		/// Offsets of reusable lists in the current arena, per size in bytes
+		std::unordered_map<uint64_t, std::vector<uint64_t>> free_;
+
+		/** Check whether a slot refers to a list or holds a destination.
+		 * @param slot_i Slot value.
+		 * @returns True if valid. */
+		static constexpr bool valid_(const SlotT slot_i) { return slot_i & VALIDTAG; }
+
+		/** Check whether a valid slot holds the destination of a leaf.
+		 * @param slot_i Slot value.
+		 * @returns True if it is a leaf. */
+		static constexpr bool leaf_(const SlotT slot_i) { return slot_i & LEAFTAG; }
+
+		/** Check whether the first slot of a list is the bitmap of a sparse
+		 * list.
+		 * @param slot_i Value of the first slot.
+		 * @returns True if sparse. */
+		static constexpr bool sparse_(const SlotT slot_i) { return (slot_i & (VALIDTAG | LEAFTAG)) == LEAFTAG; }
+
+		/** Get the destination of a leaf slot, or the bitmap of a sparse
+		 * list.
+		 * @param slot_i Slot value.
+		 * @returns Destination or bitmap. */
+		static constexpr uint64_t dest_(const SlotT slot_i) { return slot_i >> 2; }
+
+		/** Get the offset of the list a slot refers to.
+		 * @param slot_i Slot value.
+		 * @returns Byte offset relative to the base. */
+		static constexpr uint64_t offset_(const SlotT slot_i) { return (slot_i >> 2) * ALIGN; }
+
+		/** Make a slot referring to a list.
+		 * @param offset_i Byte offset of the list.
+		 * @returns Slot value. */
+		static constexpr SlotT list_(const uint64_t offset_i)
+		{
+			return static_cast<SlotT>((offset_i / ALIGN) << 2) | VALIDTAG;
+		}
+
+		/** Make a slot holding the destination of a leaf.
+		 * @param destination_i Destination, at most maxdest().
+		 * @returns Slot value. */
+		static constexpr SlotT leafslot_(const uint64_t destination_i)
+		{
+			return static_cast<SlotT>(destination_i << 2) | VALIDTAG | LEAFTAG;
+		}
+
+		/** Make the first slot of a sparse list.
+		 * @param bitmap_i Occupancy bitmap, one bit per digit.
+		 * @returns Slot value. */
+		static constexpr SlotT bitmap_(const uint64_t bitmap_i)
+		{
+			return static_cast<SlotT>(bitmap_i << 2) | LEAFTAG;
+		}
+
+		/** Get the size of a sparse list.
+		 * @param children_i Number of children.
+		 * @returns Number of bytes, padded to the alignment. */
+		static constexpr uint64_t sparsebytes_(const uint8_t children_i)
+		{
+			return ((SPARSEFIRST + children_i) * sizeof(SlotT) + ALIGN - 1) / ALIGN * ALIGN;
+		}
+
+		/** Get the value of a digit.
+		 * @param char_i Character holding the digit.
+		 * @returns Value, or 0xFF if @p char_i is not a digit of RADIX. */
+		static constexpr uint8_t digit_(const char char_i)
+		{
+			uint8_t d = 0xFF;
+
+			if (char_i >= '0' && char_i <= '9') d = char_i - '0';
+			else if (char_i >= 'a' && char_i <= 'f') d = char_i - 'a' + 10;
+			else if (char_i >= 'A' && char_i <= 'F') d = char_i - 'A' + 10;
+			return d < RADIX ? d : 0xFF;
+		}
+
+		/** Address of a slot of a list.
+		 * @param base_i Base address of the arena.
+		 * @param offset_i Byte offset of the list.
+		 * @param slot_i Slot number within the list.
+		 * @returns Pointer to the slot. */
+		static inline SlotT *slot_(SlotT *base_i, const uint64_t offset_i, const uint8_t slot_i)
+		{
+			return base_i + offset_i / sizeof(SlotT) + slot_i;
+		}
+
+		/** Get the child slot of a list.
+		 * @param base_i Base address of the arena.
+		 * @param list_i Byte offset of the list.
+		 * @param digit_i Digit.
+		 * @param own_o Set to the slot holding the destination of the list.
+		 * @returns Pointer to the child slot, or nullptr if a sparse list has
+		 * no child for @p digit_i. */
+		static inline SlotT *child_(SlotT *base_i, const uint64_t list_i, const uint8_t digit_i, SlotT *& own_o)
+		{
+			SlotT first = __atomic_load_n(slot_(base_i, list_i, 0), __ATOMIC_ACQUIRE);
+			uint64_t bm;
+
+			if (!sparse_(first)) {
+				own_o = slot_(base_i, list_i, OWNSLOT);
+				return slot_(base_i, list_i, digit_i);
+			}
+			own_o = slot_(base_i, list_i, SPARSEDEST);
+			bm = dest_(first);
+			if (!((bm >> digit_i) & 1)) return nullptr;
+			return slot_(base_i, list_i, SPARSEFIRST + __builtin_popcountll(bm & ((UINT64_C(1) << digit_i) - 1)));
+		}
+
+		/** Reset a block of memory, reusing a freed list of the same size if
+		 * there is one, or else possibly committing more pages of the arena.
+		 * Must be called with mux_ held.
+		 * @param bytes_i Number of bytes to clear.
+		 * @returns Byte offset of the block. */
+		uint64_t extra_(const uint64_t bytes_i)
+		{
+			auto it = free_.find(bytes_i);
+			uint64_t offset;
+
+			if (it != free_.end() && !it->second.empty()) {
+				offset = it->second.back();
+				it->second.pop_back();
+			} else {
+				FCET(nextfree_ + bytes_i <= SlotTraits<SlotT>::MAXBYTES, std::length_error,
+					"Unable to address more than {} bytes with {} bit slots", SlotTraits<SlotT>::MAXBYTES, 8 * sizeof(SlotT));
+				if (nextfree_ + bytes_i > arena_->committed()) arena_->commit(nextfree_ + bytes_i);
+				offset = nextfree_;
+				nextfree_ += bytes_i;
+			}
+			memset(arena_->base() + offset, 0, bytes_i);
+			return offset;
+		}
+
+		/** Build the lists for the rest of a number, bottom-up, so they are
+		 * complete before the returned slot is published.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number being set.
+		 * @param pos_i Position of the first digit of the first list.
+		 * @param destination_i Destination of the number.
+		 * @param inherit_i Destination of the first list itself.
+		 * @returns Slot referring to the first list. */
+		SlotT chain_(SlotT *base_i, const std::string & number_i, const size_t pos_i, const uint64_t destination_i,
+			const uint64_t inherit_i)
+		{
+			SlotT child = pos_i + 1 == number_i.size() ? leafslot_(destination_i)
+				: chain_(base_i, number_i, pos_i + 1, destination_i, 0);
+			uint64_t list = extra_(sparsebytes_(1));
+
+			*slot_(base_i, list, 0) = bitmap_(UINT64_C(1) << digit_(number_i[pos_i]));
+			*slot_(base_i, list, SPARSEDEST) = static_cast<SlotT>(inherit_i);
+			*slot_(base_i, list, SPARSEFIRST) = child;
+			return list_(list);
+		}
+
+		/** Add a child to a sparse list, by publishing a bigger copy, or a
+		 * full list once it would get more than SPARSEMAX children.
+		 * @param base_i Base address of the arena.
+		 * @param parent_i Slot referring to the list.
+		 * @param list_i Byte offset of the list.
+		 * @param digit_i Digit of the new child.
+		 * @param child_i Slot value of the new child. */
+		void addchild_(SlotT *base_i, SlotT *parent_i, const uint64_t list_i, const uint8_t digit_i, const SlotT child_i)
+		{
+			const SlotT *old = slot_(base_i, list_i, 0);
+			uint64_t bm = dest_(old[0]), list;
+			uint8_t children = __builtin_popcountll(bm), added = 0;
+
+			if (children >= SPARSEMAX) {
+				list = extra_(LISTBYTES);
+				for (uint8_t d = 0; d < RADIX; d++) {
+					if ((bm >> d) & 1) *slot_(base_i, list, d) = old[SPARSEFIRST + added++];
+				}
+				*slot_(base_i, list, digit_i) = child_i;
+				*slot_(base_i, list, OWNSLOT) = old[SPARSEDEST];
+			} else {
+				list = extra_(sparsebytes_(children + 1));
+				*slot_(base_i, list, 0) = bitmap_(bm | (UINT64_C(1) << digit_i));
+				*slot_(base_i, list, SPARSEDEST) = old[SPARSEDEST];
+				for (uint8_t d = 0; d < RADIX; d++) {
+					if (d == digit_i) *slot_(base_i, list, SPARSEFIRST + added) = child_i;
+					else if ((bm >> d) & 1) *slot_(base_i, list, SPARSEFIRST + added) = old[SPARSEFIRST + added - (d > digit_i)];
+					else continue;
+					added++;
+				}
+			}
+
+			// The old list stays intact for readers that are still using it
+			__atomic_store_n(parent_i, list_(list), __ATOMIC_RELEASE);
+			freed_.push_back({ Epoch::advance(), list_i, sparsebytes_(children) });
+		}
+
+		/** Release retired arenas and reuse unlinked lists no reader can be
+		 * using anymore. Must be called with mux_ held. */
+		void reclaim_()
+		{
+			uint64_t safe;
+			size_t kept = 0;
+
+			if (retired_.empty() && freed_.empty()) return;
+			safe = Epoch::safe();
+			for (size_t i = 0; i < retired_.size(); i++) {
+				if (retired_[i].epoch < safe) delete retired_[i].arena;
+				else retired_[kept++] = retired_[i];
+			}
+			retired_.resize(kept);
+
+			kept = 0;
+			for (size_t i = 0; i < freed_.size(); i++) {
+				if (freed_[i].epoch < safe) free_[freed_[i].bytes].push_back(freed_[i].offset);
+				else freed_[kept++] = freed_[i];
+			}
+			freed_.resize(kept);
+		}
+
+		/** Check a number to modify the tree with.
+		 * @param number_i Number to check.
+		 * @param what_i Modification, for the error message. */
+		static void validate_(const std::string & number_i, const char *what_i)
+		{
+			FCET(number_i.size(), std::invalid_argument, "Number to {} is empty", what_i);
+			for (size_t i = 0; i < number_i.size(); i++) {
+				FCET(digit_(number_i[i]) != 0xFF, std::invalid_argument,
+					"Number \"{}\" to {} contains at least one invalid digit at position {}", number_i, what_i, i);
+			}
+		}
+
+		public:
+		/** Constructor. Memory is only reserved when the first number is set.
+		 * @param reserve_i Number of bytes of address space to reserve, which
+		 * limits the size of the tree, default ARENARESERVE or the most the
+		 * slot width can address.
+		 * @param huge_i Huge page policy, default transparent. */
+		BasicDecTree(const uint64_t reserve_i = ARENARESERVE, const Arena::hugepages_t huge_i = Arena::transparent)
+		: base_(nullptr), arena_(nullptr),
+		reserve_(reserve_i < SlotTraits<SlotT>::MAXBYTES ? reserve_i : SlotTraits<SlotT>::MAXBYTES),
+		huge_(huge_i), nextfree_(0)
+		{ }
+
+		/// Destructor
+		~BasicDecTree()
+		{
+			clear();
+
+			// Nobody can be reading anymore while being destructed
+			for (auto & r : retired_) delete r.arena;
+			retired_.clear();
+		}
+
+		/** Get the largest destination that can be set.
+		 * @returns Maximum destination. */
+		static constexpr uint64_t maxdest() { return static_cast<SlotT>(~SlotT(0)) >> 2; }
+
+		/** Lookup a destination for a number in a string view. This method
+		 * never blocks, not even while a modification is being made.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i holds a character
+		 * that is not a digit of RADIX. */
+		uint64_t lookup(const std::string_view number_i) const
+		{
+			SlotT *base, *sl, *own, val;
+			uint64_t list = 0, found = 0, dest;
+			size_t i = 0;
+			uint8_t d;
+
+			Epoch::Guard eg;
+			base = base_.load(std::memory_order_acquire);
+			while (base != nullptr && i < number_i.size()) {
+				d = digit_(number_i[i++]);
+				if (d == 0xFF) break;
+				sl = child_(base, list, d, own);
+				if (sl == nullptr) break;
+				val = __atomic_load_n(sl, __ATOMIC_ACQUIRE);
+				if (!valid_(val)) break;
+				if (leaf_(val)) {
+					if (dest_(val)) found = dest_(val);
+					break;
+				}
+				list = offset_(val);
+				// The destination of the list is next to its first slot, loaded by child_() anyway
+				child_(base, list, 0, own);
+				dest = __atomic_load_n(own, __ATOMIC_ACQUIRE);
+				if (dest) found = dest;
+			}
+
+			// Validate the rest, also when the walk ended early
+			for (i = 0; i < number_i.size(); i++) {
+				FCET(digit_(number_i[i]) != 0xFF, std::invalid_argument,
+					"Number \"{}\" to lookup contains at least one invalid digit at position {}", number_i, i);
+			}
+			return found;
+		}
+
+		/** Lookup a destination for a given number.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i holds a character
+		 * that is not a digit of RADIX. */
+		inline uint64_t operator()(const std::string & number_i) const { return lookup(std::string_view(number_i)); }
+
+		/** Set a destination for a number (range).
+		 * @param number_i The number (range) to set.
+		 * @param destination_i The destination to set, 0 to erase.
+		 * @throws std::invalid_argument if @p number_i is empty or holds a
+		 * character that is not a digit of RADIX, or if @p destination_i
+		 * exceeds maxdest().
+		 * @throws std::length_error if the arena cannot be addressed by the
+		 * slot width anymore. */
+		void operator()(const std::string & number_i, const uint64_t destination_i)
+		{
+			SlotT *base, *sl, *own, *parent = nullptr, val;
+			uint64_t list = 0;
+
+			validate_(number_i, "set");
+			FCET(destination_i <= maxdest(), std::invalid_argument,
+				"Destination {} does not fit in {} bit slots, the maximum is {}", destination_i, 8 * sizeof(SlotT), maxdest());
+
+			GRD(mux_);
+			if (arena_ == nullptr) {
+				arena_ = new Arena(reserve_, huge_);
+				nextfree_ = 0;
+				// The root is always a full list
+				extra_(LISTBYTES);
+				base_.store(reinterpret_cast<SlotT *>(arena_->base()), std::memory_order_release);
+			}
+			base = base_.load(std::memory_order_relaxed);
+
+			for (size_t i = 0; i < number_i.size(); i++) {
+				sl = child_(base, list, digit_(number_i[i]), own);
+				if (sl == nullptr) {
+					if (destination_i == 0) break;
+					addchild_(base, parent, list, digit_(number_i[i]), i + 1 == number_i.size() ? leafslot_(destination_i)
+						: chain_(base, number_i, i + 1, destination_i, 0));
+					break;
+				}
+				val = *sl;
+
+				if (i + 1 == number_i.size()) {
+					if (valid_(val) && !leaf_(val)) {
+						child_(base, offset_(val), 0, own);
+						__atomic_store_n(own, static_cast<SlotT>(destination_i), __ATOMIC_RELEASE);
+					} else {
+						__atomic_store_n(sl, destination_i ? leafslot_(destination_i) : static_cast<SlotT>(0), __ATOMIC_RELEASE);
+					}
+					break;
+				}
+
+				// A leaf becomes a list with the destination of the leaf as its own
+				if (!valid_(val) || leaf_(val)) {
+					if (destination_i == 0) break;
+					__atomic_store_n(sl, chain_(base, number_i, i + 1, destination_i, valid_(val) ? dest_(val) : 0),
+						__ATOMIC_RELEASE);
+					break;
+				}
+				parent = sl;
+				list = offset_(val);
+			}
+			reclaim_();
+		}
+
+		/** Erase the destination of a number (range). Lists are kept, to be
+		 * dropped by clearing the tree and setting it again.
+		 * @param number_i The number (range) to erase.
+		 * @returns True if the number had a destination.
+		 * @throws std::invalid_argument if @p number_i is empty or holds a
+		 * character that is not a digit of RADIX. */
+		bool erase(const std::string & number_i)
+		{
+			SlotT *base, *sl, *own, val = 0;
+			uint64_t list = 0;
+
+			validate_(number_i, "erase");
+
+			GRD(mux_);
+			if (arena_ == nullptr) return false;
+			base = base_.load(std::memory_order_relaxed);
+
+			for (size_t i = 0; i < number_i.size(); i++) {
+				sl = child_(base, list, digit_(number_i[i]), own);
+				if (sl == nullptr) return false;
+				val = *sl;
+				if (!valid_(val)) return false;
+				if (i + 1 < number_i.size()) {
+					if (leaf_(val)) return false;
+					list = offset_(val);
+					continue;
+				}
+
+				if (!leaf_(val)) {
+					child_(base, offset_(val), 0, sl);
+					val = *sl;
+				} else val = dest_(val);
+				__atomic_store_n(sl, static_cast<SlotT>(0), __ATOMIC_RELEASE);
+			}
+			return val != 0;
+		}
+
+		/// Clear the tree, readers either see the old or the empty tree
+		void clear()
+		{
+			GRD(mux_);
+
+			if (arena_ != nullptr) {
+				base_.store(nullptr, std::memory_order_release);
+				retired_.push_back({ Epoch::advance(), arena_ });
+				arena_ = nullptr;
+				nextfree_ = 0;
+				freed_.clear();
+				free_.clear();
+			}
+			reclaim_();
+		}
+
+		/** Get the number of bytes allocated for lists, including those
+		 * waiting for reuse.
+		 * @returns Number of bytes. */
+		inline uint64_t bytes() const
+		{
+			GRD(mux_);
+
+			return nextfree_;
+		}
+	};
+
+} // SdH namespace
@@ -30,94 +30,1704 @@
  *
  * vim:set ts=4 sw=4 noet: */
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "DecTree.h"
+#include "Epoch.h"
 #include "Logger.h"
 #include "commondefs.h"
 
 namespace SdH {
 
-	DecTree::DecTree()
-	: base_(nullptr), nextfree_(0), pages_(0)
-	{ }
+	/// Magic bytes at the start of an image file
+	static const char imagemagic[8] = { 'S', 'd', 'H', 'D', 'e', 'c', 'T', 'r' };
+
+	/// Modulus of subtree hashes, the Mersenne prime 2^61-1
+	static const uint64_t sumprime = (UINT64_C(1) << 61) - 1;
+
+	/// Factors of the hashes of the children of a position, one per digit
+	static const uint64_t sumdigit[10] = {
+		UINT64_C(0x19e6bbebf7697fb9), UINT64_C(0x04bd3d4c70d3da1f), UINT64_C(0x03e68d6801eaf614), UINT64_C(0x1f293ea8e935b870), UINT64_C(0x1ad2f6b7f073eed1),
+		UINT64_C(0x021e1d7a950cddd9), UINT64_C(0x172dc5ababeb9592), UINT64_C(0x042645fd157cf9c6), UINT64_C(0x0c592cc5c4381836), UINT64_C(0x018ec5443c9f90c9)
+	};
+
+	/** Multiply two numbers modulo sumprime.
+	 * @param a_i First factor, below sumprime.
+	 * @param b_i Second factor, below sumprime.
+	 * @returns Product modulo sumprime. */
+	static inline uint64_t summul(const uint64_t a_i, const uint64_t b_i)
+	{
+		return static_cast<uint64_t>(static_cast<unsigned __int128>(a_i) * b_i % sumprime);
+	}
+
+	/** Hash a destination, spreading its bits over the whole range.
+	 * @param dest_i Destination.
+	 * @returns Hash below sumprime, 0 for destination 0. */
+	static inline uint64_t sumdest(uint64_t dest_i)
+	{
+		dest_i = (dest_i ^ (dest_i >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+		dest_i = (dest_i ^ (dest_i >> 27)) * UINT64_C(0x94d049bb133111eb);
+		return (dest_i ^ (dest_i >> 31)) % sumprime;
+	}
+
+	DecTree::DecTree(const uint64_t reserve_i, const Arena::hugepages_t huge_i)
+	: base_(nullptr), arena_(nullptr), reserve_(reserve_i), huge_(huge_i), nextfree_(0), profile_(0),
+	current_(nullptr), root_(ROOTNODE), txn_(false), pinned_(0), replicas_(0), mirrored_(nullptr), journal_(nullptr), generation_(0), cache_(false)
+	{
+#if DECTREESTATS
+		counters_ = new counters_t[STATSLOTS]();
+#endif
+		touch_();
+	}
 
 	DecTree::~DecTree()
 	{
+		// Destruction is not a modification to journal
+		delete journal_;
+		journal_ = nullptr;
+		{
+			// Whichever thread opened it, nobody can commit it anymore
+			GRD(mux_);
+			if (txn_) rollback_();
+		}
 		clear();
+
+		// Nobody can be reading anymore while being destructed
+		for (auto & r : retired_) r.release(r.ptr);
+		retired_.clear();
+#if DECTREESTATS
+		delete[] counters_;
+#endif
 	}
 
-	void DecTree::clear()
+	void DecTree::retire_(void *ptr_i, void (*release_i)(void *))
+	{
+		retired_.push_back({ Epoch::advance(), ptr_i, release_i });
+	}
+
+	void DecTree::freenode_(uint64_t *base_i, const uint64_t node_i, const uint8_t stride_i)
+	{
+		if (txn_) fresh_.erase(NODEOFFSET(node_i));
+		freed_.push_back({ Epoch::advance(), NODEOFFSET(node_i), bytes_(base_i, node_i, stride_i) });
+	}
+
+	void DecTree::reclaim_()
+	{
+		if (retired_.empty() && freed_.empty()) return;
+
+		uint64_t safe = Epoch::safe();
+		size_t kept = 0;
+
+		for (size_t i = 0; i < retired_.size(); i++) {
+			if (retired_[i].epoch < safe) retired_[i].release(retired_[i].ptr);
+			else retired_[kept++] = retired_[i];
+		}
+		retired_.resize(kept);
+
+		kept = 0;
+		for (size_t i = 0; i < freed_.size(); i++) {
+			if (freed_[i].epoch < safe) free_[freed_[i].bytes].push_back(freed_[i].offset);
+			else freed_[kept++] = freed_[i];
+		}
+		freed_.resize(kept);
+	}
+
+	void DecTree::publish_(uint64_t *base_i, const uint64_t root_i)
+	{
+		std::vector<Arena *> stale;
+		version_t *version = nullptr;
+
+		if (base_i != nullptr) {
+			version = new version_t{ base_i, root_i, {} };
+			try {
+				mirror_(base_i, stale);
+			} catch (...) {
+				delete version;
+				throw;
+			}
+			for (auto m : mirrors_) version->replicas.push_back(reinterpret_cast<uint64_t *>(m->base()));
+		} else {
+			stale.swap(mirrors_);
+			mirrored_ = nullptr;
+		}
+
+		version = current_.exchange(version, std::memory_order_acq_rel);
+		base_.store(base_i, std::memory_order_release);
+		root_ = root_i;
+		if (version != nullptr) retire_(version, dropversion_);
+		for (auto m : stale) retire_(m, Arena::destroy);
+	}
+
+	void DecTree::mirror_(const uint64_t *base_i, std::vector<Arena *> & stale_o)
+	{
+		std::vector<Arena *> mirrors;
+		const uint8_t *from = reinterpret_cast<const uint8_t *>(base_i);
+
+		if (base_i == mirrored_ && mirrors_.size() == replicas_) {
+			// Grow all replicas before copying anything, so a failure leaves them as they were
+			for (uint32_t r = 0; r < mirrors_.size(); r++) {
+				if (mirrors_[r]->committed() >= nextfree_) continue;
+				mirrors_[r]->commit(nextfree_);
+				mirrors_[r]->bind(r);
+			}
+
+			// Modifications only wrote into nodes of their own, none of which older versions can reach
+			for (auto m : mirrors_) {
+				for (const auto & f : fresh_) memcpy(m->base() + f.first, from + f.first, f.second);
+			}
+			return;
+		}
+
+		try {
+			for (uint32_t r = 0; r < replicas_; r++) {
+				mirrors.push_back(new Arena(arena_->reserved(), huge_));
+				mirrors.back()->commit(nextfree_);
+				// A replica beyond the nodes of the host just uses plain memory
+				mirrors.back()->bind(r);
+				memcpy(mirrors.back()->base(), from, nextfree_);
+			}
+		} catch (...) {
+			for (auto m : mirrors) delete m;
+			throw;
+		}
+		stale_o.swap(mirrors_);
+		mirrors_.swap(mirrors);
+		mirrored_ = base_i;
+	}
+
+	void DecTree::dropversion_(void *version_i)
+	{
+		delete static_cast<version_t *>(version_i);
+	}
+
+	void DecTree::replicas(const uint32_t replicas_i)
+	{
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!txn_, std::logic_error, "Unable to change replication while a transaction is open");
+
+		replicas_ = replicas_i;
+		if (arena_ != nullptr) publish_(base_.load(std::memory_order_relaxed), root_);
+		reclaim_();
+	}
+
+	uint32_t DecTree::replicas() const
 	{
 		GRD(mux_);
 
-		if (base_ != nullptr) {
-			memset(base_, 0, pages_ * PAGESIZE);
-			free(base_);
-			base_ = nullptr;
-			pages_ = 0;
+		return replicas_;
+	}
+
+	void DecTree::clear()
+	{
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!txn_, std::logic_error, "Unable to clear a tree while a transaction is open");
+
+		replace_(nullptr, 0);
+		if (journal_ != nullptr) journal_->clear();
+	}
+
+	void DecTree::replace_(Arena *arena_i, const uint64_t bytes_i)
+	{
+		if (arena_ != nullptr) {
+			publish_(nullptr, ROOTNODE);
+			retire_(arena_, Arena::destroy);
+		}
+		arena_ = arena_i;
+		nextfree_ = bytes_i;
+		freed_.clear();
+		free_.clear();
+		sums_.clear();
+		if (arena_ != nullptr) {
+			profile_ = reinterpret_cast<const uint64_t *>(arena_->base())[0];
+			publish_(reinterpret_cast<uint64_t *>(arena_->base()), ROOTNODE);
+		}
+		touch_();
+		reclaim_();
+	}
+
+	uint64_t DecTree::newcopy_(const uint64_t *from_i, const uint64_t val_i, const uint8_t stride_i)
+	{
+		const uint64_t *list = from_i + (NODEOFFSET(val_i) >> 3);
+		uint8_t children = 0;
+
+		if (stride_i > 1) return newlist_(stride_i) | VALIDTAG;
+
+		if (ISSPARSE(val_i)) children = __builtin_popcountll(list[0]);
+		else for (uint8_t d = 0; d < 10; d++) if (ISVALID(list[d])) children++;
+
+		if (children > SPARSEMAX) return newlist_(1) | VALIDTAG;
+		return newsparse_(children) | VALIDTAG | SPARSETAG;
+	}
+
+	bool DecTree::copylist_(const uint64_t *from_i, const uint64_t val_i, const uint64_t to_i, const size_t level_i,
+		std::deque<std::tuple<uint64_t, uint64_t, size_t>> *bfs_i)
+	{
+		uint64_t *from = const_cast<uint64_t *>(from_i);
+		uint64_t *to = reinterpret_cast<uint64_t *>(arena_->base());
+		uint64_t *sl, child, val;
+		uint8_t s = stride_(from_i[0], level_i), added = 0;
+		bool used = false;
+
+		for (uint16_t i = 0; i < POW10[s]; i++) {
+			sl = child_(from, val_i, i);
+			if (sl == nullptr || !ISVALID(*sl)) continue;
+			val = *sl;
+
+			if (bfs_i != nullptr && !POINTS2LEAF(val)) {
+				child = newcopy_(from_i, val, stride_(from_i[0], level_i + 1));
+				bfs_i->emplace_back(val, child, level_i + 1);
+			} else {
+				child = copydfs_(from_i, val, level_i + 1);
+				if (child == 0) continue;
+			}
+
+			if (ISSPARSE(to_i)) {
+				*slot_(to, to_i) |= UINT64_C(1) << i;
+				*slot_(to, to_i, SPARSEFIRST + added++) = child;
+			} else {
+				*slot_(to, to_i, i) = child;
+			}
+			used = true;
+		}
+
+		// Destinations of prefixes ending inside the stride and of the list itself
+		for (uint16_t i = POW10[s]; i < destslot_(s); i++) {
+			*slot_(to, to_i, i) = *slot_(from, val_i, i);
+			if (*slot_(from, val_i, i)) used = true;
+		}
+		*own_(to, to_i, s) = *own_(from, val_i, s);
+		return used;
+	}
+
+	uint64_t DecTree::copydfs_(const uint64_t *from_i, const uint64_t val_i, const size_t level_i)
+	{
+		uint64_t node, dest;
+		uint64_t *to = reinterpret_cast<uint64_t *>(arena_->base());
+		uint8_t s = stride_(from_i[0], level_i);
+
+		if (POINTS2LEAF(val_i)) {
+			dest = from_i[NODEOFFSET(val_i) >> 3];
+		} else {
+			// Allocate the list before its children, so they follow it closely
+			node = newcopy_(from_i, val_i, s);
+			if (copylist_(from_i, val_i, node, level_i, nullptr)) return node;
+
+			// Everything allocated after the list was dropped, so reuse its space
+			nextfree_ = NODEOFFSET(node);
+			dest = *own_(const_cast<uint64_t *>(from_i), val_i, s);
+		}
+
+		if (dest == 0) return 0;
+		node = newleaf_();
+		to[node >> 3] = dest;
+		return node | VALIDTAG | LEAFTAG;
+	}
+
+	std::pair<uint64_t, uint64_t> DecTree::consolidate()
+	{
+		/// Lists laid out breadth-first, still to be filled
+		std::deque<std::tuple<uint64_t, uint64_t, size_t>> queue;
+		alloc_t old;
+		const uint64_t *from;
+		uint64_t *to = nullptr;
+
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!readonly(), std::logic_error, "Unable to consolidate a tree opened from an image, clear it first");
+		FCET(!txn_, std::logic_error, "Unable to consolidate a tree while a transaction is open");
+		if (arena_ == nullptr) return std::make_pair(0, 0);
+
+		from = reinterpret_cast<const uint64_t *>(arena_->base());
+		to = newarena_(from[0], old);
+		try {
+			queue.emplace_back(root_, ROOTNODE, 0);
+			while (!queue.empty()) {
+				auto l = queue.front();
+				queue.pop_front();
+				copylist_(from, std::get<0>(l), std::get<1>(l), std::get<2>(l),
+					std::get<2>(l) + 1 < BFSLEVELS ? &queue : nullptr);
+			}
+
+			// Readers still on the old arena finish their lookups there
+			publish_(to, ROOTNODE);
+		} catch (...) {
+			// Nodes waiting for reuse in the old arena stay available
+			restore_(old);
+			throw;
+		}
+		retire_(old.arena, Arena::destroy);
+		reclaim_();
+
+		return std::make_pair(old.nextfree, nextfree_);
+	}
+
+	void DecTree::save(const std::string & path_i)
+	{
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!txn_, std::logic_error, "Unable to save a tree while a transaction is open");
+		save_(path_i);
+	}
+
+	void DecTree::save_(const std::string & path_i)
+	{
+		std::string tmp = path_i + ".tmp";
+		image_t hdr;
+		char zero[IMAGEHEADER] = { 0 };
+		const uint8_t *data, *parts[4];
+		uint64_t left, sizes[4], rootbytes;
+		ssize_t rv;
+		int fd;
+
+		memcpy(hdr.magic, imagemagic, sizeof(hdr.magic));
+		hdr.byteorder = UINT64_C(0x0102030405060708);
+		hdr.version = IMAGEVERSION;
+		hdr.offset = IMAGEHEADER;
+
+		fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		FCET(fd >= 0, std::runtime_error, "Unable to create image file {}: {}", tmp, strerror(errno));
+
+		hdr.bytes = nextfree_;
+		memcpy(zero, &hdr, sizeof(hdr));
+		parts[0] = reinterpret_cast<const uint8_t *>(zero);
+		sizes[0] = IMAGEHEADER;
+
+		// A transaction may have moved the root, images keep it at ROOTNODE, which is never reused
+		if (arena_ != nullptr) {
+			rootbytes = sizeof(uint64_t) * slots_(stride_(reinterpret_cast<const uint64_t *>(arena_->base())[0], 0));
+			parts[1] = arena_->base();
+			sizes[1] = ROOTNODE;
+			parts[2] = arena_->base() + root_;
+			sizes[2] = rootbytes;
+			parts[3] = arena_->base() + ROOTNODE + rootbytes;
+			sizes[3] = nextfree_ - ROOTNODE - rootbytes;
+		}
+		for (int part = 0; part < (arena_ != nullptr ? 4 : 1); part++) {
+			data = parts[part];
+			left = sizes[part];
+			while (left > 0) {
+				rv = ::write(fd, data, left);
+				if (rv < 0 && errno == EINTR) continue;
+				if (rv <= 0) {
+					::close(fd);
+					unlink(tmp.c_str());
+					FET(std::runtime_error, "Unable to write image file {}: {}", tmp, strerror(errno));
+				}
+				data += rv;
+				left -= rv;
+			}
+		}
+
+		rv = fsync(fd);
+		::close(fd);
+		if (rv != 0 || rename(tmp.c_str(), path_i.c_str()) != 0) {
+			unlink(tmp.c_str());
+			FET(std::runtime_error, "Unable to complete image file {}: {}", path_i, strerror(errno));
+		}
+	}
+
+	DecTree::image_t DecTree::header_(const int fd_i, const std::string & path_i)
+	{
+		image_t hdr;
+		struct stat st;
+
+		if (pread(fd_i, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fstat(fd_i, &st) != 0) {
+			FET(std::runtime_error, "Unable to read header of image file {}", path_i);
+		}
+		if (memcmp(hdr.magic, imagemagic, sizeof(hdr.magic)) != 0 ||
+			hdr.byteorder != UINT64_C(0x0102030405060708) ||
+			hdr.version != IMAGEVERSION ||
+			hdr.offset != IMAGEHEADER ||
+			hdr.bytes % sizeof(uint64_t) != 0 ||
+			(hdr.bytes != 0 && hdr.bytes < ROOTNODE + sizeof(uint64_t) * slots_(1)) ||
+			static_cast<uint64_t>(st.st_size) < hdr.offset + hdr.bytes) {
+			FET(std::runtime_error, "File {} is not a decimal tree image of version {}", path_i, IMAGEVERSION);
+		}
+		return hdr;
+	}
+
+	void DecTree::open(const std::string & path_i)
+	{
+		image_t hdr;
+		Arena *arena = nullptr;
+		int fd;
+
+		fd = ::open(path_i.c_str(), O_RDONLY | O_CLOEXEC);
+		FCET(fd >= 0, std::runtime_error, "Unable to open image file {}: {}", path_i, strerror(errno));
+
+		try {
+			hdr = header_(fd, path_i);
+			if (hdr.bytes > 0) arena = new Arena(fd, hdr.offset, hdr.bytes);
+		} catch (...) {
+			::close(fd);
+			throw;
+		}
+		// The mapping stays valid after closing the file
+		::close(fd);
+
+		std::unique_lock<std::mutex> lck = writer_();
+		if (txn_) {
+			delete arena;
+			FET(std::logic_error, "Unable to replace a tree while a transaction is open");
+		}
+		replace_(arena, hdr.bytes);
+	}
+
+	void DecTree::load(const std::string & path_i)
+	{
+		image_t hdr;
+		Arena *arena = nullptr;
+		uint64_t done = 0;
+		ssize_t rv;
+		int fd;
+
+		fd = ::open(path_i.c_str(), O_RDONLY | O_CLOEXEC);
+		FCET(fd >= 0, std::runtime_error, "Unable to open image file {}: {}", path_i, strerror(errno));
+
+		try {
+			hdr = header_(fd, path_i);
+			if (hdr.bytes > 0) {
+				arena = new Arena(reserve_, huge_);
+				arena->commit(hdr.bytes);
+				while (done < hdr.bytes) {
+					rv = pread(fd, arena->base() + done, hdr.bytes - done, hdr.offset + done);
+					if (rv < 0 && errno == EINTR) continue;
+					FCET(rv > 0, std::runtime_error, "Unable to read image file {}: {}", path_i, strerror(errno));
+					done += rv;
+				}
+			}
+		} catch (...) {
+			delete arena;
+			::close(fd);
+			throw;
+		}
+		::close(fd);
+
+		std::unique_lock<std::mutex> lck = writer_();
+		if (txn_) {
+			delete arena;
+			FET(std::logic_error, "Unable to replace a tree while a transaction is open");
 		}
+		replace_(arena, hdr.bytes);
 	}
 
-	uint64_t extra_(const uint8_t bytes_i)
+	uint64_t DecTree::journal(const std::string & snapshot_i, const std::string & journal_i, const uint32_t batch_i)
+	{
+		Journal *j;
+		uint64_t replayed;
+
+		{
+			std::unique_lock<std::mutex> lck = writer_();
+			FCET(!txn_, std::logic_error, "Unable to start journaling while a transaction is open");
+			delete journal_;
+			journal_ = nullptr;
+		}
+
+		if (access(snapshot_i.c_str(), F_OK) == 0) load(snapshot_i);
+		else clear();
+
+		// Replay before attaching, so the replayed modifications are not journaled again
+		j = new Journal(journal_i, batch_i);
+		try {
+			replayed = j->replay(*this);
+		} catch (...) {
+			delete j;
+			throw;
+		}
+
+		std::unique_lock<std::mutex> lck = writer_();
+		delete journal_;
+		journal_ = j;
+		snapshot_ = snapshot_i;
+		return replayed;
+	}
+
+	void DecTree::checkpoint()
+	{
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(journal_ != nullptr, std::logic_error, "Unable to checkpoint a tree that is not journaling");
+		FCET(!txn_, std::logic_error, "Unable to checkpoint a tree while a transaction is open");
+
+		// Replaying the old journal on top of the new snapshot gives the same tree, so a crash in between is harmless
+		journal_->flush();
+		save_(snapshot_);
+		journal_->truncate();
+	}
+
+	void DecTree::sync()
+	{
+		GRD(mux_);
+		if (journal_ != nullptr) journal_->flush();
+	}
+
+	bool DecTree::readonly() const
+	{
+		return arena_ != nullptr && arena_->readonly();
+	}
+
+	uint64_t DecTree::extra_(const uint32_t bytes_i)
 	{
-		void *newbase = nullptr;
 		uint64_t offset;
-		if (nextfree_ + bytes_i > pages_ * PAGESIZE) {
-			newbase = realloc( (pages_ + 1) * PAGESIZE);
-			FCET(newbase != nullptr, std::bad_alloc, "Unable to allocate an extra memory page ({} bytes already allocated)",
-				pages_ * PAGESIZE);
-			pages_++;
-			base_ = newbase_;
-		}
-		offset = nextfree_;
-		memset(base_ + nextfree_, 0, bytes_i);
-		nextfree_ += bytes_i;
+		auto it = free_.find(bytes_i);
+
+		if (it != free_.end() && !it->second.empty()) {
+			offset = it->second.back();
+			it->second.pop_back();
+		} else {
+			if (nextfree_ + bytes_i > arena_->committed()) arena_->commit(nextfree_ + bytes_i);
+			offset = nextfree_;
+			nextfree_ += bytes_i;
+		}
+
+		memset(arena_->base() + offset, 0, bytes_i);
+		if (txn_) fresh_[offset] = bytes_i;
+		if (!sums_.empty()) sums_.erase(offset);
 		return offset;
 	}
 
-	const uint64_t DecTree::operator()(const std::string & number_i)
+	uint64_t *DecTree::newarena_(const uint64_t profile_i, alloc_t & old_o)
+	{
+		uint64_t *base;
+
+		old_o.arena = arena_;
+		old_o.nextfree = nextfree_;
+		old_o.freed.swap(freed_);
+		old_o.free.swap(free_);
+		freed_.clear();
+		free_.clear();
+		sums_.clear();
+		arena_ = nullptr;
+		nextfree_ = 0;
+
+		try {
+			arena_ = new Arena(reserve_, huge_);
+			base = reinterpret_cast<uint64_t *>(arena_->base());
+			base[extra_(sizeof(uint64_t)) >> 3] = profile_i;
+			newlist_(stride_(profile_i, 0));
+		} catch (...) {
+			restore_(old_o);
+			throw;
+		}
+		return base;
+	}
+
+	void DecTree::restore_(alloc_t & old_io)
+	{
+		if (arena_ != old_io.arena) delete arena_;
+		arena_ = old_io.arena;
+		nextfree_ = old_io.nextfree;
+		freed_.swap(old_io.freed);
+		free_.swap(old_io.free);
+	}
+
+	void DecTree::create_()
+	{
+		alloc_t old;
+		uint64_t *base = newarena_(profile_, old);
+
+		try {
+			publish_(base, ROOTNODE);
+		} catch (...) {
+			restore_(old);
+			throw;
+		}
+	}
+
+	DecTree::stats_t DecTree::stats() const
+	{
+		stats_t rv = {};
+
+		rv.levels = levels();
+		for (const auto & l : rv.levels) rv.live += l.bytes;
+
+		{
+			GRD(mux_);
+			if (arena_ != nullptr) {
+				rv.allocated = nextfree_;
+				rv.committed = arena_->committed();
+				// The stride profile is always in use, but not part of any level
+				rv.live += sizeof(uint64_t);
+			}
+			for (const auto & f : freed_) rv.free += f.bytes;
+			for (const auto & f : free_) rv.free += f.first * f.second.size();
+		}
+		// Modifications since walking the levels can make live bytes exceed the allocated ones
+		rv.garbage = rv.allocated > rv.live + rv.free ? rv.allocated - rv.live - rv.free : 0;
+		rv.fragmentation = rv.allocated > rv.live ? static_cast<double>(rv.allocated - rv.live) / rv.allocated : 0.0;
+
+#if DECTREESTATS
+		rv.depths.resize(STATSDEPTH, 0);
+		for (size_t i = 0; i < STATSLOTS; i++) {
+			const counters_t & c = counters_[i];
+
+			rv.lookups += __atomic_load_n(&c.lookups, __ATOMIC_RELAXED);
+			rv.hits += __atomic_load_n(&c.hits, __ATOMIC_RELAXED);
+			rv.updates += __atomic_load_n(&c.updates, __ATOMIC_RELAXED);
+			rv.cached += __atomic_load_n(&c.cached, __ATOMIC_RELAXED);
+			for (size_t d = 0; d < STATSDEPTH; d++) rv.depths[d] += __atomic_load_n(&c.depths[d], __ATOMIC_RELAXED);
+		}
+		rv.misses = rv.lookups > rv.hits ? rv.lookups - rv.hits : 0;
+#endif
+		return rv;
+	}
+
+	std::vector<uint64_t> DecTree::words() const
+	{
+		const uint64_t *base;
+
+		GRD(mux_);
+
+		if (arena_ == nullptr) return std::vector<uint64_t>();
+		base = base_.load(std::memory_order_relaxed);
+		std::vector<uint64_t> rv(base, base + (nextfree_ >> 3));
+
+		// Put a root moved by a transaction back where the layout expects it
+		std::copy(base + (root_ >> 3), base + (root_ >> 3) + slots_(stride_(base[0], 0)), rv.begin() + (ROOTNODE >> 3));
+		return rv;
+	}
+
+	std::vector<uint8_t> DecTree::strides() const
+	{
+		std::vector<uint8_t> rv;
+		uint64_t profile = profile_;
+
+		for (size_t l = 0; l < STRIDELEVELS && (profile >> (8 * l)); l++) rv.push_back(stride_(profile, l));
+		return rv;
+	}
+
+	void DecTree::strides(const std::vector<uint8_t> & strides_i)
+	{
+		uint64_t profile = 0;
+
+		FCET(strides_i.size() <= STRIDELEVELS, std::invalid_argument,
+			"Unable to set strides for {} levels, at most {} are supported", strides_i.size(), STRIDELEVELS);
+		for (size_t l = 0; l < strides_i.size(); l++) {
+			FCET(strides_i[l] >= 1 && strides_i[l] <= MAXSTRIDE, std::invalid_argument,
+				"Stride {} of level {} is not in the range 1 through {}", strides_i[l], l, MAXSTRIDE);
+			profile |= static_cast<uint64_t>(strides_i[l]) << (8 * l);
+		}
+
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(arena_ == nullptr, std::logic_error, "Unable to change the strides of a tree that is not empty");
+		profile_ = profile;
+	}
+
+	std::vector<DecTree::level_t> DecTree::levels() const
 	{
+		std::vector<level_t> rv;
+		std::vector<std::pair<uint64_t, size_t>> todo;
+		const version_t *version;
+		uint64_t *base, *sl, profile, val;
+		uint8_t s;
+
+		Epoch::Guard eg;
+		version = current_.load(std::memory_order_acquire);
+		if (version == nullptr) return rv;
+		base = local_(version);
+		profile = load_(base);
+
+		todo.emplace_back(version->root, 0);
+		while (!todo.empty()) {
+			auto n = todo.back();
+			todo.pop_back();
+
+			s = stride_(profile, n.second);
+			while (rv.size() <= n.second + 1) rv.push_back({ stride_(profile, rv.size()), 0, 0, 0, 0, 0 });
+			rv[n.second].lists++;
+			if (ISSPARSE(n.first)) {
+				rv[n.second].sparse++;
+				rv[n.second].bytes += sizeof(uint64_t) * (SPARSEFIRST + __builtin_popcountll(load_(slot_(base, n.first))));
+			} else {
+				rv[n.second].bytes += sizeof(uint64_t) * slots_(s);
+			}
+
+			for (uint16_t i = 0; i < POW10[s]; i++) {
+				sl = child_(base, n.first, i);
+				if (sl == nullptr) continue;
+				val = load_(sl);
+				if (!ISVALID(val)) continue;
+				rv[n.second].children++;
+				if (POINTS2LEAF(val)) {
+					rv[n.second + 1].leaves++;
+					rv[n.second + 1].bytes += sizeof(uint64_t);
+				} else {
+					todo.emplace_back(val, n.second + 1);
+				}
+			}
+		}
+
+		// Drop the level below the deepest lists if it has no leaves either
+		if (rv.back().leaves == 0) rv.pop_back();
+		return rv;
+	}
+
+	uint64_t DecTree::chain_(uint64_t *base_i, const std::string & number_i, const size_t pos_i, const size_t level_i,
+		const uint64_t destination_i, const uint64_t inherit_i)
+	{
+		uint64_t node, child;
+		uint16_t idx = 0;
+		uint8_t s = stride_(base_i[0], level_i), k;
+
+		if (pos_i == number_i.size()) {
+			node = newleaf_();
+			base_i[node >> 3] = destination_i;
+			return node | VALIDTAG | LEAFTAG;
+		}
+
+		if (s == 1) {
+			child = chain_(base_i, number_i, pos_i + 1, level_i + 1, destination_i, 0);
+			node = newsparse_(1);
+			base_i[node >> 3] = UINT64_C(1) << (number_i[pos_i] & 0xF);
+			base_i[(node >> 3) + SPARSEDEST] = inherit_i;
+			base_i[(node >> 3) + SPARSEFIRST] = child;
+			return node | VALIDTAG | SPARSETAG;
+		}
+
+		for (k = 0; k < s && pos_i + k < number_i.size(); k++) idx = idx * 10 + (number_i[pos_i + k] & 0xF);
+		child = k == s ? chain_(base_i, number_i, pos_i + s, level_i + 1, destination_i, 0) : 0;
+		node = newlist_(s);
+		base_i[(node >> 3) + destslot_(s)] = inherit_i;
+		if (k < s) base_i[(node >> 3) + inner_(s, k) + idx] = destination_i;
+		else base_i[(node >> 3) + idx] = child;
+		return node | VALIDTAG;
+	}
+
+	void DecTree::addchild_(uint64_t *base_i, const uint64_t node_i, const uint64_t parent_i, const uint16_t idx_i,
+		const uint64_t child_i)
+	{
+		const uint64_t *old = slot_(base_i, node_i);
+		uint64_t node, bm;
+		uint8_t children, added = 0;
+
+		if (!ISSPARSE(node_i)) {
+			store_(slot_(base_i, node_i, idx_i), child_i);
+			return;
+		}
+
+		bm = old[0];
+		children = __builtin_popcountll(bm);
+		if (children >= SPARSEMAX) {
+			node = newlist_(1);
+			for (uint8_t d = 0; d < 10; d++) {
+				if ((bm >> d) & 1) base_i[(node >> 3) + d] = old[SPARSEFIRST + added++];
+			}
+			base_i[(node >> 3) + idx_i] = child_i;
+			base_i[(node >> 3) + destslot_(1)] = old[SPARSEDEST];
+			node |= VALIDTAG;
+		} else {
+			node = newsparse_(children + 1);
+			base_i[node >> 3] = bm | (UINT64_C(1) << idx_i);
+			base_i[(node >> 3) + SPARSEDEST] = old[SPARSEDEST];
+			for (uint8_t d = 0; d < 10; d++) {
+				if (d == idx_i) base_i[(node >> 3) + SPARSEFIRST + added] = child_i;
+				else if ((bm >> d) & 1) base_i[(node >> 3) + SPARSEFIRST + added] = old[SPARSEFIRST + added - (d > idx_i)];
+				else continue;
+				added++;
+			}
+			node |= VALIDTAG | SPARSETAG;
+		}
+
+		// The old list stays intact for readers that are still using it
+		store_(base_i + (parent_i >> 3), node);
+		freenode_(base_i, node_i, 1);
+	}
+
+	uint64_t DecTree::operator()(const std::string & number_i) const
+	{
+		return lookup(std::string_view(number_i));
+	}
+
+	uint64_t DecTree::lookup(const std::string_view number_i) const
+	{
+		return cached_(pack_(number_i), [this, number_i]() {
+			Epoch::Guard eg;
+
+			return find_(current_.load(std::memory_order_acquire), number_i);
+		});
+	}
+
+	uint64_t DecTree::find_(const version_t *version_i, const std::string_view number_i) const
+	{
+		uint64_t found;
+		size_t bad;
+
+		found = walk_(version_i, [number_i](const size_t i) -> uint8_t {
+			return static_cast<uint8_t>(number_i[i] - '0');
+		}, number_i.size(), bad, [](size_t, uint64_t) { });
+		FCET(bad == std::string::npos,
+			std::invalid_argument,
+			"Number \"{}\" to lookup contains at least one non-digit at position {}",
+			number_i, bad
+		);
+		return found;
+	}
+
+	DecTree::spot_t DecTree::under_(uint64_t *base_i, const version_t *version_i, const std::string_view prefix_i)
+	{
+		spot_t rv = { version_i ? version_i->root : 0, 0, 0, 0 };
+		size_t pos = prefix_i.find_first_not_of("0123456789");
+
+		FCET(pos == std::string::npos, std::invalid_argument,
+			"Prefix \"{}\" to enumerate contains at least one non-digit at position {}", prefix_i, pos);
+		for (size_t i = 0; i < prefix_i.size() && rv.node != 0; i++) {
+			rv = spotchild_(base_i, rv, static_cast<uint8_t>(prefix_i[i] - '0'));
+		}
+		return rv;
+	}
+
+	uint64_t DecTree::lookupBCD(const uint64_t bcd_i) const
+	{
+		uint8_t len = 0;
+
+		while (len < 16 && ((bcd_i >> (60 - 4 * len)) & 0xF) != 0xF) len++;
+
+		// Whatever follows the end does not matter, so leave it out of the key
+		return cached_(len < 16 ? bcd_i | (UINT64_MAX >> (4 * len)) : bcd_i, [this, bcd_i, len]() {
+			uint64_t found;
+			size_t bad;
+
+			found = walk_([bcd_i](const size_t i) -> uint8_t {
+				return (bcd_i >> (60 - 4 * i)) & 0xF;
+			}, len, bad, [](size_t, uint64_t) { });
+			FCET(bad == std::string::npos,
+				std::invalid_argument,
+				"Packed BCD number {:016X} to lookup contains an invalid nibble at position {}",
+				bcd_i, bad
+			);
+			return found;
+		});
+	}
+
+	uint64_t DecTree::lookupInt(const uint64_t number_i, const uint8_t digits_i) const
+	{
+		char buf[20];
+		uint64_t rest = number_i;
+		size_t bad;
+
+		FCET(digits_i <= sizeof(buf), std::invalid_argument, "Unable to lookup a number of {} digits", digits_i);
+		for (uint8_t i = digits_i; i > 0; i--) {
+			buf[i - 1] = '0' + rest % 10;
+			rest /= 10;
+		}
+		FCET(rest == 0, std::invalid_argument, "Number {} to lookup has more than {} digits", number_i, digits_i);
+
+		return cached_(pack_(std::string_view(buf, digits_i)), [this, &buf, digits_i, &bad]() {
+			return walk_([&buf](const size_t i) -> uint8_t {
+				return static_cast<uint8_t>(buf[i] - '0');
+			}, digits_i, bad, [](size_t, uint64_t) { });
+		});
+	}
+
+	size_t DecTree::lookupAll(const std::string_view number_i, match_t *matches_o, const size_t capacity_i) const
+	{
+		size_t filled = 0, bad;
+
+		walk_([number_i](const size_t i) -> uint8_t {
+			return static_cast<uint8_t>(number_i[i] - '0');
+		}, number_i.size(), bad, [&](const size_t digits_i, const uint64_t destination_i) {
+			if (capacity_i == 0) return;
+			// Make room by dropping the least specific match
+			if (filled == capacity_i) memmove(matches_o, matches_o + 1, --filled * sizeof(match_t));
+			matches_o[filled++] = { digits_i, destination_i };
+		});
+		FCET(bad == std::string::npos,
+			std::invalid_argument,
+			"Number \"{}\" to lookup contains at least one non-digit at position {}",
+			number_i, bad
+		);
+		return filled;
+	}
+
+	void DecTree::lookup(const std::string *numbers_i, uint64_t *destinations_o, const size_t count_i) const
+	{
+		/// State of a lookup in flight
+		struct inflight_t {
+			/// Index of the number in the batch
+			size_t idx;
+
+			/// Node to process in the next round, tagged as in its parent slot
+			uint64_t node;
+
+			/// Position of the next digit to consume
+			size_t pos;
+
+			/// Level of the node
+			size_t level;
+		} fl[BATCHWIDTH];
+		uint8_t active = 0;
+		size_t next = 0, pos;
+		const version_t *version;
+		uint64_t *base, *sl, profile, val, dest;
+		uint16_t idx;
+		uint8_t s, k;
+
+		/** Prefetch the slots of a list a lookup will read in the next round.
+		 * @param f_i Lookup in flight, with a list as next node. */
+		auto prefetch = [&](const inflight_t & f_i) {
+			const std::string & nr = numbers_i[f_i.idx];
+			uint8_t ps = stride_(profile, f_i.level);
+			uint16_t pidx = 0;
+
+			if (ISSPARSE(f_i.node)) {
+				// Bitmap, destination and children span at most two cache lines
+				__builtin_prefetch(slot_(base, f_i.node));
+				__builtin_prefetch(slot_(base, f_i.node, SPARSEFIRST + SPARSEMAX - 1));
+				return;
+			}
+			__builtin_prefetch(slot_(base, f_i.node, destslot_(ps)));
+			for (uint8_t pk = 1; pk <= ps && f_i.pos + pk <= nr.size(); pk++) {
+				pidx = pidx * 10 + (nr[f_i.pos + pk - 1] & 0xF);
+				__builtin_prefetch(slot_(base, f_i.node, pk < ps ? inner_(ps, pk) + pidx : pidx));
+			}
+		};
+
+		Epoch::Guard eg;
+		version = current_.load(std::memory_order_acquire);
+		if (version == nullptr) {
+			for (size_t i = 0; i < count_i; i++) destinations_o[i] = 0;
+			return;
+		}
+		base = local_(version);
+		profile = load_(base);
+
+		while (active > 0 || next < count_i) {
+			// Fill up the pipeline, starting each lookup at the root
+			while (active < BATCHWIDTH && next < count_i) {
+				const std::string & nr = numbers_i[next];
+				pos = nr.find_first_not_of("0123456789");
+				FCET(pos == std::string::npos,
+					std::invalid_argument,
+					"Number \"{}\" to lookup contains at least one non-digit at position {}",
+					nr, pos
+				);
+				destinations_o[next] = 0;
+				if (!nr.empty()) {
+					fl[active] = { next, version->root, 0, 0 };
+					prefetch(fl[active]);
+					active++;
+				} else {
+					countlookup_(0, 0);
+				}
+				next++;
+			}
+
+			// Process one node of every lookup, all of which have been prefetched
+			for (uint8_t a = 0; a < active; ) {
+				inflight_t & f = fl[a];
+				const std::string & nr = numbers_i[f.idx];
+
+				if (POINTS2LEAF(f.node)) {
+					dest = load_(slot_(base, f.node));
+					if (dest) destinations_o[f.idx] = dest;
+					countlookup_(f.level, destinations_o[f.idx]);
+					f = fl[--active];
+					continue;
+				}
+
+				s = stride_(profile, f.level);
+				dest = load_(own_(base, f.node, s));
+				if (dest) destinations_o[f.idx] = dest;
+
+				idx = 0;
+				for (k = 1; k <= s && f.pos < nr.size(); k++) {
+					idx = idx * 10 + (nr[f.pos++] & 0xF);
+					if (k < s) {
+						dest = load_(slot_(base, f.node, inner_(s, k) + idx));
+						if (dest) destinations_o[f.idx] = dest;
+					}
+				}
+
+				sl = k > s ? child_(base, f.node, idx) : nullptr;
+				val = sl ? load_(sl) : 0;
+				if (!ISVALID(val)) {
+					countlookup_(f.level, destinations_o[f.idx]);
+					f = fl[--active];
+					continue;
+				}
+
+				f.node = val;
+				f.level++;
+				if (POINTS2LEAF(val)) __builtin_prefetch(slot_(base, val));
+				else prefetch(f);
+				a++;
+			}
+		}
 	}
 
 	void DecTree::operator()(const std::string & number_i, const uint64_t destination_i)
 	{
 		FCET(number_i.size(), std::invalid_argument, "Number to store is empty");
 		size_t pos;
-		pos = number.find_first_not_of("0123456789");
+		pos = number_i.find_first_not_of("0123456789");
 		FCET(pos == std::string::npos,
 			std::invalid_argument,
 			"Number \"{}\" to set contains at least one non-digit at position {}",
 			number_i, pos
 		);
-		uint64_t offset = 0;
-		bool leaf = false;
-		uint64_t *val = nullptr;
+		uint64_t *base;
+		bool own;
 
-		GRD(mux_);
-		if (base_ == nullptr) {
-			base_ = malloc(PAGESIZE);
-			if (base_ == nullptr)
-
-			nextfree_ = 0;
-			pages_ = 1;
-			offset = newlist_();
-		}
-
-		leaf = false;
-		for (uint16_t i = 0; i < number_i.size(); i++) {
-			if (!leaf) {
-				val = base_ + offset + (number_[i]&0xF);
-				if (!ISVALID(*val)) {
-					offset = newlist_();
-					// TODO
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!readonly(), std::logic_error, "Unable to modify a tree opened from an image, clear it first");
+		if (journal_ != nullptr) Journal::check(number_i);
+		if (arena_ == nullptr) create_();
+		base = base_.load(std::memory_order_relaxed);
+		own = isolate_();
+		try {
+			if (txn_) cow_(base, number_i);
+			else unsum_(base, number_i);
+			// Either all of the number is set or nothing is, so only a success is journaled
+			set_(base, number_i, destination_i, { root_, 0, 0, 0 });
+		} catch (...) {
+			if (own) rollback_(false);
+			throw;
+		}
+		if (own) commit_(false);
+		countupdate_();
+		touch_();
+		reclaim_();
+		if (journal_ != nullptr) journal_->set(number_i, destination_i);
+	}
+
+	void DecTree::set_(uint64_t *base_i, const std::string & number_i, const uint64_t destination_i, cursor_t cur_i)
+	{
+		uint64_t *sl, val;
+		uint16_t idx;
+		uint8_t s, k;
+
+		while (true) {
+			s = stride_(base_i[0], cur_i.level);
+			idx = 0;
+			for (k = 0; k < s && cur_i.pos < number_i.size(); k++) idx = idx * 10 + (number_i[cur_i.pos++] & 0xF);
+
+			// Prefix ending inside the stride of this list, which is never sparse
+			if (k < s) {
+				store_(slot_(base_i, cur_i.node, inner_(s, k) + idx), destination_i);
+				return;
+			}
+
+			sl = child_(base_i, cur_i.node, idx);
+			val = sl ? load_(sl) : 0;
+
+			if (!ISVALID(val)) {
+				addchild_(base_i, cur_i.node, cur_i.parent, idx,
+					chain_(base_i, number_i, cur_i.pos, cur_i.level + 1, destination_i, 0));
+				return;
+			}
+			if (POINTS2LEAF(val)) {
+				if (cur_i.pos == number_i.size()) store_(slot_(base_i, val), destination_i);
+				// Replace the leaf by a list inheriting its destination
+				else {
+					store_(sl, chain_(base_i, number_i, cur_i.pos, cur_i.level + 1, destination_i, load_(slot_(base_i, val))));
+					freenode_(base_i, val, 0);
 				}
-				// TODO
+				return;
+			}
+			if (cur_i.pos == number_i.size()) {
+				store_(own_(base_i, val, stride_(base_i[0], cur_i.level + 1)), destination_i);
+				return;
+			}
+
+			cur_i.parent = (sl - base_i) << 3;
+			cur_i.node = val;
+			cur_i.level++;
+		}
+	}
+
+	bool DecTree::erase(const std::string & number_i)
+	{
+		FCET(number_i.size(), std::invalid_argument, "Number to erase is empty");
+		size_t pos;
+		pos = number_i.find_first_not_of("0123456789");
+		FCET(pos == std::string::npos,
+			std::invalid_argument,
+			"Number \"{}\" to erase contains at least one non-digit at position {}",
+			number_i, pos
+		);
+		uint64_t *base;
+		bool found, own;
+
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!readonly(), std::logic_error, "Unable to modify a tree opened from an image, clear it first");
+		if (arena_ == nullptr) return false;
+		if (journal_ != nullptr) Journal::check(number_i);
+		countupdate_();
+		base = base_.load(std::memory_order_relaxed);
+		own = isolate_();
+
+		try {
+			if (txn_) cow_(base, number_i);
+			else unsum_(base, number_i);
+			found = erase_(base, number_i);
+		} catch (...) {
+			if (own) rollback_(false);
+			else {
+				touch_();
+				erased_(base, number_i);
 			}
-			// TODO
+			throw;
 		}
+		if (own) commit_(false);
+		touch_();
+		reclaim_();
+		if (found && journal_ != nullptr) journal_->erase(number_i);
+		return found;
+	}
+
+	bool DecTree::erase_(uint64_t *base_i, const std::string & number_i)
+	{
+		std::vector<cursor_t> path;
+		uint64_t *sl, val;
+		bool found = false;
+		uint16_t idx;
+		uint8_t s, k;
+
+		path.push_back({ root_, 0, 0, 0 });
+		while (true) {
+			cursor_t cur = path.back();
+
+			s = stride_(base_i[0], cur.level);
+			idx = 0;
+			for (k = 0; k < s && cur.pos < number_i.size(); k++) idx = idx * 10 + (number_i[cur.pos++] & 0xF);
+
+			// Prefix ending inside the stride of this list
+			if (k < s) {
+				sl = slot_(base_i, cur.node, inner_(s, k) + idx);
+				found = *sl != 0;
+				store_(sl, 0);
+				break;
+			}
+
+			sl = child_(base_i, cur.node, idx);
+			val = sl ? *sl : 0;
+			if (!ISVALID(val)) return false;
+
+			if (POINTS2LEAF(val)) {
+				if (cur.pos != number_i.size()) return false;
+				found = *slot_(base_i, val) != 0;
+				path.back().node = removechild_(base_i, path.back(), idx);
+				freenode_(base_i, val, 0);
+				break;
+			}
+
+			path.push_back({ val, static_cast<uint64_t>(sl - base_i) << 3, cur.level + 1, cur.pos });
+			if (cur.pos == number_i.size()) {
+				sl = own_(base_i, val, stride_(base_i[0], cur.level + 1));
+				found = *sl != 0;
+				store_(sl, 0);
+				break;
+			}
+		}
+
+		prune_(base_i, number_i, path);
+		return found;
+	}
+
+	void DecTree::erased_(uint64_t *base_i, const std::string & number_i)
+	{
+		spot_t spot = { root_, 0, 0, 0 };
+
+		if (journal_ == nullptr) return;
+		for (size_t i = 0; i < number_i.size() && spot.node != 0; i++) {
+			spot = spotchild_(base_i, spot, static_cast<uint8_t>(number_i[i] - '0'));
+		}
+		if (spotdest_(base_i, spot) == 0) journal_->erase(number_i);
+	}
+
+	uint64_t DecTree::removechild_(uint64_t *base_i, const cursor_t & cur_i, const uint16_t idx_i)
+	{
+		const uint64_t *old = slot_(base_i, cur_i.node);
+		uint64_t node, bm;
+		uint8_t added = 0;
+
+		if (!ISSPARSE(cur_i.node)) {
+			store_(slot_(base_i, cur_i.node, idx_i), 0);
+			return cur_i.node;
+		}
+
+		bm = old[0];
+		node = newsparse_(__builtin_popcountll(bm) - 1);
+		base_i[node >> 3] = bm & ~(UINT64_C(1) << idx_i);
+		base_i[(node >> 3) + SPARSEDEST] = old[SPARSEDEST];
+		for (uint8_t d = 0, i = 0; d < 10; d++) {
+			if (!((bm >> d) & 1)) continue;
+			if (d != idx_i) base_i[(node >> 3) + SPARSEFIRST + added++] = old[SPARSEFIRST + i];
+			i++;
+		}
+		node |= VALIDTAG | SPARSETAG;
+
+		// The old list stays intact for readers that are still using it
+		store_(base_i + (cur_i.parent >> 3), node);
+		freenode_(base_i, cur_i.node, 1);
+		return node;
+	}
+
+	void DecTree::prune_(uint64_t *base_i, const std::string & number_i, std::vector<cursor_t> & path_io)
+	{
+		uint64_t *sl, node, dest;
+		uint16_t idx;
+		uint8_t s, ps;
+
+		while (path_io.size() > 1) {
+			const cursor_t cur = path_io.back();
+
+			s = stride_(base_i[0], cur.level);
+			for (uint16_t i = 0; i < POW10[s]; i++) {
+				sl = child_(base_i, cur.node, i);
+				if (sl != nullptr && ISVALID(*sl)) return;
+			}
+			for (uint16_t i = POW10[s]; i < destslot_(s); i++) if (*slot_(base_i, cur.node, i)) return;
+			dest = *own_(base_i, cur.node, s);
+
+			if (dest) {
+				// Only the destination of the list itself is left
+				node = newleaf_();
+				base_i[node >> 3] = dest;
+				store_(base_i + (cur.parent >> 3), node | VALIDTAG | LEAFTAG);
+				freenode_(base_i, cur.node, s);
+				return;
+			}
+
+			path_io.pop_back();
+			ps = stride_(base_i[0], path_io.back().level);
+			idx = 0;
+			for (uint8_t k = 0; k < ps; k++) idx = idx * 10 + (number_i[path_io.back().pos + k] & 0xF);
+			path_io.back().node = removechild_(base_i, path_io.back(), idx);
+			freenode_(base_i, cur.node, s);
+		}
+	}
+
+	void DecTree::descend_(uint64_t *base_i, const std::string & number_i, const size_t len_i, cursor_t & cur_io)
+	{
+		uint64_t *sl, val;
+		uint16_t idx;
+		uint8_t s;
+
+		while (true) {
+			s = stride_(base_i[0], cur_io.level);
+			if (cur_io.pos + s >= len_i) return;
+
+			idx = 0;
+			for (uint8_t k = 0; k < s; k++) idx = idx * 10 + (number_i[cur_io.pos + k] & 0xF);
+			sl = child_(base_i, cur_io.node, idx);
+			val = sl ? load_(sl) : 0;
+			if (!ISVALID(val) || POINTS2LEAF(val)) return;
+
+			cur_io.parent = (sl - base_i) << 3;
+			cur_io.node = val;
+			cur_io.level++;
+			cur_io.pos += s;
+		}
+	}
+
+	uint64_t DecTree::private_(uint64_t *base_i, const uint64_t val_i, const uint8_t stride_i)
+	{
+		uint32_t bytes;
+		uint64_t node;
+
+		if (fresh_.count(NODEOFFSET(val_i))) return val_i;
+
+		bytes = bytes_(base_i, val_i, stride_i);
+		node = extra_(bytes);
+		memcpy(base_i + (node >> 3), slot_(base_i, val_i), bytes);
+		replaced_.push_back({ 0, NODEOFFSET(val_i), bytes });
+		return node | (val_i & TAGMASK);
+	}
+
+	void DecTree::cow_(uint64_t *base_i, const std::string & number_i)
+	{
+		uint64_t *sl, node, val;
+		size_t pos = 0, level = 0;
+		uint16_t idx;
+		uint8_t s, k;
+
+		root_ = node = private_(base_i, root_, stride_(base_i[0], 0));
+		while (true) {
+			s = stride_(base_i[0], level);
+			idx = 0;
+			for (k = 0; k < s && pos < number_i.size(); k++) idx = idx * 10 + (number_i[pos++] & 0xF);
+			if (k < s) return;
 
+			sl = child_(base_i, node, idx);
+			val = sl ? *sl : 0;
+			if (!ISVALID(val)) return;
+
+			// Nothing refers to the copy yet, so no atomic store is needed
+			*sl = node = private_(base_i, val, stride_(base_i[0], ++level));
+			if (POINTS2LEAF(node) || pos == number_i.size()) return;
+		}
+	}
+
+	/** Recursively compute the minimal set of prefixes covering a range.
+	 * @param prefix_io Prefix common to the subrange, restored on return.
+	 * @param lo_i Lowest suffix of the subrange.
+	 * @param hi_i Highest suffix of the subrange, of equal length.
+	 * @param cover_o Vector to append the prefixes to. */
+	static void coverrange(std::string & prefix_io, const std::string_view lo_i, const std::string_view hi_i,
+		std::vector<std::string> & cover_o)
+	{
+		size_t len = prefix_io.size();
+
+		// The whole block below the prefix is covered, the empty prefix cannot be set though
+		if (len && lo_i.find_first_not_of('0') == std::string_view::npos && hi_i.find_first_not_of('9') == std::string_view::npos) {
+			cover_o.push_back(prefix_io);
+			return;
+		}
+
+		if (lo_i[0] == hi_i[0]) {
+			prefix_io += lo_i[0];
+			coverrange(prefix_io, lo_i.substr(1), hi_i.substr(1), cover_o);
+		} else {
+			std::string nines(lo_i.size() - 1, '9'), zeroes(lo_i.size() - 1, '0');
+
+			prefix_io += lo_i[0];
+			coverrange(prefix_io, lo_i.substr(1), nines, cover_o);
+			for (char d = lo_i[0] + 1; d < hi_i[0]; d++) {
+				prefix_io[len] = d;
+				cover_o.push_back(prefix_io);
+			}
+			prefix_io[len] = hi_i[0];
+			coverrange(prefix_io, zeroes, hi_i.substr(1), cover_o);
+		}
+		prefix_io.resize(len);
+	}
+
+	std::vector<std::string> DecTree::cover(const std::string & from_i, const std::string & to_i)
+	{
+		std::vector<std::string> rv;
+		std::string prefix;
+		size_t pos;
+
+		FCET(from_i.size() && from_i.size() == to_i.size(), std::invalid_argument,
+			"Range {} through {} must consist of two numbers of equal, non-zero length", from_i, to_i);
+		pos = from_i.find_first_not_of("0123456789");
+		if (pos == std::string::npos) pos = to_i.find_first_not_of("0123456789");
+		FCET(pos == std::string::npos, std::invalid_argument,
+			"Range {} through {} contains at least one non-digit at position {}", from_i, to_i, pos);
+		FCET(from_i <= to_i, std::invalid_argument, "Range {} through {} is empty", from_i, to_i);
+
+		coverrange(prefix, from_i, to_i, rv);
+		return rv;
+	}
+
+	size_t DecTree::setRange(const std::string & from_i, const std::string & to_i, const uint64_t destination_i)
+	{
+		std::vector<std::string> prefixes = cover(from_i, to_i);
+		cursor_t common, cur;
+		uint64_t *base;
+		size_t len = 0, i = 0;
+		bool own;
+
+		while (len < from_i.size() && from_i[len] == to_i[len]) len++;
+
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!readonly(), std::logic_error, "Unable to modify a tree opened from an image, clear it first");
+		if (journal_ != nullptr) Journal::check(from_i);
+		if (arena_ == nullptr) create_();
+		base = base_.load(std::memory_order_relaxed);
+		own = isolate_();
+
+		try {
+			if (txn_) for (const auto & p : prefixes) cow_(base, p);
+			else for (const auto & p : prefixes) unsum_(base, p);
+
+			// Walk the path shared by all prefixes only once
+			common = { root_, 0, 0, 0 };
+			descend_(base, from_i, len, common);
+			for (; i < prefixes.size(); i++) {
+				cur = common;
+				// A sparse list may have been replaced by a bigger copy in the meantime
+				if (cur.parent) cur.node = load_(base + (cur.parent >> 3));
+				set_(base, prefixes[i], destination_i, cur);
+				countupdate_();
+			}
+		} catch (...) {
+			if (own) rollback_(false);
+			else {
+				touch_();
+				// The prefixes set before the failure stay, so the journal gets those
+				if (journal_ != nullptr) for (size_t j = 0; j < i; j++) journal_->set(prefixes[j], destination_i);
+			}
+			throw;
+		}
+		if (own) commit_(false);
+
+		touch_();
+		reclaim_();
+		if (journal_ != nullptr) journal_->range(from_i, to_i, destination_i);
+		return prefixes.size();
+	}
+
+	void DecTree::begin()
+	{
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!readonly(), std::logic_error, "Unable to modify a tree opened from an image, clear it first");
+		FCET(!txn_, std::logic_error, "Unable to begin a transaction while another one is open");
+		begin_();
+	}
+
+	void DecTree::begin_()
+	{
+		if (arena_ == nullptr) create_();
+		if (journal_ != nullptr) journal_->begin();
+		txn_ = true;
+		owner_ = std::this_thread::get_id();
+	}
+
+	std::unique_lock<std::mutex> DecTree::writer_()
+	{
+		std::unique_lock<std::mutex> lck(mux_);
+
+		ended_.wait(lck, [this]() { return !txn_ || owner_ == std::this_thread::get_id(); });
+		return lck;
+	}
+
+	const DecTree::version_t *DecTree::pin_() const
+	{
+		// Under the lock, so no modification is halfway changing nodes in place
+		GRD(mux_);
+		pinned_.fetch_add(1, std::memory_order_relaxed);
+		return current_.load(std::memory_order_acquire);
+	}
+
+	bool DecTree::isolate_()
+	{
+		if (txn_ || (replicas_ == 0 && pinned_.load(std::memory_order_acquire) == 0)) return false;
+		txn_ = true;
+		owner_ = std::this_thread::get_id();
+		return true;
+	}
+
+	void DecTree::commit()
+	{
+		GRD(mux_);
+		FCET(txn_ && owner_ == std::this_thread::get_id(), std::logic_error,
+			"Unable to commit without a transaction opened by this thread");
+		commit_();
+	}
+
+	void DecTree::commit_(const bool journal_i)
+	{
+		uint64_t epoch;
+
+		if (journal_i && journal_ != nullptr) journal_->commit();
+
+		// Lookups and versions still on the replaced nodes finish there
+		publish_(base_.load(std::memory_order_relaxed), root_);
+		epoch = Epoch::advance();
+		for (auto & r : replaced_) {
+			// The original root stays in place, so images can put the current one there
+			if (r.offset == ROOTNODE) continue;
+			r.epoch = epoch;
+			freed_.push_back(r);
+		}
+		replaced_.clear();
+		fresh_.clear();
+		txn_ = false;
+		ended_.notify_all();
+		touch_();
+		reclaim_();
+	}
+
+	void DecTree::rollback()
+	{
+		GRD(mux_);
+		if (txn_ && owner_ == std::this_thread::get_id()) rollback_();
+	}
+
+	void DecTree::rollback_(const bool journal_i)
+	{
+		// Nodes of the transaction were never published, so they can be reused right away
+		for (const auto & f : fresh_) free_[f.second].push_back(f.first);
+		root_ = current_.load(std::memory_order_relaxed)->root;
+		replaced_.clear();
+		fresh_.clear();
+		txn_ = false;
+		ended_.notify_all();
+
+		// Replay drops a transaction without a commit record, so a lost rollback record does no harm
+		if (journal_i && journal_ != nullptr) {
+			try {
+				journal_->rollback();
+			} catch (const std::exception & e) {
+				FW("Unable to journal a rollback, replay drops the transaction anyway: {}", e.what());
+			}
+		}
+	}
+
+	uint64_t DecTree::spotdest_(uint64_t *base_i, const spot_t & spot_i)
+	{
+		uint8_t s;
+
+		if (spot_i.node == 0) return 0;
+		if (POINTS2LEAF(spot_i.node)) return load_(slot_(base_i, spot_i.node));
+
+		s = stride_(base_i[0], spot_i.level);
+		if (spot_i.digits == 0) return load_(own_(base_i, spot_i.node, s));
+		return load_(slot_(base_i, spot_i.node, inner_(s, spot_i.digits) + spot_i.idx));
+	}
+
+	DecTree::spot_t DecTree::spotchild_(uint64_t *base_i, const spot_t & spot_i, const uint8_t digit_i)
+	{
+		uint64_t *sl, val;
+		uint16_t idx = spot_i.idx * 10 + digit_i;
+		uint8_t s;
+
+		if (spot_i.node == 0 || POINTS2LEAF(spot_i.node)) return { 0, 0, 0, 0 };
+
+		// Digits inside the stride of a list stay at the list
+		s = stride_(base_i[0], spot_i.level);
+		if (spot_i.digits + 1 < s) return { spot_i.node, spot_i.level, static_cast<uint8_t>(spot_i.digits + 1), idx };
+
+		sl = child_(base_i, spot_i.node, idx);
+		val = sl ? load_(sl) : 0;
+		if (!ISVALID(val)) return { 0, 0, 0, 0 };
+		return { val, spot_i.level + 1, 0, 0 };
+	}
+
+	uint64_t DecTree::sum_(uint64_t *base_i, const spot_t & spot_i) const
+	{
+		uint64_t rv;
+		spot_t child;
+		bool list = spot_i.digits == 0 && !POINTS2LEAF(spot_i.node);
+
+		if (spot_i.node == 0) return 0;
+		if (list) {
+			auto it = sums_.find(NODEOFFSET(spot_i.node));
+			if (it != sums_.end()) return it->second;
+		}
+
+		// Prepending a digit multiplies the hash of every prefix below by the same factor
+		rv = sumdest(spotdest_(base_i, spot_i));
+		for (uint8_t d = 0; d < 10; d++) {
+			child = spotchild_(base_i, spot_i, d);
+			if (child.node != 0) rv = (rv + summul(sumdigit[d], sum_(base_i, child))) % sumprime;
+		}
+		if (list) sums_[NODEOFFSET(spot_i.node)] = rv;
+		return rv;
+	}
+
+	void DecTree::unsum_(uint64_t *base_i, const std::string & number_i)
+	{
+		spot_t spot = { root_, 0, 0, 0 };
+
+		if (sums_.empty()) return;
+		for (size_t i = 0; spot.node != 0; i++) {
+			if (spot.digits == 0) sums_.erase(NODEOFFSET(spot.node));
+			if (i == number_i.size()) break;
+			spot = spotchild_(base_i, spot, number_i[i] - '0');
+		}
+	}
+
+	void DecTree::diff_(const DecTree *ta_i, uint64_t *from_i, const spot_t & a_i,
+		const DecTree *tb_i, uint64_t *to_i, const spot_t & b_i,
+		std::string & prefix_io, std::vector<change_t> & delta_o)
+	{
+		uint64_t a = spotdest_(from_i, a_i), b = spotdest_(to_i, b_i);
+		spot_t ca, cb;
+
+		// The root list has no number of its own
+		if (a != b && !prefix_io.empty()) delta_o.push_back({ prefix_io, a, b });
+
+		for (uint8_t d = 0; d < 10; d++) {
+			ca = spotchild_(from_i, a_i, d);
+			cb = spotchild_(to_i, b_i, d);
+			if (ca.node == 0 && cb.node == 0) continue;
+
+			// Nodes shared by two versions cannot have changed, modifications copy them while one is pinned
+			if (from_i == to_i && ca.node == cb.node && ca.digits == cb.digits && ca.idx == cb.idx) continue;
+
+			// Subtrees of two trees with the same hash hold the same prefixes and destinations
+			if (ta_i != nullptr && ta_i->sum_(from_i, ca) == tb_i->sum_(to_i, cb)) continue;
+
+			prefix_io.push_back('0' + d);
+			diff_(ta_i, from_i, ca, tb_i, to_i, cb, prefix_io, delta_o);
+			prefix_io.pop_back();
+		}
+	}
+
+	std::vector<DecTree::change_t> DecTree::delta_(const DecTree *ta_i, const version_t *from_i,
+		const DecTree *tb_i, const version_t *to_i)
+	{
+		std::vector<change_t> rv;
+		std::string prefix;
+
+		diff_(ta_i, from_i ? from_i->base : nullptr, { from_i ? from_i->root : 0, 0, 0, 0 },
+			tb_i, to_i ? to_i->base : nullptr, { to_i ? to_i->root : 0, 0, 0, 0 }, prefix, rv);
+		return rv;
+	}
+
+	std::vector<DecTree::change_t> DecTree::diff(const DecTree & other_i) const
+	{
+		if (&other_i == this) return {};
+
+		// Hashes of subtrees stay valid as long as no modification changes them in place
+		std::scoped_lock lck(mux_, other_i.mux_);
+		return delta_(this, current_.load(std::memory_order_acquire),
+			&other_i, other_i.current_.load(std::memory_order_acquire));
+	}
+
+	std::vector<DecTree::change_t> DecTree::diff(const Version & from_i) const
+	{
+		Epoch::Guard eg;
+
+		return delta_(nullptr, from_i.version_, nullptr, current_.load(std::memory_order_acquire));
+	}
+
+	size_t DecTree::apply(const std::vector<change_t> & delta_i)
+	{
+		uint64_t *base;
+		size_t pos;
+		bool own;
+
+		for (const auto & c : delta_i) {
+			FCET(c.prefix.size(), std::invalid_argument, "Prefix to apply is empty");
+			pos = c.prefix.find_first_not_of("0123456789");
+			FCET(pos == std::string::npos, std::invalid_argument,
+				"Prefix \"{}\" to apply contains at least one non-digit at position {}", c.prefix, pos);
+		}
+		if (delta_i.empty()) return 0;
+
+		std::unique_lock<std::mutex> lck = writer_();
+		FCET(!readonly(), std::logic_error, "Unable to modify a tree opened from an image, clear it first");
+		if (journal_ != nullptr) for (const auto & c : delta_i) Journal::check(c.prefix);
+
+		// Lookups see all of the changes at once, unless the caller has a transaction open
+		own = !txn_;
+		if (own) begin_();
+		try {
+			base = base_.load(std::memory_order_relaxed);
+			for (const auto & c : delta_i) {
+				cow_(base, c.prefix);
+				if (c.to) set_(base, c.prefix, c.to, { root_, 0, 0, 0 });
+				else {
+					try {
+						erase_(base, c.prefix);
+					} catch (...) {
+						// The transaction of the caller keeps what was erased
+						if (!own) erased_(base, c.prefix);
+						throw;
+					}
+				}
+				countupdate_();
+				if (journal_ != nullptr) {
+					if (c.to) journal_->set(c.prefix, c.to);
+					else journal_->erase(c.prefix);
+				}
+			}
+			if (own) commit_();
+		} catch (...) {
+			if (own) rollback_();
+			throw;
+		}
+		touch_();
+		reclaim_();
+		return delta_i.size();
 	}
 
 } // SdH namespace
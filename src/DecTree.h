@@ -32,41 +32,613 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Arena.h"
+#include "Epoch.h"
+#include "Journal.h"
+#include "commondefs.h"
 
 #define ISVALID(x)     (x & UINT64_C(0x01))
 #define POINTS2LEAF(x) (x & UINT64_C(0x02))
+#define ISSPARSE(x)    (x & UINT64_C(0x04))
+
+/// Tag bits of a slot referring to another node
+#define VALIDTAG       UINT64_C(0x01)
+#define LEAFTAG        UINT64_C(0x02)
+#define SPARSETAG      UINT64_C(0x04)
+#define TAGMASK        UINT64_C(0x07)
+
+/// Byte offset of the node a tagged slot refers to
+#define NODEOFFSET(x)  (x & ~TAGMASK)
+
+/// Size of the header of a saved image, the arena follows page aligned
+#define IMAGEHEADER    4096
+
+/// Number of top levels consolidate() lays out breadth-first
+#define BFSLEVELS      3
+
+/// Number of top levels that can have a stride of more than one digit
+#define STRIDELEVELS   8
+
+/// Maximum number of digits a list can consume at once
+#define MAXSTRIDE      3
+
+/// Maximum number of children of a sparse list, so it fits in a cache line
+#define SPARSEMAX      6
+
+/// Byte offset of the root list, after the stride profile of the arena
+#define ROOTNODE       UINT64_C(8)
+
+/// Gather lookup and update counters, 0 to leave them out completely
+#ifndef DECTREESTATS
+#define DECTREESTATS   1
+#endif
+
+/// Number of cache line sized counter blocks, threads beyond this share them
+#define STATSLOTS      64
+
+/// Number of buckets of the lookup depth histogram, the last one collects deeper lookups
+#define STATSDEPTH     16
+
+/// Number of entries of the per-thread lookup cache, a power of two
+#define LOOKUPCACHE    256
+
+/// Version of the image format written by save()
+#define IMAGEVERSION   3
+
+/// Number of digits the stack of an enumeration is reserved for, deeper trees grow it once
+#define EACHDEPTH      32
 
 namespace SdH {
 
+	/** Decimal tree mapping number prefixes to destinations.
+	 * All nodes live in one arena and refer to each other by tagged byte
+	 * offsets relative to its base. A list consists of 10 child slots, one
+	 * per digit, followed by the destination of the prefix leading to it. A
+	 * leaf holds only a destination and is used for prefixes without longer
+	 * ones below them.
+	 *
+	 * Lists in the top levels can be configured to consume up to MAXSTRIDE
+	 * digits at once, to shorten lookup paths where a numbering plan is
+	 * dense. A list with a stride of s digits has 10^s child slots, followed
+	 * by the destinations of prefixes ending inside the stride: 10 for one
+	 * more digit, 100 for two more, and so on. Those are independent of the
+	 * child slot, so they are loaded in parallel with it. The last slot holds
+	 * the destination of the list itself. The stride of every level is kept
+	 * in the first word of the arena.
+	 *
+	 * Lists consuming one digit start out sparse: an occupancy bitmap with
+	 * one bit per digit, the destination of the list and only the children
+	 * that exist, in digit order. The child for a digit is found by counting
+	 * the bits below it. Adding a child replaces a sparse list by a bigger
+	 * copy, or by a full list once it would get more than SPARSEMAX
+	 * children. Slots referring to a sparse list are tagged with SPARSETAG.
+	 *
+	 * Lookups never take a lock. A single writer at a time, serialized by
+	 * a mutex, publishes changes with atomic stores into the slots, after
+	 * the nodes they refer to have been completely initialized. Memory that
+	 * readers might still use is only released when all reader epochs have
+	 * moved past the moment it was unlinked.
+	 *
+	 * Readers start at the root of the current version, which pairs the
+	 * base address of the arena with the offset of the root list. A
+	 * transaction copies every node on the paths it modifies into fresh
+	 * arena space, leaving the current version alone, and publishes a new
+	 * version with a single atomic store when it commits. */
+	class DecTreeBuilder;
+	template <const uint64_t *ARENA, size_t WORDS> class FrozenDecTree;
+
 	class DecTree
 	{
+		/// Bulk builder fills the arena directly
+		friend class DecTreeBuilder;
+
+		/// Frozen trees walk the same layout
+		template <const uint64_t *ARENA, size_t WORDS> friend class FrozenDecTree;
+
 		private:
 		/// Copy construction not allowed
-		DecTree(const DecTree * obj_i) = delete;
+		DecTree(const DecTree & obj_i) = delete;
 
 		/// Assignment construction not allowed
 		DecTree & operator=(const DecTree & obj_i) = delete;
 
+		public:
+		/// Difference of the destination of a prefix between two trees
+		struct change_t {
+			/// Prefix
+			std::string prefix;
+
+			/// Destination in the tree compared from, 0 if it has none
+			uint64_t from;
+
+			/// Destination in the tree compared to, 0 if it has none, which apply() erases
+			uint64_t to;
+		};
+
 		protected:
-		/// Base address of data
-		void *base_;
+		/// Powers of ten up to the maximum stride
+		static constexpr uint16_t POW10[MAXSTRIDE + 1] = { 1, 10, 100, 1000 };
+
+		/// Slot of a sparse list holding its destination, after the bitmap
+		static constexpr uint8_t SPARSEDEST = 1;
+
+		/// Slot of a sparse list holding its first child
+		static constexpr uint8_t SPARSEFIRST = 2;
+
+		/// Number of lookups a batch keeps in flight at the same time
+		static constexpr uint8_t BATCHWIDTH = 16;
+
+		/// Header at the start of a saved image
+		struct image_t {
+			/// Magic bytes identifying the file format
+			char magic[8];
+
+			/// Byte order marker, to refuse images from other architectures
+			uint64_t byteorder;
+
+			/// Version of the image format
+			uint32_t version;
+
+			/// Offset of the arena in the file
+			uint32_t offset;
+
+			/// Number of bytes of arena in the file
+			uint64_t bytes;
+		};
+
+		/// Position of a writer walking the tree
+		struct cursor_t {
+			/// Tagged slot referring to the current list
+			uint64_t node;
+
+			/// Byte offset of the slot referring to the current list, 0 for the root
+			uint64_t parent;
+
+			/// Level of the current list
+			size_t level;
+
+			/// Number of digits consumed before the current list
+			size_t pos;
+		};
+
+		/// Memory retired by a writer, to be released when no reader can use it
+		struct retired_t {
+			/// Epoch the memory was retired in
+			uint64_t epoch;
+
+			/// Memory to release
+			void *ptr;
+
+			/// Function to release the memory with
+			void (*release)(void *);
+		};
+
+		/// Node unlinked by a writer, to be reused when no reader can use it
+		struct freed_t {
+			/// Epoch the node was unlinked in
+			uint64_t epoch;
+
+			/// Byte offset of the node
+			uint64_t offset;
+
+			/// Size of the node in bytes
+			uint32_t bytes;
+		};
+
+		/// Allocation state of an arena, put aside while building a new one
+		struct alloc_t {
+			/// Arena
+			Arena *arena;
+
+			/// Next free byte in allocated memory
+			uint64_t nextfree;
+
+			/// Nodes unlinked from the arena, waiting for readers to move on
+			std::vector<freed_t> freed;
+
+			/// Offsets of reusable nodes in the arena, per size in bytes
+			std::unordered_map<uint32_t, std::vector<uint64_t>> free;
+		};
+
+		/// Position of a diff walk, after the digits of a prefix
+		struct spot_t {
+			/// Tagged slot referring to the node holding the position, 0 if the tree has none
+			uint64_t node;
+
+			/// Level of the node
+			size_t level;
+
+			/// Number of digits of the stride of the node consumed
+			uint8_t digits;
+
+			/// Index formed by those digits
+			uint16_t idx;
+		};
+
+		/// Position of an enumeration, with the next digit to follow from it
+		struct frame_t {
+			/// Position
+			spot_t spot;
+
+			/// Next digit to follow
+			uint8_t digit;
+		};
+
+		/// Version of the tree readers walk, replaced as a whole
+		struct version_t {
+			/// Base address of the arena
+			uint64_t *base;
+
+			/// Byte offset of the root list
+			uint64_t root;
+
+			/// Base addresses of read replicas, one per NUMA node, empty if not replicating
+			std::vector<uint64_t *> replicas;
+		};
+
+		/// Base address of data, stable for the lifetime of the arena
+		std::atomic<uint64_t *> base_;
+
+		/// Arena holding all nodes, only used by writers
+		Arena *arena_;
+
+		/// Number of bytes of address space to reserve for an arena
+		uint64_t reserve_;
+
+		/// Huge page policy for arenas
+		Arena::hugepages_t huge_;
 
 		/// Mutex to prevent simultaneous modifications
-		std::mutex mux_;
+		mutable std::mutex mux_;
 
 		/// Next free byte in allocated memory
 		uint64_t nextfree_;
 
-		/// Number of memory pages allocated
-		uint32_t pages_;
+		/// Stride profile for the next arena, one byte per level
+		uint64_t profile_;
 
-		/** Reset a block of memory, possibly allocating more pages of
-		 * necessary.
+		/// Memory retired by writers
+		std::vector<retired_t> retired_;
+
+		/// Nodes unlinked from the current arena, waiting for readers to move on
+		std::vector<freed_t> freed_;
+
+		/// Offsets of reusable nodes in the current arena, per size in bytes
+		std::unordered_map<uint32_t, std::vector<uint64_t>> free_;
+
+		/// Version lookups start from, nullptr while the tree is empty
+		std::atomic<version_t *> current_;
+
+		/// Byte offset of the root list writers modify, ahead of current_ during a transaction
+		uint64_t root_;
+
+		/// True while a transaction is open
+		bool txn_;
+
+		/// Thread that opened the transaction, modifications of other threads wait for it to end
+		std::thread::id owner_;
+
+		/// Signalled whenever a transaction ends
+		std::condition_variable ended_;
+
+		/// Number of pinned versions, which modifications must not change in place
+		mutable std::atomic<uint32_t> pinned_;
+
+		/// Nodes allocated by the open transaction, not reachable from current_, with their size in bytes
+		std::unordered_map<uint64_t, uint32_t> fresh_;
+
+		/// Nodes of the current version copied by the open transaction, to be reused once it commits
+		std::vector<freed_t> replaced_;
+
+		/// Hashes of the subtrees below lists of the arena by offset, as far as diff() needed them
+		mutable std::unordered_map<uint64_t, uint64_t> sums_;
+
+		/// Number of read replicas every version gets, 0 if lookups use the arena itself
+		uint32_t replicas_;
+
+		/// Arenas holding the read replicas, shared by all versions of the same arena
+		std::vector<Arena *> mirrors_;
+
+		/// Base address of the arena mirrors_ are copies of, nullptr if none
+		const uint64_t *mirrored_;
+
+		/// Journal recording modifications, nullptr if not journaling
+		Journal *journal_;
+
+		/// Unique number of the current contents, changed by every modification
+		std::atomic<uint64_t> generation_;
+
+		/// True if lookups go through the per-thread cache
+		std::atomic<bool> cache_;
+
+		/// Cached result of a lookup
+		struct cached_t {
+			/// Packed number, as taken by lookupBCD()
+			uint64_t key;
+
+			/// Generation of the tree the result was found in
+			uint64_t generation;
+
+			/// Found destination
+			uint64_t destination;
+		};
+
+		/// Path of the snapshot a checkpoint writes
+		std::string snapshot_;
+
+#if DECTREESTATS
+		/// Counters of one thread, in a cache line of their own
+		struct alignas(64) counters_t {
+			/// Number of lookups
+			uint64_t lookups;
+
+			/// Number of lookups that found a destination
+			uint64_t hits;
+
+			/// Number of modifications
+			uint64_t updates;
+
+			/// Number of lookups served from the cache
+			uint64_t cached;
+
+			/// Number of lookups per number of levels descended below the root
+			uint64_t depths[STATSDEPTH];
+		};
+
+		/// Counter blocks, indexed by statslot_()
+		counters_t *counters_;
+
+		/** Get the counter block of the calling thread. Threads are assigned
+		 * blocks round robin when they first use one, so only more than
+		 * STATSLOTS threads share a block, and may then lose increments.
+		 * @returns Index in counters_. */
+		static inline size_t statslot_()
+		{
+			static std::atomic<size_t> next(0);
+			static thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed) % STATSLOTS;
+
+			return slot;
+		}
+
+		/** Increment a counter without a locked instruction, as only the
+		 * owning thread writes it.
+		 * @param counter_io Counter to increment. */
+		static inline void bump_(uint64_t & counter_io)
+		{
+			__atomic_store_n(&counter_io, __atomic_load_n(&counter_io, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+		}
+#endif
+
+		/** Count a lookup, if statistics are gathered.
+		 * @param depth_i Number of levels descended below the root.
+		 * @param found_i Destination found, 0 if none. */
+		inline void countlookup_(const size_t depth_i, const uint64_t found_i) const
+		{
+#if DECTREESTATS
+			counters_t & c = counters_[statslot_()];
+
+			bump_(c.lookups);
+			if (found_i) bump_(c.hits);
+			bump_(c.depths[depth_i < STATSDEPTH ? depth_i : STATSDEPTH - 1]);
+#else
+			UNUSED(depth_i);
+			UNUSED(found_i);
+#endif
+		}
+
+		/** Count a lookup served from the cache, if statistics are gathered.
+		 * @param found_i Destination found, 0 if none. */
+		inline void countcached_(const uint64_t found_i) const
+		{
+#if DECTREESTATS
+			counters_t & c = counters_[statslot_()];
+
+			bump_(c.lookups);
+			bump_(c.cached);
+			if (found_i) bump_(c.hits);
+#else
+			UNUSED(found_i);
+#endif
+		}
+
+		/// Count a modification, if statistics are gathered
+		inline void countupdate_() const
+		{
+#if DECTREESTATS
+			bump_(counters_[statslot_()].updates);
+#endif
+		}
+
+		/** Give the contents a new generation, after publishing a
+		 * modification, so cached lookup results are no longer used.
+		 * Generations are unique over all trees, so one cache serves them
+		 * all. */
+		inline void touch_()
+		{
+			static std::atomic<uint64_t> next(0);
+
+			generation_.store(next.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/** Pack a number as taken by lookupBCD().
+		 * @param number_i Number to pack.
+		 * @returns Packed number, or UINT64_MAX if it is empty, longer than
+		 * 16 digits or holds a non-digit. */
+		static inline uint64_t pack_(const std::string_view number_i)
+		{
+			uint64_t rv = UINT64_MAX;
+			uint8_t d;
+
+			if (number_i.empty() || number_i.size() > 16) return UINT64_MAX;
+			for (size_t i = 0; i < number_i.size(); i++) {
+				d = static_cast<uint8_t>(number_i[i] - '0');
+				if (d > 9) return UINT64_MAX;
+				rv = (rv << 4) | d;
+			}
+			// Rotate the digits to the top, keeping the filler nibbles below them
+			return number_i.size() < 16 ? (rv << (64 - 4 * number_i.size())) | (UINT64_MAX >> (4 * number_i.size())) : rv;
+		}
+
+		/** Get the entry of the per-thread lookup cache for a number. All
+		 * lookup methods pack numbers the same way, and generations are
+		 * unique over all trees, so one cache per thread serves them all.
+		 * @param key_i Packed number.
+		 * @returns Cache entry. */
+		static inline cached_t & cacheslot_(const uint64_t key_i)
+		{
+			static thread_local cached_t cache[LOOKUPCACHE];
+
+			return cache[((key_i * UINT64_C(0x9E3779B97F4A7C15)) >> 32) % LOOKUPCACHE];
+		}
+
+		/** Lookup through the per-thread cache, if enabled. A result is only
+		 * used while the tree still has the generation it was found in.
+		 * @param key_i Packed number, UINT64_MAX to bypass the cache.
+		 * @param lookup_i Callable doing the actual lookup.
+		 * @returns Found destination, or 0 if not found. */
+		template <class LOOKUP>
+		inline uint64_t cached_(const uint64_t key_i, LOOKUP lookup_i) const
+		{
+			uint64_t generation, found;
+
+			if (key_i == UINT64_MAX || !cache_.load(std::memory_order_relaxed)) return lookup_i();
+
+			// Read the generation before the tree, so a concurrent modification invalidates the result
+			generation = generation_.load(std::memory_order_acquire);
+			cached_t & c = cacheslot_(key_i);
+			if (c.key == key_i && c.generation == generation) {
+				countcached_(c.destination);
+				return c.destination;
+			}
+
+			found = lookup_i();
+			c = { key_i, generation, found };
+			return found;
+		}
+
+		/** Atomically read a slot.
+		 * @param slot_i Slot to read.
+		 * @returns Slot value. */
+		static inline uint64_t load_(const uint64_t *slot_i)
+		{
+			return __atomic_load_n(slot_i, __ATOMIC_ACQUIRE);
+		}
+
+		/** Atomically publish a new slot value. Everything written before
+		 * this store is visible to readers that observe the new value.
+		 * @param slot_i Slot to write.
+		 * @param value_i New value of the slot. */
+		static inline void store_(uint64_t *slot_i, const uint64_t value_i)
+		{
+			__atomic_store_n(slot_i, value_i, __ATOMIC_RELEASE);
+		}
+
+		/** Address of a slot in the arena.
+		 * @param base_i Base address of the arena.
+		 * @param offset_i Byte offset of the node, possibly tagged.
+		 * @param slot_i Slot number within the node.
+		 * @returns Pointer to the slot. */
+		static inline uint64_t *slot_(uint64_t *base_i, const uint64_t offset_i, const uint16_t slot_i = 0)
+		{
+			return base_i + (NODEOFFSET(offset_i) >> 3) + slot_i;
+		}
+
+		/** Get the stride of a level from a stride profile.
+		 * @param profile_i Stride profile, one byte per level.
+		 * @param level_i Level, 0 for the root list.
+		 * @returns Number of digits consumed by lists at this level. */
+		static constexpr uint8_t stride_(const uint64_t profile_i, const size_t level_i)
+		{
+			uint8_t s = level_i < STRIDELEVELS ? (profile_i >> (8 * level_i)) & 0xFF : 1;
+			return s ? s : 1;
+		}
+
+		/** Get the number of slots of a list.
+		 * @param stride_i Stride of the list.
+		 * @returns Number of slots. */
+		static constexpr uint16_t slots_(const uint8_t stride_i)
+		{
+			return (POW10[stride_i] * 10 - 1) / 9;
+		}
+
+		/** Get the first slot holding destinations of prefixes ending inside
+		 * a stride.
+		 * @param stride_i Stride of the list.
+		 * @param digits_i Number of digits of the stride the prefixes
+		 * consume, 1 up to @p stride_i - 1.
+		 * @returns Slot of the destination for the prefix with all of
+		 * those digits 0, the others follow in numerical order. */
+		static constexpr uint16_t inner_(const uint8_t stride_i, const uint8_t digits_i)
+		{
+			return POW10[stride_i] + (POW10[digits_i] - 10) / 9;
+		}
+
+		/** Get the slot holding the destination of a list itself.
+		 * @param stride_i Stride of the list.
+		 * @returns Slot number. */
+		static constexpr uint16_t destslot_(const uint8_t stride_i)
+		{
+			return slots_(stride_i) - 1;
+		}
+
+		/** Get the child slot of a list.
+		 * @param base_i Base address of the arena.
+		 * @param node_i Tagged slot referring to the list.
+		 * @param idx_i Value of the digits the list consumes.
+		 * @returns Pointer to the child slot, or nullptr if a sparse list
+		 * has no child for @p idx_i. */
+		static inline uint64_t *child_(uint64_t *base_i, const uint64_t node_i, const uint16_t idx_i)
+		{
+			uint64_t bm;
+
+			if (!ISSPARSE(node_i)) return slot_(base_i, node_i, idx_i);
+			bm = load_(slot_(base_i, node_i));
+			if (!((bm >> idx_i) & 1)) return nullptr;
+			return slot_(base_i, node_i, SPARSEFIRST + __builtin_popcountll(bm & ((UINT64_C(1) << idx_i) - 1)));
+		}
+
+		/** Get the slot holding the destination of a list itself.
+		 * @param base_i Base address of the arena.
+		 * @param node_i Tagged slot referring to the list.
+		 * @param stride_i Stride of the list.
+		 * @returns Pointer to the destination slot. */
+		static inline uint64_t *own_(uint64_t *base_i, const uint64_t node_i, const uint8_t stride_i)
+		{
+			return slot_(base_i, node_i, ISSPARSE(node_i) ? SPARSEDEST : destslot_(stride_i));
+		}
+
+		/** Get the size of a node.
+		 * @param base_i Base address of the arena.
+		 * @param node_i Tagged slot referring to the node.
+		 * @param stride_i Stride of the node, if it is a list.
+		 * @returns Number of bytes of the node. */
+		static inline uint32_t bytes_(uint64_t *base_i, const uint64_t node_i, const uint8_t stride_i)
+		{
+			if (POINTS2LEAF(node_i)) return sizeof(uint64_t);
+			if (ISSPARSE(node_i)) return sizeof(uint64_t) * (SPARSEFIRST + __builtin_popcountll(load_(slot_(base_i, node_i))));
+			return sizeof(uint64_t) * slots_(stride_i);
+		}
+
+		/** Reset a block of memory, reusing a freed node of the same size if
+		 * there is one, or else possibly committing more pages of the arena.
+		 * The arena never moves, so readers stay valid while it grows. Must
+		 * be called with mux_ held.
 		 * @param bytes_i Number of bytes to clear
 		 * @returns Offset of block, relative to base. */
-		uint64_t extra_(const uint8_t bytes_i);
+		uint64_t extra_(const uint32_t bytes_i);
 
 		/** Create a new leaf in memory, possibly allocating more pages if
 		 * necessary.
@@ -75,26 +647,796 @@ namespace SdH {
 
 		/** Create a new list in memory, possibly allocating more pages if
 		 * necessary.
+		 * @param stride_i Number of digits the list consumes.
 		 * @returns Offset in bytes of new list, relative to base. */
-		inline uint64_t newlist_() { return extra_(sizeof(uint64_t)*11); }
+		inline uint64_t newlist_(const uint8_t stride_i) { return extra_(sizeof(uint64_t) * slots_(stride_i)); }
+
+		/** Create a new sparse list in memory, possibly allocating more pages
+		 * if necessary.
+		 * @param children_i Number of children the list has room for.
+		 * @returns Offset in bytes of new list, relative to base. */
+		inline uint64_t newsparse_(const uint8_t children_i) { return extra_(sizeof(uint64_t) * (SPARSEFIRST + children_i)); }
+
+		/** Hand a node that has been unlinked from the tree over for reuse
+		 * once no reader can use it anymore. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param node_i Tagged slot that referred to the node.
+		 * @param stride_i Stride of the node, if it is a list. */
+		void freenode_(uint64_t *base_i, const uint64_t node_i, const uint8_t stride_i);
+
+		/** Build the nodes for the rest of a number that is not in the tree
+		 * yet, bottom-up, so they are complete before being published. Must
+		 * be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number being set.
+		 * @param pos_i Number of digits consumed before the top node.
+		 * @param level_i Level of the top node.
+		 * @param destination_i Destination of the number.
+		 * @param inherit_i Destination of the top node itself, if it is a list.
+		 * @returns Tagged slot referring to the top node. */
+		uint64_t chain_(uint64_t *base_i, const std::string & number_i, const size_t pos_i, const size_t level_i,
+			const uint64_t destination_i, const uint64_t inherit_i);
+
+		/** Add a child to a list that does not have one for a value yet. A
+		 * sparse list is replaced by a copy with room for the new child, or
+		 * by a full list if it would get more than SPARSEMAX children. Must
+		 * be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param node_i Tagged slot referring to the list.
+		 * @param parent_i Byte offset of the slot referring to the list.
+		 * @param idx_i Value of the digits of the new child.
+		 * @param child_i Tagged slot referring to the new child. */
+		void addchild_(uint64_t *base_i, const uint64_t node_i, const uint64_t parent_i, const uint16_t idx_i,
+			const uint64_t child_i);
+
+		/** Remove a child from a list. A sparse list is replaced by a copy
+		 * without it. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param cur_i Position of the list.
+		 * @param idx_i Value of the digits of the child.
+		 * @returns Tagged slot now referring to the list. */
+		uint64_t removechild_(uint64_t *base_i, const cursor_t & cur_i, const uint16_t idx_i);
+
+		/** Prune the lists at the end of a path that no longer hold anything,
+		 * bottom-up. A list left with only its own destination is replaced by
+		 * a leaf. The root list is never removed. Must be called with mux_
+		 * held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number the path was walked for.
+		 * @param path_io Lists on the path, starting at the root. */
+		void prune_(uint64_t *base_i, const std::string & number_i, std::vector<cursor_t> & path_io);
+
+		/** Set a destination for a number, starting at a list on its path.
+		 * The number is not validated. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i The number (range) to set.
+		 * @param destination_i The destination to set.
+		 * @param cur_i List to start at, the root or one found by descend_(). */
+		void set_(uint64_t *base_i, const std::string & number_i, const uint64_t destination_i, cursor_t cur_i);
+
+		/** Follow the existing lists on the path of a number as far as
+		 * possible, leaving at least the last of a number of digits
+		 * unconsumed. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number to follow.
+		 * @param len_i Maximum number of digits to consume.
+		 * @param cur_io List to start at, updated to the deepest list found. */
+		void descend_(uint64_t *base_i, const std::string & number_i, const size_t len_i, cursor_t & cur_io);
+
+		/** Allocate a list in the current arena for a copy of a list, sparse
+		 * if it has few enough children. Must be called with mux_ held.
+		 * @param from_i Base address of the arena to copy from.
+		 * @param val_i Tagged slot referring to the list to copy.
+		 * @param stride_i Stride of the list.
+		 * @returns Tagged slot referring to the empty copy. */
+		uint64_t newcopy_(const uint64_t *from_i, const uint64_t val_i, const uint8_t stride_i);
+
+		/** Fill a copy of a list allocated with newcopy_(), as part of
+		 * consolidation. Must be called with mux_ held.
+		 * @param from_i Base address of the arena to copy from.
+		 * @param val_i Tagged slot referring to the list to copy.
+		 * @param to_i Tagged slot referring to the copy.
+		 * @param level_i Level of the list.
+		 * @param bfs_i Queue of lists to lay out breadth-first, with entries
+		 * of offset to copy, copy and level. Children of the list are added
+		 * to it unless it is nullptr, then they are copied depth-first.
+		 * @returns True if the copy has children or destinations of prefixes
+		 * ending inside its stride. */
+		bool copylist_(const uint64_t *from_i, const uint64_t val_i, const uint64_t to_i, const size_t level_i,
+			std::deque<std::tuple<uint64_t, uint64_t, size_t>> *bfs_i);
+
+		/** Read and check the header of an image file.
+		 * @param fd_i File descriptor of the image file.
+		 * @param path_i Path of the image file, for error messages.
+		 * @returns Header of the image.
+		 * @throws std::runtime_error if the file is not an image of the
+		 * current version. */
+		static image_t header_(const int fd_i, const std::string & path_i);
+
+		/** Replace the current arena by another one and publish it. Must be
+		 * called with mux_ held.
+		 * @param arena_i New arena, nullptr to make the tree empty.
+		 * @param bytes_i Number of bytes in use in the new arena. */
+		void replace_(Arena *arena_i, const uint64_t bytes_i);
+
+		/** Save the tree to an image file. Must be called with mux_ held.
+		 * @param path_i Path of the image file. */
+		void save_(const std::string & path_i);
+
+		/** Create a new arena holding a stride profile and an empty root
+		 * list, and make it the current arena for allocations. It is not
+		 * published to readers. The allocation state of the previous arena
+		 * is moved aside, so restore_() can go back to it if filling or
+		 * publishing the new one fails. Must be called with mux_ held.
+		 * @param profile_i Stride profile of the new arena.
+		 * @param old_o Set to the allocation state of the previous arena.
+		 * @returns Base address of the new arena. */
+		uint64_t *newarena_(const uint64_t profile_i, alloc_t & old_o);
+
+		/** Drop an arena created by newarena_() that has not been published,
+		 * going back to the previous one. Must be called with mux_ held.
+		 * @param old_io Allocation state of the previous arena, moved from. */
+		void restore_(alloc_t & old_io);
+
+		/** Create and publish the arena of an empty tree. Must be called
+		 * with mux_ held. */
+		void create_();
+
+		/** Hand memory over for release once no reader can use it anymore.
+		 * Must be called with mux_ held.
+		 * @param ptr_i Memory to release.
+		 * @param release_i Function to release the memory with. */
+		void retire_(void *ptr_i, void (*release_i)(void *));
+
+		/** Release all retired memory that no reader can use anymore.
+		 * Must be called with mux_ held. */
+		void reclaim_();
+
+		/** Publish a new version to readers, retiring the previous one.
+		 * When replicating, the replicas are brought up to date first. Must
+		 * be called with mux_ held.
+		 * @param base_i Base address of the arena, nullptr if empty.
+		 * @param root_i Byte offset of the root list.
+		 * @throws std::bad_alloc if a replica cannot be allocated. */
+		void publish_(uint64_t *base_i, const uint64_t root_i);
+
+		/** Bring the replicas up to date with the arena. For the arena they
+		 * already copy, only the nodes allocated by the transaction being
+		 * committed are copied, as nothing else changed since the previous
+		 * version. For another arena or number of replicas, new replicas
+		 * with a full copy replace them. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param stale_o Replicas replaced, to be retired once published.
+		 * @throws std::bad_alloc if a replica cannot be allocated, leaving
+		 * the replicas as they were. */
+		void mirror_(const uint64_t *base_i, std::vector<Arena *> & stale_o);
+
+		/** Release a version, usable as deleter of retired memory.
+		 * @param version_i Version to release. */
+		static void dropversion_(void *version_i);
+
+		/** Get the base address a lookup in a version reads from: the
+		 * replica of the NUMA node the calling thread runs on, if any.
+		 * @param version_i Version to read, nullptr if empty.
+		 * @returns Base address, nullptr if empty. */
+		static inline uint64_t *local_(const version_t *version_i)
+		{
+			if (version_i == nullptr) return nullptr;
+			if (version_i->replicas.empty()) return version_i->base;
+			return version_i->replicas[Arena::node() % version_i->replicas.size()];
+		}
+
+		/** Make sure a node can be modified without readers noticing, by
+		 * copying it unless the open transaction allocated it. Must be
+		 * called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param val_i Tagged slot referring to the node.
+		 * @param stride_i Stride of the node if it is a list.
+		 * @returns Tagged slot referring to the node to modify. */
+		uint64_t private_(uint64_t *base_i, const uint64_t val_i, const uint8_t stride_i);
+
+		/** Copy the nodes on the path of a number that the open transaction
+		 * did not allocate, so modifications along it stay invisible until
+		 * it commits. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number to be modified. */
+		void cow_(uint64_t *base_i, const std::string & number_i);
+
+		/** Remove the destination of a number, pruning lists left empty.
+		 * Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number to erase.
+		 * @returns True if the number had a destination. */
+		bool erase_(uint64_t *base_i, const std::string & number_i);
+
+		/** Journal an erase that failed while pruning, if the destination of
+		 * the number is gone already. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number that was being erased. */
+		void erased_(uint64_t *base_i, const std::string & number_i);
+
+		/** Lock the tree for a modification. If another thread has a
+		 * transaction open, wait for it to end first, so the modification
+		 * does not become part of it.
+		 * @returns Lock on mux_. */
+		std::unique_lock<std::mutex> writer_();
+
+		/** Pin the current version for a Version.
+		 * @returns Current version, nullptr if the tree is empty. */
+		const version_t *pin_() const;
+
+		/** Make a modification outside a transaction copy the nodes on its
+		 * path while a version is pinned, so the version does not change
+		 * under it, or while replicating, so only the copies have to be
+		 * copied into the replicas. Must be called with mux_ held.
+		 * @returns True if the modification got a transaction of its own,
+		 * to be ended with commit_(false) or rollback_(false). */
+		bool isolate_();
+
+		/// Open a transaction, must be called with mux_ held
+		void begin_();
+
+		/** Commit the open transaction, must be called with mux_ held.
+		 * @param journal_i False for a transaction of a single
+		 * modification, which journals itself. */
+		void commit_(const bool journal_i = true);
+
+		/** Drop the open transaction, must be called with mux_ held. The
+		 * transaction has ended before the rollback is journaled, so a
+		 * failure to journal it is only logged.
+		 * @param journal_i False for a transaction of a single
+		 * modification, which journals itself. */
+		void rollback_(const bool journal_i = true);
+
+		/** Get the destination of exactly the prefix leading to a position.
+		 * @param base_i Base address of the arena.
+		 * @param spot_i Position.
+		 * @returns Destination, 0 if none. */
+		static uint64_t spotdest_(uint64_t *base_i, const spot_t & spot_i);
+
+		/** Get the position one digit further.
+		 * @param base_i Base address of the arena.
+		 * @param spot_i Position.
+		 * @param digit_i Digit to follow.
+		 * @returns Position, with node 0 if the tree has nothing there. */
+		static spot_t spotchild_(uint64_t *base_i, const spot_t & spot_i, const uint8_t digit_i);
+
+		/** Get a hash of the prefixes below a position, relative to it, and
+		 * their destinations. It does not depend on strides or layout, so
+		 * equal subtrees of different trees have equal hashes. The hashes
+		 * of lists are kept in sums_ until they change. Must be called with
+		 * mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param spot_i Position.
+		 * @returns Hash below 2^61-1, 0 if nothing below has a destination. */
+		uint64_t sum_(uint64_t *base_i, const spot_t & spot_i) const;
+
+		/** Forget the hashes of the lists on the path of a number, before
+		 * they are changed in place. Must be called with mux_ held.
+		 * @param base_i Base address of the arena.
+		 * @param number_i Number about to be modified. */
+		void unsum_(uint64_t *base_i, const std::string & number_i);
+
+		/** Compare the subtrees at two positions digit by digit, skipping
+		 * subtrees both share or that have equal hashes. The stride
+		 * profiles may differ.
+		 * @param ta_i Tree of the first position, to compare hashes of,
+		 * nullptr to compare versions of one tree.
+		 * @param from_i Base address of the arena of the first position.
+		 * @param a_i First position.
+		 * @param tb_i Tree of the second position, nullptr if @p ta_i is.
+		 * @param to_i Base address of the arena of the second position.
+		 * @param b_i Second position.
+		 * @param prefix_io Prefix leading to the positions, restored on return.
+		 * @param delta_o Vector to append the differences to. */
+		static void diff_(const DecTree *ta_i, uint64_t *from_i, const spot_t & a_i,
+			const DecTree *tb_i, uint64_t *to_i, const spot_t & b_i,
+			std::string & prefix_io, std::vector<change_t> & delta_o);
+
+		/** Compare two versions. The caller keeps an Epoch::Guard, or the
+		 * locks of both trees when comparing hashes.
+		 * @param ta_i Tree of the first version, to compare hashes of,
+		 * nullptr to compare versions of one tree.
+		 * @param from_i Version to compare from, nullptr if empty.
+		 * @param tb_i Tree of the second version, nullptr if @p ta_i is.
+		 * @param to_i Version to compare to, nullptr if empty.
+		 * @returns Differences in ascending order of prefix. */
+		static std::vector<change_t> delta_(const DecTree *ta_i, const version_t *from_i,
+			const DecTree *tb_i, const version_t *to_i);
+
+		/** Lookup a number in a version of the tree.
+		 * @param version_i Version to walk, nullptr if empty.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		uint64_t find_(const version_t *version_i, const std::string_view number_i) const;
+
+		/** Find the position of a prefix in a version.
+		 * @param base_i Base address of the arena to read.
+		 * @param version_i Version to walk, nullptr if empty.
+		 * @param prefix_i Prefix, empty for the root list.
+		 * @returns Position, with node 0 if the version has nothing there.
+		 * @throws std::invalid_argument if @p prefix_i does not consist of
+		 * only digits in the range 0 through 9. */
+		static spot_t under_(uint64_t *base_i, const version_t *version_i, const std::string_view prefix_i);
+
+		/** Enumerate the prefixes of a version that have a destination,
+		 * depth-first in ascending order. The stack and the key are
+		 * allocated once, so nothing is allocated per entry. The caller
+		 * keeps an Epoch::Guard.
+		 * @param version_i Version to walk, nullptr if empty.
+		 * @param prefix_i Prefix to limit the enumeration to, empty for all.
+		 * @param visit_i Callable invoked with every prefix and its destination.
+		 * @returns Number of prefixes visited.
+		 * @throws std::invalid_argument if @p prefix_i does not consist of
+		 * only digits in the range 0 through 9. */
+		template <class VISIT>
+		static size_t each_(const version_t *version_i, const std::string_view prefix_i, VISIT visit_i)
+		{
+			uint64_t *base = local_(version_i), dest, bm;
+			std::vector<frame_t> stack;
+			std::string key(prefix_i);
+			size_t rv = 0;
+			spot_t child;
+			uint8_t d;
+
+			child = under_(base, version_i, prefix_i);
+			if (child.node == 0) return 0;
+
+			// The root list has no number of its own
+			dest = key.empty() ? 0 : spotdest_(base, child);
+			if (dest) {
+				visit_i(std::string_view(key), dest);
+				rv++;
+			}
+			if (POINTS2LEAF(child.node)) return rv;
+
+			stack.reserve(EACHDEPTH);
+			key.reserve(key.size() + EACHDEPTH);
+			stack.push_back({ child, 0 });
+			while (!stack.empty()) {
+				if (stack.back().digit > 9) {
+					stack.pop_back();
+					if (!stack.empty()) key.pop_back();
+					continue;
+				}
+				d = stack.back().digit;
+
+				// Sparse lists consume one digit and know their children, so skip straight to the next one
+				if (ISSPARSE(stack.back().spot.node)) {
+					bm = (load_(slot_(base, stack.back().spot.node)) & 0x3FF) >> d;
+					d = bm ? d + __builtin_ctzll(bm) : 10;
+					if (d > 9) {
+						stack.back().digit = d;
+						continue;
+					}
+				}
+				stack.back().digit = d + 1;
+				child = spotchild_(base, stack.back().spot, d);
+				if (child.node == 0) continue;
+
+				key.push_back('0' + d);
+				dest = spotdest_(base, child);
+				if (dest) {
+					visit_i(std::string_view(key), dest);
+					rv++;
+				}
+
+				// Leaves have nothing below them, so do not bother stacking them
+				if (POINTS2LEAF(child.node)) key.pop_back();
+				else stack.push_back({ child, 0 });
+			}
+			return rv;
+		}
+
+		/** Copy a subtree depth-first into the current arena, as part of
+		 * consolidation. Lists without children become leaves and subtrees
+		 * without any destination are dropped. Must be called with mux_
+		 * held.
+		 * @param from_i Base address of the arena to copy from.
+		 * @param val_i Tagged slot referring to the subtree root.
+		 * @param level_i Level of the subtree root.
+		 * @returns Tagged slot referring to the copy, 0 if dropped. */
+		uint64_t copydfs_(const uint64_t *from_i, const uint64_t val_i, const size_t level_i);
+
+		/** Walk a version of the tree for a number, validating its digits on
+		 * the way. Digits beyond the deepest node are still validated, so
+		 * every digit is looked at exactly once. The caller keeps an
+		 * Epoch::Guard while walking.
+		 * @param version_i Version to walk, nullptr if empty.
+		 * @param digit_i Callable returning the digit at a position, or a
+		 * value above 9 if that position holds no valid digit.
+		 * @param len_i Number of digits.
+		 * @param bad_o Set to the position of the first invalid digit, or to
+		 * std::string::npos if all digits are valid.
+		 * @param match_i Callable invoked with the length and destination of
+		 * every matching prefix, shortest first.
+		 * @returns Found destination, or 0 if not found or invalid. */
+		template <class DIGIT, class MATCH>
+		inline uint64_t walk_(const version_t *version_i, DIGIT digit_i, const size_t len_i, size_t & bad_o,
+			MATCH match_i) const
+		{
+			uint64_t *base = local_(version_i), *child, profile, val, dest, found = 0;
+			uint64_t node = version_i ? version_i->root : ROOTNODE;
+			size_t i = 0, level = 0;
+			uint16_t idx;
+			uint8_t d, k, s;
+
+			bad_o = std::string::npos;
+			profile = base ? load_(base) : 0;
+
+			while (base != nullptr && i < len_i) {
+				s = stride_(profile, level);
+
+				// Consume the digits of the stride, picking up prefixes ending inside it
+				idx = 0;
+				for (k = 1; k <= s && i < len_i; k++) {
+					d = digit_i(i++);
+					if (d > 9) {
+						bad_o = i - 1;
+						return 0;
+					}
+					idx = idx * 10 + d;
+					if (k < s) {
+						dest = load_(slot_(base, node, inner_(s, k) + idx));
+						if (dest) match_i(i, found = dest);
+					}
+				}
+				if (k <= s) break;
+
+				child = child_(base, node, idx);
+				if (child == nullptr) break;
+				val = load_(child);
+				if (!ISVALID(val)) break;
+				if (POINTS2LEAF(val)) {
+					dest = load_(slot_(base, val));
+					if (dest) match_i(i, found = dest);
+					level++;
+					break;
+				}
+				node = val;
+				dest = load_(own_(base, node, stride_(profile, ++level)));
+				if (dest) match_i(i, found = dest);
+			}
+			countlookup_(level, found);
+
+			for (; i < len_i; i++) {
+				if (digit_i(i) > 9) {
+					bad_o = i;
+					return 0;
+				}
+			}
+			return found;
+		}
+
+		/** Walk the current version of the tree for a number.
+		 * @param digit_i Callable returning the digit at a position.
+		 * @param len_i Number of digits.
+		 * @param bad_o Set to the position of the first invalid digit.
+		 * @param match_i Callable invoked for every matching prefix.
+		 * @returns Found destination, or 0 if not found or invalid. */
+		template <class DIGIT, class MATCH>
+		inline uint64_t walk_(DIGIT digit_i, const size_t len_i, size_t & bad_o, MATCH match_i) const
+		{
+			Epoch::Guard eg;
+
+			return walk_(current_.load(std::memory_order_acquire), digit_i, len_i, bad_o, match_i);
+		}
 
 		public:
-		/// Constructor
-		DecTree();
+		/** Constructor. Memory is only reserved when the first number is set.
+		 * @param reserve_i Number of bytes of address space to reserve, which
+		 * limits the size of the tree, default ARENARESERVE.
+		 * @param huge_i Huge page policy, default transparent. */
+		DecTree(const uint64_t reserve_i = ARENARESERVE, const Arena::hugepages_t huge_i = Arena::transparent);
 
 		/// Destructor
 		~DecTree();
 
-		/** Clear the entire database. This method will cause segfaults when
-		 * reads are still being executed. */
+		/// Memory use of one level of the tree
+		struct level_t {
+			/// Number of digits consumed by lists at this level
+			uint8_t stride;
+
+			/// Number of lists at this level
+			uint64_t lists;
+
+			/// Number of those lists that are sparse
+			uint64_t sparse;
+
+			/// Number of leaves referred to from the level above
+			uint64_t leaves;
+
+			/// Number of child slots in use in the lists at this level
+			uint64_t children;
+
+			/// Number of bytes used by lists and leaves at this level
+			uint64_t bytes;
+		};
+
+		/// Runtime statistics of a tree
+		struct stats_t {
+			/// Memory use per level of the reachable part of the tree, as levels() returns
+			std::vector<level_t> levels;
+
+			/// Number of bytes of reachable nodes
+			uint64_t live;
+
+			/// Number of bytes handed out from the arena
+			uint64_t allocated;
+
+			/// Number of bytes of the arena backed by memory
+			uint64_t committed;
+
+			/// Number of bytes of unlinked nodes, waiting for or ready for reuse
+			uint64_t free;
+
+			/// Number of bytes handed out but neither reachable nor reusable
+			uint64_t garbage;
+
+			/// Share of the allocated bytes that is not live, 0 when compact
+			double fragmentation;
+
+			/// Number of lookups, 0 if built without DECTREESTATS
+			uint64_t lookups;
+
+			/// Number of lookups that found a destination
+			uint64_t hits;
+
+			/// Number of lookups that found no destination
+			uint64_t misses;
+
+			/// Number of modifications
+			uint64_t updates;
+
+			/// Number of lookups served from the per-thread cache
+			uint64_t cached;
+
+			/// Number of lookups per number of levels descended below the root
+			std::vector<uint64_t> depths;
+		};
+
+		/** Gather statistics about the structure and use of the tree. The
+		 * counters are gathered per thread at almost no cost on the lookup
+		 * path, and can be left out by building with DECTREESTATS set to 0.
+		 * @returns Statistics. */
+		stats_t stats() const;
+
+		/** Copy the arena, e.g. to compile it into a FrozenDecTree. Call
+		 * consolidate() first to leave out unreachable nodes.
+		 * @returns Words of the arena in use, the stride profile first,
+		 * empty if the tree is empty. */
+		std::vector<uint64_t> words() const;
+
+		/** Get the strides of the top levels of the tree.
+		 * @returns Number of digits consumed at each of the top levels,
+		 * starting at the root. Deeper levels consume one digit. */
+		std::vector<uint8_t> strides() const;
+
+		/** Set the strides of the top levels of the tree. Higher strides
+		 * shorten lookup paths, at the expense of memory where the
+		 * numbering plan is not dense. Use levels() to see the trade-off.
+		 * @param strides_i Number of digits to consume at each of the top
+		 * levels, starting at the root, from 1 up to MAXSTRIDE.
+		 * @throws std::invalid_argument if a stride is out of range or more
+		 * than STRIDELEVELS strides are given.
+		 * @throws std::logic_error if the tree is not empty. */
+		void strides(const std::vector<uint8_t> & strides_i);
+
+		/** Get the memory use per level of the reachable part of the tree.
+		 * @returns Statistics per level, starting at the root. */
+		std::vector<level_t> levels() const;
+
+		/** Clear the entire database. Lookups running concurrently will
+		 * either see the old or the empty tree. */
 		void clear();
 
+		/** Rebuild the arena compactly and in a cache friendly order.
+		 * Unreachable nodes, left behind by modifications, are dropped, as
+		 * are subtrees without destinations. The top BFSLEVELS levels are
+		 * laid out breadth-first, so they share as few cache lines and pages
+		 * as possible. Every subtree below them is laid out depth-first, so
+		 * the rest of a lookup path is clustered as well. Lookups continue
+		 * on the old arena until the new one is published.
+		 * @returns Number of bytes in use before and after consolidation.
+		 * @throws std::logic_error if the tree is a read-only image. */
+		std::pair<uint64_t, uint64_t> consolidate();
+
+		/** Save the tree to an image file, which can later be mapped with
+		 * open(). The image is written to a temporary file first, which is
+		 * renamed to @p path_i when complete.
+		 * @param path_i Path of the image file.
+		 * @throws std::runtime_error if the file cannot be written. */
+		void save(const std::string & path_i);
+
+		/** Replace the contents of the tree by an image file written by
+		 * save(). The file is mapped read-only and shared, so lookups are
+		 * served straight from the page cache without parsing anything. The
+		 * tree cannot be modified until it is cleared.
+		 * @param path_i Path of the image file.
+		 * @throws std::runtime_error if the file cannot be read, is not an
+		 * image or has an unsupported version. */
+		void open(const std::string & path_i);
+
+		/** Replace the contents of the tree by a modifiable copy of an image
+		 * file written by save(). Unlike open(), this reads the whole image.
+		 * @param path_i Path of the image file.
+		 * @throws std::runtime_error if the file cannot be read, is not an
+		 * image or has an unsupported version. */
+		void load(const std::string & path_i);
+
+		/** Recover the tree from a snapshot and a journal, and journal all
+		 * modifications from then on. The snapshot is loaded if it exists,
+		 * then the journal is replayed on top of it, so recovery takes time
+		 * in proportion to the changes since the last checkpoint. Bulk
+		 * loads and images opened or loaded later are not journaled, take a
+		 * checkpoint() after them.
+		 * @param snapshot_i Path of the snapshot image.
+		 * @param journal_i Path of the journal file.
+		 * @param batch_i Number of modifications to write and sync to the
+		 * journal at once, 1 to make every modification durable before it
+		 * returns. Up to this many modifications minus one are lost in a
+		 * crash; sync() writes them out earlier.
+		 * @returns Number of journaled modifications replayed.
+		 * @throws std::runtime_error if the snapshot or the journal cannot
+		 * be read. */
+		uint64_t journal(const std::string & snapshot_i, const std::string & journal_i,
+			const uint32_t batch_i = JOURNALBATCH);
+
+		/** Fold the journal into a new snapshot and empty it.
+		 * @throws std::logic_error if the tree is not journaling.
+		 * @throws std::runtime_error if the snapshot cannot be written. */
+		void checkpoint();
+
+		/** Write and sync all journaled modifications that are still
+		 * buffered. Does nothing if the tree is not journaling.
+		 * @throws std::runtime_error if the journal cannot be written. */
+		void sync();
+
+		/** Check whether the tree is a read-only image opened with open().
+		 * @returns True if read-only, false if modifiable. */
+		bool readonly() const;
+
+		/** Enable or disable the per-thread lookup cache. Every thread keeps
+		 * the results of its last lookups of single numbers, up to 16 digits,
+		 * in a small direct-mapped cache shared by all trees. A result is
+		 * only used as long as the tree has not been modified since, so this
+		 * pays off for heavily skewed traffic.
+		 * @param enable_i True to use the cache, false to always walk the
+		 * tree. */
+		inline void cache(const bool enable_i) { cache_.store(enable_i, std::memory_order_relaxed); }
+
+		/** Check whether lookups use the per-thread cache.
+		 * @returns True if enabled. */
+		inline bool cache() const { return cache_.load(std::memory_order_relaxed); }
+
+		/** Let lookups read from replicas of the arena on the memory of the
+		 * NUMA node they run on, instead of from the arena itself, which may
+		 * be on another node. Modifications copy the nodes on their path,
+		 * like a transaction, and only those copies are written into the
+		 * replicas when they are published. Consolidating, bulk loading or
+		 * clearing the tree gives it new replicas with a full copy. Without
+		 * libnuma or NUMA support, replicas use plain memory.
+		 * @param replicas_i Number of replicas, Arena::nodes() for one per
+		 * node, 0 to stop replicating. Threads use the replica of their
+		 * node modulo this number.
+		 * @throws std::logic_error if a transaction is open.
+		 * @throws std::bad_alloc if a replica cannot be allocated. */
+		void replicas(const uint32_t replicas_i);
+
+		/** Get the number of read replicas every version gets.
+		 * @returns Number of replicas, 0 if not replicating. */
+		uint32_t replicas() const;
+
 		/** Lookup a destination for a given number.
+		 * This method never blocks, not even while a modification is being
+		 * made.
 		 * @param number_i Number to lookup.
 		 * @returns Found destination, or 0 if not found.
 		 * @throws std::invalid_argument if @p number_i does not consist of
 		 * only digits in the range 0 through 9. */
-		const uint64_t operator()(const std::string & number_i) const;
+		uint64_t operator()(const std::string & number_i) const;
+
+		/** Lookup a destination for a number in a string view, without any
+		 * heap allocation.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		uint64_t lookup(const std::string_view number_i) const;
+
+		/** Lookup a destination for a number in a raw character buffer,
+		 * without any heap allocation.
+		 * @param number_i Pointer to the first digit.
+		 * @param len_i Number of digits.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if the buffer does not consist of
+		 * only digits in the range 0 through 9. */
+		inline uint64_t lookup(const char *number_i, const size_t len_i) const
+		{
+			return lookup(std::string_view(number_i, len_i));
+		}
+
+		/** Lookup a destination for a packed BCD number, without any heap
+		 * allocation. The first digit is in the most significant nibble.
+		 * The number ends at the first nibble with value 0xF, or after 16
+		 * digits.
+		 * @param bcd_i Packed BCD number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if a nibble before the end holds a
+		 * value in the range 0xA through 0xE. */
+		uint64_t lookupBCD(const uint64_t bcd_i) const;
+
+		/** Lookup a destination for a number given as integer, without any
+		 * heap allocation.
+		 * @param number_i Number to lookup.
+		 * @param digits_i Number of digits, @p number_i is padded with
+		 * leading zeroes up to this length.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i has more digits than
+		 * @p digits_i. */
+		uint64_t lookupInt(const uint64_t number_i, const uint8_t digits_i) const;
+
+		/// Prefix of a number that has a destination
+		struct match_t {
+			/// Number of digits of the prefix
+			size_t digits;
+
+			/// Destination of the prefix
+			uint64_t destination;
+		};
+
+		/** Lookup the destinations of all prefixes of a number in a single
+		 * walk, e.g. to fall back to a less specific destination. Nothing is
+		 * allocated.
+		 * @param number_i Number to lookup.
+		 * @param matches_o Buffer to fill with the matching prefixes,
+		 * shortest first. If it is too small, the longest ones are kept.
+		 * @param capacity_i Number of entries @p matches_o has room for.
+		 * @returns Number of entries filled in.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		size_t lookupAll(const std::string_view number_i, match_t *matches_o, const size_t capacity_i) const;
+
+		/** Lookup the destinations of all prefixes of a number in a single
+		 * walk, into a fixed-size buffer, e.g. on the stack.
+		 * @param number_i Number to lookup.
+		 * @param matches_o Buffer to fill with the matching prefixes,
+		 * shortest first. If it is too small, the longest ones are kept.
+		 * @returns Number of entries filled in.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		template <size_t N>
+		inline size_t lookupAll(const std::string_view number_i, std::array<match_t, N> & matches_o) const
+		{
+			return lookupAll(number_i, matches_o.data(), N);
+		}
+
+		/** Lookup destinations for a batch of numbers.
+		 * Up to BATCHWIDTH numbers are walked in lock-step. The next node of
+		 * every one of them is prefetched before any of them is read, so the
+		 * memory latency of one lookup is hidden behind the work on others.
+		 * @param numbers_i Numbers to lookup.
+		 * @param destinations_o Found destinations, 0 if not found, in the
+		 * same order as @p numbers_i.
+		 * @param count_i Number of numbers to lookup.
+		 * @throws std::invalid_argument if one of the numbers does not
+		 * consist of only digits in the range 0 through 9. Destinations of
+		 * other numbers may or may not have been filled in by then. */
+		void lookup(const std::string *numbers_i, uint64_t *destinations_o, const size_t count_i) const;
+
+		/** Lookup destinations for a batch of numbers.
+		 * @param numbers_i Numbers to lookup.
+		 * @param destinations_o Found destinations, resized to the number
+		 * of numbers to lookup.
+		 * @throws std::invalid_argument if one of the numbers does not
+		 * consist of only digits in the range 0 through 9. */
+		inline void lookup(const std::vector<std::string> & numbers_i, std::vector<uint64_t> & destinations_o) const
+		{
+			destinations_o.resize(numbers_i.size());
+			lookup(numbers_i.data(), destinations_o.data(), numbers_i.size());
+		}
 
 		/** Set a destination for a number (range).
 		 * This method creates decimal trees and allocates memory as
@@ -104,6 +1446,210 @@ namespace SdH {
 		 * @throws std::invalid_argument if @p number_i does not consist of
 		 * only digits in the range 0 through 9. */
 		void operator()(const std::string & number_i, const uint64_t destination_i);
+
+		/** Erase the destination of a number (range). Lists that no longer
+		 * hold anything are pruned and their memory is reused by later
+		 * modifications, once no lookup can be using it anymore. Shorter
+		 * prefixes of the number are not affected.
+		 * @param number_i The number (range) to erase.
+		 * @returns True if the number had a destination.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9.
+		 * @throws std::logic_error if the tree is a read-only image. */
+		bool erase(const std::string & number_i);
+
+		/** Compute the minimal set of prefixes covering a number range.
+		 * @param from_i First number of the range.
+		 * @param to_i Last number of the range, of the same length.
+		 * @returns Prefixes in ascending order, together covering exactly
+		 * the numbers of the given length in the range.
+		 * @throws std::invalid_argument if the numbers are empty, differ in
+		 * length, contain non-digits or @p to_i is lower than @p from_i. */
+		static std::vector<std::string> cover(const std::string & from_i, const std::string & to_i);
+
+		/** Set a destination for a number range, e.g. 3141900000 through
+		 * 3141949999. The minimal set of prefixes covering the range is set
+		 * under a single lock, walking the path they share only once.
+		 * @param from_i First number of the range.
+		 * @param to_i Last number of the range, of the same length.
+		 * @param destination_i The destination to set for the range.
+		 * @returns Number of prefixes set.
+		 * @throws std::invalid_argument if the numbers are empty, differ in
+		 * length, contain non-digits or @p to_i is lower than @p from_i.
+		 * @throws std::logic_error if the tree is a read-only image. */
+		size_t setRange(const std::string & from_i, const std::string & to_i, const uint64_t destination_i);
+
+		/** Open a transaction. Modifications made by this thread until
+		 * commit() are invisible to lookups, which keep seeing the tree as
+		 * it was, and become visible all at once. Modifications by other
+		 * threads, and their transactions, wait until it has ended.
+		 * Clearing, loading, saving and consolidating are refused while a
+		 * transaction of the calling thread is open.
+		 * @throws std::logic_error if the calling thread has a transaction
+		 * open already or the tree is a read-only image. */
+		void begin();
+
+		/** Publish the modifications of the open transaction with a single
+		 * atomic store. Nodes they replaced are reused once no lookup or
+		 * version can be using them anymore.
+		 * @throws std::logic_error if the calling thread has no transaction
+		 * open.
+		 * @throws std::runtime_error if journaling the commit fails, the
+		 * transaction is still open then. */
+		void commit();
+
+		/** Drop the modifications of the open transaction of the calling
+		 * thread, if any. It does not throw: if the rollback cannot be
+		 * journaled, replay drops the transaction for lack of a commit
+		 * record all the same. */
+		void rollback();
+
+		/** Consistent view of the tree, pinning the version that was current
+		 * when it was taken, so a sequence of lookups is not affected by any
+		 * modification made in the meantime. While a version is pinned,
+		 * modifications outside a transaction copy the nodes on their path
+		 * like transactions do, instead of changing them in place. Like a
+		 * lookup, it keeps writers from reusing memory while it exists, so
+		 * release it as soon as possible. It must be released by the thread
+		 * that took it. Lookups through it bypass the per-thread cache. */
+		class Version
+		{
+			/// Only a tree hands out versions
+			friend class DecTree;
+
+			private:
+			/// Copy construction not allowed
+			Version(const Version & obj_i) = delete;
+
+			/// Assignment not allowed
+			Version & operator=(const Version & obj_i) = delete;
+
+			/// Keeps the version and its nodes from being released
+			Epoch::Guard eg_;
+
+			/// Tree the version belongs to
+			const DecTree & tree_;
+
+			/// Pinned version, nullptr if the tree was empty
+			const version_t *version_;
+
+			/** Constructor, pinning the current version of a tree.
+			 * @param tree_i Tree to pin. */
+			Version(const DecTree & tree_i)
+			: tree_(tree_i), version_(tree_i.pin_())
+			{ }
+
+			public:
+			/// Destructor, letting modifications change nodes in place again
+			~Version() { tree_.pinned_.fetch_sub(1, std::memory_order_release); }
+
+			/** Lookup a destination for a number in the pinned version.
+			 * @param number_i Number to lookup.
+			 * @returns Found destination, or 0 if not found.
+			 * @throws std::invalid_argument if @p number_i does not consist
+			 * of only digits in the range 0 through 9. */
+			inline uint64_t lookup(const std::string_view number_i) const { return tree_.find_(version_, number_i); }
+
+			/** Lookup a destination for a number in the pinned version.
+			 * @param number_i Number to lookup.
+			 * @returns Found destination, or 0 if not found.
+			 * @throws std::invalid_argument if @p number_i does not consist
+			 * of only digits in the range 0 through 9. */
+			inline uint64_t operator()(const std::string & number_i) const { return lookup(std::string_view(number_i)); }
+
+			/** Visit every prefix of the pinned version that has a
+			 * destination, in ascending order.
+			 * @param visit_i Callable invoked with every prefix, as a view
+			 * only valid during the call, and its destination.
+			 * @returns Number of prefixes visited. */
+			template <class VISIT>
+			inline size_t forEach(VISIT visit_i) const { return DecTree::each_(version_, std::string_view(), visit_i); }
+
+			/** Visit the prefixes of the pinned version that have a
+			 * destination and start with a given prefix, in ascending order.
+			 * @param prefix_i Prefix, which is visited itself as well.
+			 * @param visit_i Callable invoked with every prefix, as a view
+			 * only valid during the call, and its destination.
+			 * @returns Number of prefixes visited.
+			 * @throws std::invalid_argument if @p prefix_i does not consist
+			 * of only digits in the range 0 through 9. */
+			template <class VISIT>
+			inline size_t forEachUnder(const std::string_view prefix_i, VISIT visit_i) const
+			{
+				return DecTree::each_(version_, prefix_i, visit_i);
+			}
+		};
+
+		/** Pin the current version of the tree.
+		 * @returns Version to do consistent lookups in. */
+		inline Version version() const { return Version(*this); }
+
+		/** Visit every prefix that has a destination, in ascending order,
+		 * e.g. to export the tree. The walk takes no lock and allocates
+		 * nothing per prefix. Modifications made during the walk may or may
+		 * not be visited; use a version() to enumerate a consistent view.
+		 * Like a lookup, it keeps writers from reusing memory until it
+		 * returns.
+		 * @param visit_i Callable invoked with every prefix, as a view only
+		 * valid during the call, and its destination.
+		 * @returns Number of prefixes visited. */
+		template <class VISIT>
+		inline size_t forEach(VISIT visit_i) const
+		{
+			Epoch::Guard eg;
+
+			return each_(current_.load(std::memory_order_acquire), std::string_view(), visit_i);
+		}
+
+		/** Visit the prefixes that have a destination and start with a given
+		 * prefix, in ascending order, walking only the subtree below it.
+		 * @param prefix_i Prefix, which is visited itself as well.
+		 * @param visit_i Callable invoked with every prefix, as a view only
+		 * valid during the call, and its destination.
+		 * @returns Number of prefixes visited.
+		 * @throws std::invalid_argument if @p prefix_i does not consist of
+		 * only digits in the range 0 through 9. */
+		template <class VISIT>
+		inline size_t forEachUnder(const std::string_view prefix_i, VISIT visit_i) const
+		{
+			Epoch::Guard eg;
+
+			return each_(current_.load(std::memory_order_acquire), prefix_i, visit_i);
+		}
+
+		/** Compare the tree with another one. Both trees are walked digit by
+		 * digit in lock-step, so they may have different strides. Subtrees
+		 * with equal hashes are skipped. The hashes of the lists walked are
+		 * kept until a modification changes them, so comparing again after
+		 * a few modifications takes time in proportion to the differences.
+		 * The walk holds the writer locks of both trees, lookups go on.
+		 * @param other_i Tree to compare with.
+		 * @returns Prefixes whose destination differs, in ascending order,
+		 * with their destination in this tree as from and in @p other_i as
+		 * to. Applying them to this tree makes it equal to @p other_i. */
+		std::vector<change_t> diff(const DecTree & other_i) const;
+
+		/** Compare a pinned version with the tree as it is now. While a
+		 * version is pinned, modifications copy the nodes they change, so
+		 * nodes both still share are unchanged and skipped. This takes time
+		 * in proportion to what was changed since.
+		 * @param from_i Version to compare from, pinned by this thread.
+		 * @returns Prefixes whose destination differs, in ascending order,
+		 * with their destination in @p from_i as from and in the tree as to. */
+		std::vector<change_t> diff(const Version & from_i) const;
+
+		/** Apply differences found by diff() under a single writer lock,
+		 * setting every prefix to its to destination and erasing it if that
+		 * is 0. Unless a transaction is open already, the changes are made
+		 * in one that is committed at the end, so lookups see all or none of
+		 * them. Other prefixes are not affected.
+		 * @param delta_i Differences to apply.
+		 * @returns Number of differences applied.
+		 * @throws std::invalid_argument if a prefix is empty or does not
+		 * consist of only digits in the range 0 through 9, before anything
+		 * is applied.
+		 * @throws std::logic_error if the tree is a read-only image. */
+		size_t apply(const std::vector<change_t> & delta_i);
 	};
 
 } // SdH namespace
@@ -0,0 +1,285 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include "DecTreeBuilder.h"
+#include "Logger.h"
+#include "commondefs.h"
+
+namespace SdH {
+
+	DecTreeBuilder::DecTreeBuilder(const size_t threads_i)
+	: threads_(threads_i)
+	{
+		if (threads_ == 0) threads_ = std::thread::hardware_concurrency();
+		if (threads_ == 0) threads_ = 1;
+	}
+
+	void DecTreeBuilder::add(const std::string & prefix_i, const uint64_t destination_i)
+	{
+		size_t pos;
+
+		FCET(prefix_i.size(), std::invalid_argument, "Number to add is empty");
+		pos = prefix_i.find_first_not_of("0123456789");
+		FCET(pos == std::string::npos,
+			std::invalid_argument,
+			"Number \"{}\" to add contains at least one non-digit at position {}",
+			prefix_i, pos
+		);
+
+		if (!entries_.empty()) {
+			FCET(entries_.back().first <= prefix_i, std::invalid_argument,
+				"Number \"{}\" is added after \"{}\", which is out of order", prefix_i, entries_.back().first);
+			if (entries_.back().first == prefix_i) {
+				entries_.back().second = destination_i;
+				return;
+			}
+		}
+		entries_.emplace_back(prefix_i, destination_i);
+	}
+
+	size_t DecTreeBuilder::addCSV(std::istream & in_i)
+	{
+		std::string line;
+		size_t added = 0, lineno = 0, comma, used = 0;
+		uint64_t dest = 0;
+
+		while (std::getline(in_i, line)) {
+			lineno++;
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.empty()) continue;
+
+			comma = line.find(',');
+			FCET(comma != std::string::npos, std::invalid_argument, "Line {} of CSV input has no comma", lineno);
+			try {
+				dest = std::stoull(line.substr(comma + 1), &used);
+			} catch (const std::exception &) {
+				used = 0;
+			}
+			FCET(used > 0 && comma + 1 + used == line.size(), std::invalid_argument,
+				"Line {} of CSV input has no valid destination", lineno);
+
+			add(line.substr(0, comma), dest);
+			added++;
+		}
+		return added;
+	}
+
+	uint64_t DecTreeBuilder::subtree_(region_t & reg_io, const uint64_t profile_i, size_t begin_i, const size_t end_i,
+		const size_t pos_i, const size_t level_i) const
+	{
+		const size_t kidsbase = reg_io.kids.size(), innerbase = reg_io.inner.size();
+		const uint8_t s = DecTree::stride_(profile_i, level_i);
+		uint64_t dest = 0, child, node, *n;
+		size_t next, children, inners;
+		uint16_t idx;
+		uint8_t k, added = 0;
+
+		// The prefix of the subtree root itself sorts first
+		if (entries_[begin_i].first.size() == pos_i) dest = entries_[begin_i++].second;
+
+		// Build the children first, so every list is written once, completely
+		while (begin_i < end_i) {
+			const std::string & p = entries_[begin_i].first;
+
+			idx = 0;
+			for (k = 0; k < s && pos_i + k < p.size(); k++) idx = idx * 10 + (p[pos_i + k] & 0xF);
+			if (k < s) {
+				if (entries_[begin_i].second) reg_io.inner.emplace_back(DecTree::inner_(s, k) + idx, entries_[begin_i].second);
+				begin_i++;
+				continue;
+			}
+
+			for (next = begin_i + 1; next < end_i && entries_[next].first.compare(pos_i, s, p, pos_i, s) == 0; next++);
+			child = subtree_(reg_io, profile_i, begin_i, next, pos_i + s, level_i + 1);
+			if (child) reg_io.kids.emplace_back(idx, child);
+			begin_i = next;
+		}
+		children = reg_io.kids.size() - kidsbase;
+		inners = reg_io.inner.size() - innerbase;
+
+		if (children == 0 && inners == 0) {
+			if (dest == 0) return 0;
+			node = reg_io.slots.size();
+			reg_io.slots.push_back(dest);
+			return (node << 3) | VALIDTAG | LEAFTAG;
+		}
+
+		node = reg_io.slots.size();
+		if (s == 1 && children <= SPARSEMAX) {
+			reg_io.slots.resize(node + DecTree::SPARSEFIRST + children, 0);
+			n = reg_io.slots.data() + node;
+			n[DecTree::SPARSEDEST] = dest;
+			for (size_t c = kidsbase; c < reg_io.kids.size(); c++) {
+				n[0] |= UINT64_C(1) << reg_io.kids[c].first;
+				n[DecTree::SPARSEFIRST + added] = reg_io.kids[c].second;
+				reg_io.relocs.push_back(node + DecTree::SPARSEFIRST + added++);
+			}
+			node = (node << 3) | VALIDTAG | SPARSETAG;
+		} else {
+			reg_io.slots.resize(node + DecTree::slots_(s), 0);
+			n = reg_io.slots.data() + node;
+			n[DecTree::destslot_(s)] = dest;
+			for (size_t c = kidsbase; c < reg_io.kids.size(); c++) {
+				n[reg_io.kids[c].first] = reg_io.kids[c].second;
+				reg_io.relocs.push_back(node + reg_io.kids[c].first);
+			}
+			for (size_t c = innerbase; c < reg_io.inner.size(); c++) n[reg_io.inner[c].first] = reg_io.inner[c].second;
+			node = (node << 3) | VALIDTAG;
+		}
+
+		reg_io.kids.resize(kidsbase);
+		reg_io.inner.resize(innerbase);
+		return node;
+	}
+
+	void DecTreeBuilder::build(DecTree & tree_io) const
+	{
+		/// Subtree below one child slot of the root list
+		struct group_t {
+			/// Value of the digits consumed by the root list
+			uint16_t idx;
+
+			/// First entry of the subtree
+			size_t begin;
+
+			/// Entry beyond the subtree
+			size_t end;
+
+			/// Worker building the subtree
+			size_t worker;
+
+			/// Tagged slot referring to the built subtree, relative to its region
+			uint64_t node;
+		};
+		std::vector<group_t> groups;
+		std::vector<std::pair<uint16_t, uint64_t>> rootinner;
+		std::vector<region_t> regs;
+		std::vector<uint64_t> offsets;
+		std::vector<std::exception_ptr> errors;
+		std::vector<std::thread> workers;
+		uint64_t profile, total = 0, *base = nullptr;
+		size_t b = 0, next, workersize, todo;
+		uint16_t idx;
+		uint8_t s, k;
+		DecTree::alloc_t old;
+
+		{
+			GRD(tree_io.mux_);
+			profile = tree_io.profile_;
+		}
+		s = DecTree::stride_(profile, 0);
+
+		// Partition the entries by the digits the root list consumes
+		while (b < entries_.size()) {
+			const std::string & p = entries_[b].first;
+
+			idx = 0;
+			for (k = 0; k < s && k < p.size(); k++) idx = idx * 10 + (p[k] & 0xF);
+			if (k < s) {
+				if (entries_[b].second) rootinner.emplace_back(DecTree::inner_(s, k) + idx, entries_[b].second);
+				b++;
+				continue;
+			}
+			for (next = b + 1; next < entries_.size() && entries_[next].first.compare(0, s, p, 0, s) == 0; next++);
+			groups.push_back({ idx, b, next, 0, 0 });
+			b = next;
+		}
+
+		// Spread consecutive groups over the workers by number of entries
+		regs.resize(std::max<size_t>(1, std::min(threads_, groups.size())));
+		workersize = (entries_.size() + regs.size() - 1) / regs.size();
+		todo = 0;
+		for (auto & g : groups) {
+			g.worker = std::min(todo / std::max<size_t>(workersize, 1), regs.size() - 1);
+			todo += g.end - g.begin;
+		}
+
+		errors.resize(regs.size());
+		for (size_t w = 0; w < regs.size(); w++) {
+			workers.emplace_back([&, w]() {
+				try {
+					for (auto & g : groups) {
+						if (g.worker == w) g.node = subtree_(regs[w], profile, g.begin, g.end, s, 1);
+					}
+				} catch (...) {
+					errors[w] = std::current_exception();
+				}
+			});
+		}
+		for (auto & t : workers) t.join();
+		workers.clear();
+		for (auto & e : errors) if (e) std::rethrow_exception(e);
+
+		std::unique_lock<std::mutex> lck = tree_io.writer_();
+		FCET(!tree_io.txn_, std::logic_error, "Unable to build into a tree while a transaction is open");
+		base = tree_io.newarena_(profile, old);
+		try {
+			// Place the regions after each other, behind the root list
+			for (auto & r : regs) total += r.slots.size() * sizeof(uint64_t);
+			offsets.push_back(total ? tree_io.extra_(total) : 0);
+			for (size_t w = 1; w < regs.size(); w++) offsets.push_back(offsets[w - 1] + regs[w - 1].slots.size() * sizeof(uint64_t));
+
+			// Copy and relocate all regions in parallel
+			for (size_t w = 0; w < regs.size(); w++) {
+				workers.emplace_back([&, w]() {
+					uint64_t *to = base + (offsets[w] >> 3);
+
+					memcpy(to, regs[w].slots.data(), regs[w].slots.size() * sizeof(uint64_t));
+					for (const uint64_t r : regs[w].relocs) to[r] += offsets[w];
+				});
+			}
+			for (auto & t : workers) t.join();
+
+			for (const auto & g : groups) {
+				if (g.node) base[(ROOTNODE >> 3) + g.idx] = g.node + offsets[g.worker];
+			}
+			for (const auto & i : rootinner) base[(ROOTNODE >> 3) + i.first] = i.second;
+
+			// Publish the complete tree, lookups still on the old arena finish there
+			tree_io.publish_(base, ROOTNODE);
+		} catch (...) {
+			for (auto & t : workers) if (t.joinable()) t.join();
+
+			// The tree keeps its contents and the nodes waiting for reuse in them
+			tree_io.restore_(old);
+			throw;
+		}
+		tree_io.touch_();
+		if (old.arena != nullptr) tree_io.retire_(old.arena, Arena::destroy);
+		tree_io.reclaim_();
+	}
+
+} // SdH namespace
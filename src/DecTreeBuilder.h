@@ -0,0 +1,142 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "DecTree.h"
+
+namespace SdH {
+
+	/** Parallel bulk builder for decimal trees.
+	 * Entries are added in ascending order of their prefix. When building,
+	 * the entries are partitioned by the digits consumed by the root list
+	 * across worker threads. Each worker builds its subtrees bottom-up in a
+	 * region of its own, so every node is written once, completely, with
+	 * its exact number of children. The regions are then copied into one
+	 * arena in parallel, relocating the offsets they contain, and the
+	 * result replaces the contents of a tree in one go. The nodes are laid
+	 * out depth-first, children before their list, not breadth-first like
+	 * consolidate() does. As a partition is never split, at most 10^s
+	 * workers have work for a root stride of s, 10 for a stride of 1. */
+	class DecTreeBuilder
+	{
+		private:
+		/// Copy construction not allowed
+		DecTreeBuilder(const DecTreeBuilder & obj_i) = delete;
+
+		/// Assignment construction not allowed
+		DecTreeBuilder & operator=(const DecTreeBuilder & obj_i) = delete;
+
+		protected:
+		/// Region of the arena built by one worker
+		struct region_t {
+			/// Nodes, with offsets relative to the start of the region
+			std::vector<uint64_t> slots;
+
+			/// Slots holding offsets, to relocate when copying
+			std::vector<uint64_t> relocs;
+
+			/// Children of lists being built, shared by all levels
+			std::vector<std::pair<uint16_t, uint64_t>> kids;
+
+			/// Destinations of prefixes ending inside strides, shared by all levels
+			std::vector<std::pair<uint16_t, uint64_t>> inner;
+		};
+
+		/// Entries to build from, in ascending order
+		std::vector<std::pair<std::string, uint64_t>> entries_;
+
+		/// Number of worker threads
+		size_t threads_;
+
+		/** Build a subtree of entries bottom-up.
+		 * @param reg_io Region to build in.
+		 * @param profile_i Stride profile of the tree.
+		 * @param begin_i First entry of the subtree.
+		 * @param end_i Entry beyond the subtree.
+		 * @param pos_i Number of digits all entries share as prefix.
+		 * @param level_i Level of the subtree root.
+		 * @returns Tagged slot referring to the subtree root, relative to the
+		 * start of the region, 0 if it holds no destinations. */
+		uint64_t subtree_(region_t & reg_io, const uint64_t profile_i, size_t begin_i, const size_t end_i,
+			const size_t pos_i, const size_t level_i) const;
+
+		public:
+		/** Constructor.
+		 * @param threads_i Number of worker threads, default 0 to use one
+		 * per hardware thread. No more are started than there are
+		 * partitions of the root list, see DecTreeBuilder. */
+		DecTreeBuilder(const size_t threads_i = 0);
+
+		/** Add an entry. Entries must be added in ascending order of their
+		 * prefix. Adding a prefix equal to the previous one replaces its
+		 * destination.
+		 * @param prefix_i Number (range) to set.
+		 * @param destination_i Destination to set.
+		 * @throws std::invalid_argument if @p prefix_i is empty, contains
+		 * non-digits or is lower than the previous prefix. */
+		void add(const std::string & prefix_i, const uint64_t destination_i);
+
+		/** Add entries from a CSV stream, one "prefix,destination" per line.
+		 * Empty lines are skipped.
+		 * @param in_i Stream to read from.
+		 * @returns Number of entries added.
+		 * @throws std::invalid_argument if a line cannot be parsed or its
+		 * prefix is out of order. */
+		size_t addCSV(std::istream & in_i);
+
+		/** Get the number of entries added so far.
+		 * @returns Number of entries. */
+		inline size_t size() const { return entries_.size(); }
+
+		/** Build a tree from all entries added so far, replacing its
+		 * contents. Lookups on the tree continue on the old contents until
+		 * the new ones are complete. The stride profile of the tree is used,
+		 * its root stride limits the number of workers. Call consolidate()
+		 * afterwards for the breadth-first layout of the top levels.
+		 * @param tree_io Tree to fill.
+		 * @throws std::bad_alloc if the arena of the tree cannot hold the new
+		 * contents, the tree then keeps its old ones.
+		 * @throws std::logic_error if the calling thread has a transaction
+		 * open on the tree, one of another thread is waited for. */
+		void build(DecTree & tree_io) const;
+
+		/// Remove all entries
+		inline void clear() { entries_.clear(); }
+	};
+
+} // SdH namespace
@@ -0,0 +1,106 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include "Epoch.h"
+
+namespace SdH {
+
+	std::atomic<uint64_t> Epoch::global_a(1);
+	std::atomic<Epoch::record_t *> Epoch::head_a(nullptr);
+	thread_local Epoch::holder_t Epoch::mine_a = { nullptr };
+
+	Epoch::holder_t::~holder_t()
+	{
+		if (rec != nullptr) {
+			rec->epoch.store(0, std::memory_order_release);
+			rec->nesting = 0;
+			rec->inuse.store(false, std::memory_order_release);
+			rec = nullptr;
+		}
+	}
+
+	Epoch::record_t *Epoch::claim_()
+	{
+		record_t *rec;
+		bool expected;
+
+		// Reuse a record of a thread that has exited
+		for (rec = head_a.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+			expected = false;
+			if (!rec->inuse.load(std::memory_order_relaxed) &&
+				rec->inuse.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+				return rec;
+			}
+		}
+
+		rec = new record_t;
+		rec->epoch.store(0, std::memory_order_relaxed);
+		rec->inuse.store(true, std::memory_order_relaxed);
+		rec->nesting = 0;
+		rec->next = head_a.load(std::memory_order_relaxed);
+		while (!head_a.compare_exchange_weak(rec->next, rec, std::memory_order_release, std::memory_order_relaxed));
+		return rec;
+	}
+
+	Epoch::Guard::Guard()
+	{
+		if (mine_a.rec == nullptr) mine_a.rec = claim_();
+		rec_ = mine_a.rec;
+
+		if (rec_->nesting++ == 0) {
+			rec_->epoch.store(global_a.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+			// Make the announcement visible before any shared data is read
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+
+	Epoch::Guard::~Guard()
+	{
+		if (--rec_->nesting == 0) {
+			rec_->epoch.store(0, std::memory_order_release);
+		}
+	}
+
+	uint64_t Epoch::safe()
+	{
+		uint64_t oldest, e;
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		oldest = global_a.load(std::memory_order_seq_cst);
+		for (record_t *rec = head_a.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+			e = rec->epoch.load(std::memory_order_seq_cst);
+			if (e != 0 && e < oldest) oldest = e;
+		}
+		return oldest;
+	}
+
+} // SdH namespace
@@ -0,0 +1,122 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace SdH {
+
+	/** Process wide epoch based reclamation domain.
+	 * Readers enter a critical section by creating a Guard, which announces
+	 * the global epoch they observed. Writers unlink memory, then call
+	 * advance() to get the epoch the memory is retired in. Retired memory
+	 * may be released as soon as safe() has moved past that epoch, because
+	 * then no reader can still hold a reference to it. Readers never wait
+	 * and never take a lock. */
+	class Epoch
+	{
+		private:
+		/// Per thread reader announcement, padded to avoid false sharing
+		struct alignas(64) record_t {
+			/// Epoch announced by the reader, 0 when outside a critical section
+			std::atomic<uint64_t> epoch;
+
+			/// True while claimed by a live thread
+			std::atomic<bool> inuse;
+
+			/// Critical section nesting depth, only touched by the owner
+			uint32_t nesting;
+
+			/// Next record in the global list, never changes once linked
+			record_t *next;
+		};
+
+		/// Releases the record of a thread when that thread exits
+		struct holder_t {
+			record_t *rec;
+			~holder_t();
+		};
+
+		/// Global epoch, starts at 1 so 0 can mean "not reading"
+		static std::atomic<uint64_t> global_a;
+
+		/// Head of the list of reader records, records are never freed
+		static std::atomic<record_t *> head_a;
+
+		/// Record of the current thread
+		static thread_local holder_t mine_a;
+
+		/** Claim an unused record or link a new one.
+		 * @returns Record for exclusive use by the calling thread. */
+		static record_t *claim_();
+
+		public:
+		/** RAII reader critical section. While a Guard exists in a thread, no
+		 * memory retired after its construction will be released. Guards may
+		 * be nested. */
+		class Guard
+		{
+			private:
+			/// Record of the thread that created this guard
+			record_t *rec_;
+
+			/// Copy construction not allowed
+			Guard(const Guard & obj_i) = delete;
+
+			/// Assignment not allowed
+			Guard & operator=(const Guard & obj_i) = delete;
+
+			public:
+			/// Enter a critical section
+			Guard();
+
+			/// Leave the critical section
+			~Guard();
+		};
+
+		/** Advance the global epoch. Call this after unlinking memory from a
+		 * shared structure.
+		 * @returns The epoch to retire the unlinked memory in. */
+		static inline uint64_t advance()
+		{
+			return global_a.fetch_add(1, std::memory_order_seq_cst);
+		}
+
+		/** Determine the oldest epoch any reader might still be in.
+		 * @returns Memory retired in an epoch lower than this value can be
+		 * released. */
+		static uint64_t safe();
+	};
+
+} // SdH namespace
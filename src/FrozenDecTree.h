@@ -0,0 +1,288 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "DecTree.h"
+#include "Logger.h"
+
+namespace SdH {
+
+	/** Read-only decimal tree compiled into the binary. The arena of a
+	 * DecTree is emitted as a constant array by dectreegen, so it lives in
+	 * .rodata, is shared between processes and needs no loading at all.
+	 * Lookups walk the same layout as DecTree, but with plain reads and
+	 * without epochs, and can be evaluated at compile time. Where the
+	 * number is not known at compile time, the compiler can still fold
+	 * the slots of the top levels into constants.
+	 * @tparam ARENA Words of the arena, as returned by DecTree::words().
+	 * @tparam WORDS Number of words of the arena. */
+	template <const uint64_t *ARENA, size_t WORDS>
+	class FrozenDecTree
+	{
+		protected:
+		/** Get the child slot of a list.
+		 * @param node_i Tagged slot referring to the list.
+		 * @param idx_i Value of the digits the list consumes.
+		 * @returns Child slot value, 0 if there is none. */
+		static constexpr uint64_t child_(const uint64_t node_i, const uint16_t idx_i)
+		{
+			uint64_t bm = 0;
+
+			if (!ISSPARSE(node_i)) return ARENA[(NODEOFFSET(node_i) >> 3) + idx_i];
+			bm = ARENA[NODEOFFSET(node_i) >> 3];
+			if (!((bm >> idx_i) & 1)) return 0;
+			return ARENA[(NODEOFFSET(node_i) >> 3) + DecTree::SPARSEFIRST + __builtin_popcountll(bm & ((UINT64_C(1) << idx_i) - 1))];
+		}
+
+		/** Get the destination of a list itself.
+		 * @param node_i Tagged slot referring to the list.
+		 * @param stride_i Stride of the list.
+		 * @returns Destination, 0 if none. */
+		static constexpr uint64_t own_(const uint64_t node_i, const uint8_t stride_i)
+		{
+			return ARENA[(NODEOFFSET(node_i) >> 3) + (ISSPARSE(node_i) ? DecTree::SPARSEDEST : DecTree::destslot_(stride_i))];
+		}
+
+		/** Walk the tree along a number, like DecTree does.
+		 * @param digit_i Callable returning the digit at a position, or a
+		 * value above 9 if that position holds no valid digit.
+		 * @param len_i Number of digits.
+		 * @param bad_o Set to the position of the first invalid digit, or to
+		 * std::string::npos if all digits are valid.
+		 * @param match_i Callable invoked with the length and destination of
+		 * every matching prefix, shortest first.
+		 * @returns Found destination, or 0 if not found or invalid. */
+		template <class DIGIT, class MATCH>
+		static constexpr uint64_t walk_(DIGIT digit_i, const size_t len_i, size_t & bad_o, MATCH match_i)
+		{
+			// Constant evaluation requires every variable to be initialized
+			uint64_t profile = WORDS ? ARENA[0] : 0, val = 0, node = ROOTNODE, dest = 0, found = 0;
+			size_t i = 0, level = 0;
+			uint16_t idx = 0;
+			uint8_t d = 0, k = 0, s = 0;
+
+			bad_o = std::string::npos;
+			while (WORDS > (ROOTNODE >> 3) && i < len_i) {
+				s = DecTree::stride_(profile, level);
+
+				// Consume the digits of the stride, picking up prefixes ending inside it
+				idx = 0;
+				for (k = 1; k <= s && i < len_i; k++) {
+					d = digit_i(i++);
+					if (d > 9) {
+						bad_o = i - 1;
+						return 0;
+					}
+					idx = idx * 10 + d;
+					if (k < s) {
+						dest = ARENA[(NODEOFFSET(node) >> 3) + DecTree::inner_(s, k) + idx];
+						if (dest) match_i(i, found = dest);
+					}
+				}
+				if (k <= s) break;
+
+				val = child_(node, idx);
+				if (!ISVALID(val)) break;
+				if (POINTS2LEAF(val)) {
+					dest = ARENA[NODEOFFSET(val) >> 3];
+					if (dest) match_i(i, found = dest);
+					break;
+				}
+				node = val;
+				dest = own_(node, DecTree::stride_(profile, ++level));
+				if (dest) match_i(i, found = dest);
+			}
+
+			for (; i < len_i; i++) {
+				if (digit_i(i) > 9) {
+					bad_o = i;
+					return 0;
+				}
+			}
+			return found;
+		}
+
+		/** Report a number with an invalid digit.
+		 * @param number_i Number looked up.
+		 * @param bad_i Position of the first invalid digit.
+		 * @throws std::invalid_argument always. */
+		[[noreturn]] static void invalid_(const std::string_view number_i, const size_t bad_i)
+		{
+			FET(std::invalid_argument,
+				"Number \"{}\" to lookup contains at least one non-digit at position {}",
+				number_i, bad_i
+			);
+		}
+
+		public:
+		/** Lookup a destination for a number in a string view.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		static constexpr uint64_t lookup(const std::string_view number_i)
+		{
+			uint64_t found = 0;
+			size_t bad = 0;
+
+			found = walk_([number_i](const size_t i) -> uint8_t {
+				return static_cast<uint8_t>(number_i[i] - '0');
+			}, number_i.size(), bad, [](size_t, uint64_t) { });
+			if (bad != std::string::npos) invalid_(number_i, bad);
+			return found;
+		}
+
+		/** Lookup a destination for a given number.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		inline uint64_t operator()(const std::string & number_i) const
+		{
+			return lookup(std::string_view(number_i));
+		}
+
+		/** Lookup a destination for a number in a raw character buffer.
+		 * @param number_i Pointer to the first digit.
+		 * @param len_i Number of digits.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if the buffer does not consist of
+		 * only digits in the range 0 through 9. */
+		static constexpr uint64_t lookup(const char *number_i, const size_t len_i)
+		{
+			return lookup(std::string_view(number_i, len_i));
+		}
+
+		/** Lookup a destination for a packed BCD number. The first digit is
+		 * in the most significant nibble. The number ends at the first
+		 * nibble with value 0xF, or after 16 digits.
+		 * @param bcd_i Packed BCD number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if a nibble before the end holds a
+		 * value in the range 0xA through 0xE. */
+		static constexpr uint64_t lookupBCD(const uint64_t bcd_i)
+		{
+			uint64_t found = 0;
+			size_t bad = 0;
+			uint8_t len = 0;
+
+			while (len < 16 && ((bcd_i >> (60 - 4 * len)) & 0xF) != 0xF) len++;
+
+			found = walk_([bcd_i](const size_t i) -> uint8_t {
+				return (bcd_i >> (60 - 4 * i)) & 0xF;
+			}, len, bad, [](size_t, uint64_t) { });
+			if (bad != std::string::npos) {
+				FET(std::invalid_argument,
+					"Packed BCD number {:016X} to lookup contains an invalid nibble at position {}",
+					bcd_i, bad
+				);
+			}
+			return found;
+		}
+
+		/** Lookup a destination for a number given as integer.
+		 * @param number_i Number to lookup.
+		 * @param digits_i Number of digits, @p number_i is padded with
+		 * leading zeroes up to this length.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i has more digits than
+		 * @p digits_i. */
+		static constexpr uint64_t lookupInt(const uint64_t number_i, const uint8_t digits_i)
+		{
+			uint8_t digits[20] = {};
+			uint64_t rest = number_i;
+			size_t bad = 0;
+
+			if (digits_i > sizeof(digits)) FET(std::invalid_argument, "Unable to lookup a number of {} digits", digits_i);
+			for (uint8_t i = digits_i; i > 0; i--) {
+				digits[i - 1] = rest % 10;
+				rest /= 10;
+			}
+			if (rest != 0) FET(std::invalid_argument, "Number {} to lookup has more than {} digits", number_i, digits_i);
+
+			return walk_([&digits](const size_t i) -> uint8_t {
+				return digits[i];
+			}, digits_i, bad, [](size_t, uint64_t) { });
+		}
+
+		/** Lookup all prefixes of a number that have a destination.
+		 * @param number_i Number to lookup.
+		 * @param matches_o Buffer to store matches in, shortest prefix first.
+		 * @param capacity_i Number of matches the buffer can hold. If there
+		 * are more, the longest ones are kept.
+		 * @returns Number of matches stored.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		static constexpr size_t lookupAll(const std::string_view number_i, DecTree::match_t *matches_o,
+			const size_t capacity_i)
+		{
+			size_t filled = 0, bad = 0;
+
+			walk_([number_i](const size_t i) -> uint8_t {
+				return static_cast<uint8_t>(number_i[i] - '0');
+			}, number_i.size(), bad, [&](const size_t digits_i, const uint64_t destination_i) {
+				if (capacity_i == 0) return;
+				// Make room by dropping the least specific match
+				if (filled == capacity_i) {
+					for (size_t m = 1; m < filled; m++) matches_o[m - 1] = matches_o[m];
+					filled--;
+				}
+				matches_o[filled++] = { digits_i, destination_i };
+			});
+			if (bad != std::string::npos) invalid_(number_i, bad);
+			return filled;
+		}
+
+		/** Lookup all prefixes of a number that have a destination.
+		 * @param number_i Number to lookup.
+		 * @param matches_o Array to store matches in, shortest prefix first.
+		 * @returns Number of matches stored.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		template <size_t N>
+		static constexpr size_t lookupAll(const std::string_view number_i, std::array<DecTree::match_t, N> & matches_o)
+		{
+			return lookupAll(number_i, matches_o.data(), N);
+		}
+
+		/** Get the size of the compiled arena.
+		 * @returns Number of bytes. */
+		static constexpr size_t bytes() { return WORDS * sizeof(uint64_t); }
+	};
+
+} // SdH namespace
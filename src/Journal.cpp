@@ -0,0 +1,325 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "DecTree.h"
+#include "Journal.h"
+#include "Logger.h"
+
+namespace SdH {
+
+	/// Magic bytes at the start of a journal file, followed by a byte order marker
+	static const char journalmagic[8] = { 'S', 'd', 'H', 'J', 'o', 'u', 'r', 'n' };
+
+	/// Size of the header of a journal file
+	static constexpr uint64_t journalheader = sizeof(journalmagic) + sizeof(uint64_t);
+
+	/** Compute the FNV-1a checksum of a record.
+	 * @param data_i First byte of the record.
+	 * @param bytes_i Number of bytes.
+	 * @returns Checksum. */
+	static uint32_t checksum(const uint8_t *data_i, const size_t bytes_i)
+	{
+		uint32_t h = UINT32_C(2166136261);
+
+		for (size_t i = 0; i < bytes_i; i++) h = (h ^ data_i[i]) * UINT32_C(16777619);
+		return h;
+	}
+
+	Journal::Journal(const std::string & path_i, const uint32_t batch_i)
+	: path_(path_i), fd_(-1), end_(0), pending_(0), batch_(batch_i ? batch_i : 1)
+	{
+		uint8_t hdr[journalheader];
+		uint64_t byteorder = UINT64_C(0x0102030405060708);
+		struct stat st;
+
+		fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		FCET(fd_ >= 0, std::runtime_error, "Unable to open journal file {}: {}", path_, strerror(errno));
+
+		if (fstat(fd_, &st) == 0 && st.st_size == 0) {
+			memcpy(hdr, journalmagic, sizeof(journalmagic));
+			memcpy(hdr + sizeof(journalmagic), &byteorder, sizeof(byteorder));
+			try {
+				write_(hdr, sizeof(hdr), 0);
+				if (fdatasync(fd_) != 0) FET(std::runtime_error, "Unable to sync journal file {}: {}", path_, strerror(errno));
+			} catch (...) {
+				::close(fd_);
+				throw;
+			}
+		} else if (pread(fd_, hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+			memcmp(hdr, journalmagic, sizeof(journalmagic)) != 0 ||
+			memcmp(hdr + sizeof(journalmagic), &byteorder, sizeof(byteorder)) != 0) {
+			::close(fd_);
+			FET(std::runtime_error, "File {} is not a decimal tree journal", path_);
+		}
+
+		// New records follow whatever the file holds, replay() cuts off a torn record first
+		end_ = journalheader;
+		if (fstat(fd_, &st) == 0) end_ = st.st_size;
+	}
+
+	Journal::~Journal()
+	{
+		try {
+			flush();
+		} catch (...) {
+			// Nothing sensible to do with an error while destructing
+		}
+		::close(fd_);
+	}
+
+	void Journal::write_(const uint8_t *data_i, const size_t bytes_i, const uint64_t offset_i)
+	{
+		size_t done = 0;
+		ssize_t rv;
+
+		while (done < bytes_i) {
+			rv = pwrite(fd_, data_i + done, bytes_i - done, offset_i + done);
+			if (rv < 0 && errno == EINTR) continue;
+			FCET(rv > 0, std::runtime_error, "Unable to write journal file {}: {}", path_, strerror(errno));
+			done += rv;
+		}
+	}
+
+	void Journal::flush()
+	{
+		if (buf_.empty()) return;
+
+		// A failed write is overwritten by the next attempt, as end_ only moves on success
+		write_(buf_.data(), buf_.size(), end_);
+		FCET(fdatasync(fd_) == 0, std::runtime_error, "Unable to sync journal file {}: {}", path_, strerror(errno));
+		end_ += buf_.size();
+		buf_.clear();
+		pending_ = 0;
+	}
+
+	void Journal::truncate()
+	{
+		buf_.clear();
+		pending_ = 0;
+		FCET(ftruncate(fd_, journalheader) == 0 && fdatasync(fd_) == 0,
+			std::runtime_error, "Unable to truncate journal file {}: {}", path_, strerror(errno));
+		end_ = journalheader;
+	}
+
+	size_t Journal::begin_(const op_t op_i, const size_t digits_i)
+	{
+		size_t start = buf_.size();
+
+		FCET(digits_i <= UINT8_MAX, std::invalid_argument,
+			"Unable to journal a number of {} digits, at most {} are supported", digits_i, UINT8_MAX);
+		buf_.push_back(op_i);
+		buf_.push_back(static_cast<uint8_t>(digits_i));
+		return start;
+	}
+
+	void Journal::digits_(const std::string & number_i)
+	{
+		for (size_t i = 0; i < number_i.size(); i += 2) {
+			buf_.push_back(((number_i[i] & 0xF) << 4) | (i + 1 < number_i.size() ? number_i[i + 1] & 0xF : 0xF));
+		}
+	}
+
+	void Journal::destination_(const uint64_t destination_i)
+	{
+		const uint8_t *d = reinterpret_cast<const uint8_t *>(&destination_i);
+
+		buf_.insert(buf_.end(), d, d + sizeof(destination_i));
+	}
+
+	void Journal::commit_(const size_t start_i, const bool keep_i)
+	{
+		uint32_t sum = checksum(buf_.data() + start_i, buf_.size() - start_i);
+		const uint8_t *s = reinterpret_cast<const uint8_t *>(&sum);
+
+		buf_.insert(buf_.end(), s, s + sizeof(sum));
+		if (++pending_ < batch_ && buf_.size() < JOURNALBUFFER) return;
+
+		try {
+			flush();
+		} catch (...) {
+			if (!keep_i) {
+				buf_.resize(start_i);
+				pending_--;
+			}
+			throw;
+		}
+	}
+
+	void Journal::check(const std::string & number_i)
+	{
+		FCET(number_i.size() <= UINT8_MAX, std::invalid_argument,
+			"Unable to journal a number of {} digits, at most {} are supported", number_i.size(), UINT8_MAX);
+	}
+
+	void Journal::set(const std::string & number_i, const uint64_t destination_i)
+	{
+		size_t start = begin_(opset, number_i.size());
+
+		destination_(destination_i);
+		digits_(number_i);
+		commit_(start);
+	}
+
+	void Journal::erase(const std::string & number_i)
+	{
+		size_t start = begin_(operase, number_i.size());
+
+		digits_(number_i);
+		commit_(start);
+	}
+
+	void Journal::range(const std::string & from_i, const std::string & to_i, const uint64_t destination_i)
+	{
+		size_t start = begin_(oprange, from_i.size());
+
+		destination_(destination_i);
+		digits_(from_i);
+		digits_(to_i);
+		commit_(start);
+	}
+
+	void Journal::clear()
+	{
+		commit_(begin_(opclear, 0));
+	}
+
+	void Journal::begin()
+	{
+		commit_(begin_(opbegin, 0));
+	}
+
+	void Journal::commit()
+	{
+		commit_(begin_(opcommit, 0), false);
+	}
+
+	void Journal::rollback()
+	{
+		commit_(begin_(oprollback, 0));
+	}
+
+	uint64_t Journal::replay(DecTree & tree_io)
+	{
+		std::vector<uint8_t> data;
+		std::string numbers[2];
+		uint64_t records = 0, dest, pos = journalheader, txnpos = 0, txnrecords = 0;
+		uint32_t sum;
+		size_t len, bcd, need;
+		struct stat st;
+		ssize_t rv;
+		uint8_t op;
+		bool txn = false;
+
+		flush();
+		FCET(fstat(fd_, &st) == 0, std::runtime_error, "Unable to stat journal file {}: {}", path_, strerror(errno));
+		data.resize(st.st_size);
+		for (size_t done = 0; done < data.size(); ) {
+			rv = pread(fd_, data.data() + done, data.size() - done, done);
+			if (rv < 0 && errno == EINTR) continue;
+			FCET(rv > 0, std::runtime_error, "Unable to read journal file {}: {}", path_, strerror(errno));
+			done += rv;
+		}
+
+		while (pos + 2 <= data.size()) {
+			op = data[pos];
+			len = data[pos + 1];
+			bcd = (len + 1) / 2;
+			switch (op) {
+				case opset: need = 2 + sizeof(dest) + bcd; break;
+				case operase: need = 2 + bcd; break;
+				case oprange: need = 2 + sizeof(dest) + 2 * bcd; break;
+				case opclear:
+				case opbegin:
+				case opcommit:
+				case oprollback: need = 2; break;
+				default: need = 0; break;
+			}
+			if (need == 0 || pos + need + sizeof(sum) > data.size()) break;
+			memcpy(&sum, data.data() + pos + need, sizeof(sum));
+			if (sum != checksum(data.data() + pos, need)) break;
+
+			// Unpack the number(s) following the destination
+			dest = 0;
+			if (op == opset || op == oprange) memcpy(&dest, data.data() + pos + 2, sizeof(dest));
+			for (uint8_t n = 0; n < (op == oprange ? 2 : 1); n++) {
+				const uint8_t *p = data.data() + pos + need - (op == oprange && n == 0 ? 2 : 1) * bcd;
+
+				numbers[n].resize(len);
+				for (size_t i = 0; i < len; i++) numbers[n][i] = '0' + ((p[i / 2] >> (i % 2 ? 0 : 4)) & 0xF);
+			}
+
+			switch (op) {
+				case opset: tree_io(numbers[0], dest); break;
+				case operase: tree_io.erase(numbers[0]); break;
+				case oprange: tree_io.setRange(numbers[0], numbers[1], dest); break;
+				case opclear: tree_io.clear(); break;
+				case opbegin:
+					tree_io.begin();
+					txn = true;
+					txnpos = pos;
+					txnrecords = records;
+					break;
+				case opcommit:
+				case oprollback:
+					if (!txn) break;
+					if (op == opcommit) tree_io.commit();
+					else tree_io.rollback();
+					txn = false;
+					break;
+			}
+			records++;
+			pos += need + sizeof(sum);
+		}
+
+		// A transaction without a commit record is dropped as a whole
+		if (txn) {
+			tree_io.rollback();
+			pos = txnpos;
+			records = txnrecords;
+		}
+
+		// Cut off a torn record, so new records follow the complete ones
+		if (pos < data.size()) {
+			FCET(ftruncate(fd_, pos) == 0 && fdatasync(fd_) == 0,
+				std::runtime_error, "Unable to truncate journal file {}: {}", path_, strerror(errno));
+		}
+		end_ = pos;
+		return records;
+	}
+
+} // SdH namespace
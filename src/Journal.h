@@ -0,0 +1,202 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Default number of records a journal writes and syncs at once
+#define JOURNALBATCH   64
+
+/// Number of bytes of buffered records that trigger a write regardless of the batch size
+#define JOURNALBUFFER  (UINT64_C(64) << 10)
+
+namespace SdH {
+
+	class DecTree;
+
+	/** Append-only journal of modifications of a decimal tree.
+	 * Records are gathered in a buffer and written with a single write and
+	 * fdatasync once a batch is complete, so the cost of the system calls
+	 * is shared by all records of the batch. A record holds the operation,
+	 * the number of digits, the destination if any, the digits as packed
+	 * BCD and a checksum, so a record torn by a crash is recognized and
+	 * dropped when replaying. The tree journals a modification once it
+	 * has been made, so a modification that fails is never replayed. If
+	 * it fails halfway, the part that was made is journaled instead, like
+	 * the prefixes of a range set before the failure. Every operation
+	 * assigns to prefixes, so replaying records that are already part of
+	 * a snapshot gives the same result. Records of a transaction are only
+	 * replayed together with its commit record, so a crash halfway
+	 * through a transaction drops all of it. Not thread safe, the tree
+	 * serializes its use. */
+	class Journal
+	{
+		private:
+		/// Copy construction not allowed
+		Journal(const Journal & obj_i) = delete;
+
+		/// Assignment construction not allowed
+		Journal & operator=(const Journal & obj_i) = delete;
+
+		protected:
+		/// Operation of a record
+		enum op_t : uint8_t {
+			/// Set the destination of a number
+			opset = 1,
+			/// Erase the destination of a number
+			operase,
+			/// Set the destination of a number range
+			oprange,
+			/// Clear the whole tree
+			opclear,
+			/// Open a transaction
+			opbegin,
+			/// Commit the open transaction
+			opcommit,
+			/// Drop the open transaction
+			oprollback
+		};
+
+		/// Path of the journal file
+		std::string path_;
+
+		/// File descriptor of the journal file
+		int fd_;
+
+		/// Number of bytes of complete records in the file
+		uint64_t end_;
+
+		/// Records not written yet
+		std::vector<uint8_t> buf_;
+
+		/// Number of records in buf_
+		uint32_t pending_;
+
+		/// Number of records to write and sync at once
+		uint32_t batch_;
+
+		/** Start a record in the buffer.
+		 * @param op_i Operation.
+		 * @param digits_i Number of digits of the number(s).
+		 * @returns Offset of the record in the buffer. */
+		size_t begin_(const op_t op_i, const size_t digits_i);
+
+		/** Append a number as packed BCD to the record being built.
+		 * @param number_i Number to append. */
+		void digits_(const std::string & number_i);
+
+		/** Append a destination to the record being built.
+		 * @param destination_i Destination to append. */
+		void destination_(const uint64_t destination_i);
+
+		/** Complete the record being built with its checksum, writing the
+		 * batch if it is complete.
+		 * @param start_i Offset of the record in the buffer.
+		 * @param keep_i True to keep the record buffered if writing fails,
+		 * as the modification it describes has been made already. False to
+		 * drop it again, so the caller can refrain from the modification. */
+		void commit_(const size_t start_i, const bool keep_i = true);
+
+		/** Write all bytes of a buffer at an offset of the file.
+		 * @param data_i Bytes to write.
+		 * @param bytes_i Number of bytes.
+		 * @param offset_i Offset in the file. */
+		void write_(const uint8_t *data_i, const size_t bytes_i, const uint64_t offset_i);
+
+		public:
+		/** Constructor, opens or creates the journal file. Existing records
+		 * are kept, call replay() to apply them.
+		 * @param path_i Path of the journal file.
+		 * @param batch_i Number of records to write and sync at once, 1 to
+		 * make every modification durable before it returns.
+		 * @throws std::runtime_error if the file cannot be opened or is not
+		 * a journal. */
+		Journal(const std::string & path_i, const uint32_t batch_i = JOURNALBATCH);
+
+		/// Destructor, writes and syncs the remaining records
+		~Journal();
+
+		/** Apply all complete records in the file to a tree. A torn record
+		 * at the end, left behind by a crash, is cut off.
+		 * @param tree_io Tree to apply the records to.
+		 * @returns Number of records applied. */
+		uint64_t replay(DecTree & tree_io);
+
+		/** Check that a number can be journaled, before the modification
+		 * that is journaled afterwards is made.
+		 * @param number_i Number to check.
+		 * @throws std::invalid_argument if the number has too many digits. */
+		static void check(const std::string & number_i);
+
+		/** Record setting a destination for a number.
+		 * @param number_i Number, validated by the caller.
+		 * @param destination_i Destination. */
+		void set(const std::string & number_i, const uint64_t destination_i);
+
+		/** Record erasing the destination of a number.
+		 * @param number_i Number, validated by the caller. */
+		void erase(const std::string & number_i);
+
+		/** Record setting a destination for a number range.
+		 * @param from_i First number of the range, validated by the caller.
+		 * @param to_i Last number of the range, of the same length.
+		 * @param destination_i Destination. */
+		void range(const std::string & from_i, const std::string & to_i, const uint64_t destination_i);
+
+		/// Record clearing the whole tree
+		void clear();
+
+		/// Record opening a transaction
+		void begin();
+
+		/** Record committing the open transaction. Replaying only applies
+		 * the records of a transaction once its commit record is found.
+		 * @throws std::runtime_error if writing the batch fails, the commit
+		 * is not recorded then. */
+		void commit();
+
+		/// Record dropping the open transaction
+		void rollback();
+
+		/** Write and sync all buffered records.
+		 * @throws std::runtime_error if writing or syncing fails. */
+		void flush();
+
+		/** Drop all records, once they are part of a snapshot.
+		 * @throws std::runtime_error if the file cannot be truncated. */
+		void truncate();
+	};
+
+} // SdH namespace
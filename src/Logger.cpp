@@ -25,6 +25,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 vim:set ts=4 sw=4 noexpandtab: */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <cstdarg>
 #include <mutex>
@@ -36,14 +38,29 @@ vim:set ts=4 sw=4 noexpandtab: */
 #include <fmt/chrono.h>
 #include <fmt/format.h>
 #include <fmt/printf.h>
+#if FMT_VERSION >= 90000
+#include <fmt/std.h>
+#endif
 #include <sys/time.h>
 #include "Logger.h"
 
+namespace {
+
+	/// Source of unique numbers for Logger instances
+	std::atomic<uint64_t> generations(0);
+
+}
+
 namespace Fs2a {
 
+	std::atomic<Logger::loglevel_t> Logger::maxlevel_a(Logger::debug);
+
 	Logger::Logger()
-		: maxlevel_(Logger::debug), stream_(nullptr), strip_(0), syslog_(false)
+		: stream_(nullptr), strip_(0), syslog_(false),
+		  ringsize_(LOGRINGSIZE), generation_(++generations), async_(false), dropped_(0),
+		  reported_(0), stop_(false)
 	{
+		maxlevel_a.store(debug, std::memory_order_relaxed);
 		levels_[error]   = "ERROR";
 		levels_[warning] = "WARNING";
 		levels_[notice]  = "NOTICE";
@@ -53,6 +70,15 @@ namespace Fs2a {
 
 	Logger::~Logger()
 	{
+		if (async_.exchange(false)) {
+			{
+				GRD(wakemux_);
+				stop_ = true;
+			}
+			wake_.notify_one();
+			writer_.join();
+		}
+
 		GRD(mymux_);
 
 		if (syslog_) {
@@ -71,7 +97,14 @@ namespace Fs2a {
 		struct timeval tv;      // Time value storage
 		std::string le;         // Log Entry containing final result
 
-		if (priority_i > maxlevel_) return std::unique_ptr<std::string>();
+		if (!enabled(priority_i)) return std::unique_ptr<std::string>();
+
+		// The writer thread adds the time stamp, thread id and level
+		if (async_.load(std::memory_order_acquire)) {
+			queue_(file_i.c_str(), line_i, priority_i, msg_i.data(), msg_i.size());
+			return std::unique_ptr<std::string>(new std::string(fmt::format("{}:{} {}",
+				file_i.substr(strip_ < file_i.size() ? strip_ : file_i.size()), line_i, msg_i)));
+		}
 
 		gettimeofday(&tv, nullptr);
 
@@ -103,6 +136,197 @@ namespace Fs2a {
 		return std::unique_ptr<std::string>(new std::string(le));
 	}
 
+	void Logger::put(const char *file_i, const size_t line_i, const loglevel_t priority_i, const char *msg_i)
+	{
+		if (!enabled(priority_i)) return;
+
+		if (async_.load(std::memory_order_acquire)) queue_(file_i, line_i, priority_i, msg_i, strlen(msg_i));
+		else log(file_i, line_i, priority_i, msg_i);
+	}
+
+	void Logger::queue_(const char *file_i, const size_t line_i, const loglevel_t priority_i,
+		const char *msg_i, const size_t len_i)
+	{
+		entry_t *e = reserve_(priority_i);
+
+		if (e == nullptr) return;
+		where_(*e, file_i, line_i);
+		e->len = e->split + std::min(len_i, sizeof(e->text) - e->split);
+		memcpy(e->text + e->split, msg_i, e->len - e->split);
+		post_();
+	}
+
+	Logger::ring_t *Logger::ring_()
+	{
+		struct holder_t {
+			/// Ring buffer, shared with the Logger so it outlives either
+			std::shared_ptr<ring_t> ring;
+
+			/// Generation of the Logger the ring belongs to
+			uint64_t generation = 0;
+
+			/// Hand the ring over to a future thread on exit
+			~holder_t()
+			{
+				if (ring) ring->owned.store(false, std::memory_order_release);
+			}
+		};
+		static thread_local holder_t holder;
+
+		if (holder.ring && holder.generation == generation_) return holder.ring.get();
+
+		if (holder.ring) holder.ring->owned.store(false, std::memory_order_release);
+		holder.ring.reset();
+
+		GRD(ringmux_);
+
+		for (auto & r : rings_) {
+			bool owned = false;
+
+			if (r->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+				holder.ring = r;
+				break;
+			}
+		}
+
+		if (!holder.ring) {
+			holder.ring = std::make_shared<ring_t>();
+			holder.ring->head = 0;
+			holder.ring->tail = 0;
+			holder.ring->owned = true;
+			holder.ring->entries.resize(ringsize_);
+			rings_.push_back(holder.ring);
+		}
+
+		holder.generation = generation_;
+		return holder.ring.get();
+	}
+
+	Logger::entry_t *Logger::reserve_(const loglevel_t priority_i)
+	{
+		ring_t *r = ring_();
+		uint64_t h = r->head.load(std::memory_order_relaxed);
+		entry_t *e;
+
+		if (h - r->tail.load(std::memory_order_acquire) >= r->entries.size()) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		e = &r->entries[h & (r->entries.size() - 1)];
+		clock_gettime(CLOCK_REALTIME, &e->ts);
+		e->tid = std::this_thread::get_id();
+		e->priority = priority_i;
+		return e;
+	}
+
+	void Logger::post_()
+	{
+		ring_t *r = ring_();
+
+		r->head.store(r->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	void Logger::drain_()
+	{
+		std::vector<std::pair<ring_t *, uint64_t>> heads;
+		std::vector<const entry_t *> batch;
+		fmt::memory_buffer buf;
+		uint64_t dropped;
+
+		GRD(mymux_);
+
+		{
+			GRD(ringmux_);
+
+			for (auto & r : rings_) {
+				uint64_t h = r->head.load(std::memory_order_acquire);
+				uint64_t mask = r->entries.size() - 1;
+
+				for (uint64_t i = r->tail.load(std::memory_order_relaxed); i < h; i++) {
+					batch.push_back(&r->entries[i & mask]);
+				}
+				heads.emplace_back(r.get(), h);
+			}
+		}
+
+		std::stable_sort(batch.begin(), batch.end(), [](const entry_t *a_i, const entry_t *b_i) {
+			if (a_i->ts.tv_sec != b_i->ts.tv_sec) return a_i->ts.tv_sec < b_i->ts.tv_sec;
+			return a_i->ts.tv_nsec < b_i->ts.tv_nsec;
+		});
+
+		for (const entry_t *e : batch) {
+			buf.clear();
+			fmt::format_to(std::back_inserter(buf), "{:%T}.{:06d} [{}] {}",
+				fmt::localtime(e->ts.tv_sec),
+				e->ts.tv_nsec / 1000,
+				e->tid,
+				fmt::string_view(e->text, e->split)
+			);
+			if (!syslog_) fmt::format_to(std::back_inserter(buf), "{} ", levels_[e->priority]);
+			buf.append(e->text + e->split, e->text + e->len);
+
+			if (syslog_) {
+				buf.push_back('\0');
+				::syslog(e->priority, "%s", buf.data());
+			} else if (stream_ != nullptr) {
+				buf.push_back('\n');
+				stream_->write(buf.data(), buf.size());
+			}
+		}
+
+		// Tell about entries which did not fit
+		dropped = dropped_.load(std::memory_order_relaxed);
+		if (dropped != reported_) {
+			std::string msg = fmt::format("Dropped {} log entries because the ring buffer was full", dropped - reported_);
+
+			reported_ = dropped;
+			if (syslog_) ::syslog(warning, "%s", msg.c_str());
+			else if (stream_ != nullptr) *stream_ << levels_[warning] << " " << msg << '\n';
+		}
+
+		if (!syslog_ && stream_ != nullptr) stream_->flush();
+
+		for (auto & h : heads) h.first->tail.store(h.second, std::memory_order_release);
+	}
+
+	void Logger::async(const size_t entries_i)
+	{
+		size_t size = 1;
+
+		GRD(mymux_);
+
+		if (async_.load(std::memory_order_relaxed)) return;
+
+		while (size < entries_i) size <<= 1;
+		{
+			GRD(ringmux_);
+			ringsize_ = size;
+		}
+
+		stop_ = false;
+		writer_ = std::thread([this]() {
+			bool stop = false;
+
+			while (!stop) {
+				{
+					std::unique_lock<std::mutex> lck(wakemux_);
+
+					wake_.wait_for(lck, std::chrono::milliseconds(LOGINTERVAL), [this]() { return stop_; });
+					stop = stop_;
+				}
+				drain_();
+			}
+		});
+
+		async_.store(true, std::memory_order_release);
+	}
+
+	void Logger::flush()
+	{
+		if (async_.load(std::memory_order_acquire)) drain_();
+	}
+
 	void Logger::stream(std::ostream * stream_i, const size_t strip_i)
 	{
 		if (stream_i == nullptr) {
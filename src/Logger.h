@@ -28,52 +28,79 @@ vim:set ts=4 sw=4 noexpandtab: */
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 #include <syslog.h>
+#include <time.h>
 #include <fmt/format.h>
 #include "commondefs.h"
 #include "Singleton.h"
 
+/** Most verbose syslog priority level compiled in. Logging macros of less
+ * important levels are removed at compile time, e.g. define LOGMAXLEVEL as
+ * LOG_NOTICE to drop all debug and info logging from hot paths. */
+#ifndef LOGMAXLEVEL
+#define LOGMAXLEVEL LOG_DEBUG
+#endif
+
+/** Check whether a level is logged, at compile time against LOGMAXLEVEL
+ * and otherwise with a single relaxed load, before formatting anything.
+ * @param level Level without namespace, e.g. info. */
+#define LOGENABLED(level) (Fs2a::Logger::level <= LOGMAXLEVEL && Fs2a::Logger::enabled(Fs2a::Logger::level))
+
 /** @{ Logging macros for easy logging using old-school *printf %
- * replacements. */
+ * replacements. The message is formatted on the calling thread, the
+ * variants that do not throw then queue it without allocating in
+ * asynchronous mode. */
 
 #ifndef NDEBUG
 /// Log a Debug message
 #define LD(fmtstr, ...) \
 { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	if (LOGENABLED(debug)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	} \
 }
 
 /// Log a Conditional Debug message
 #define LCD(cond, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	if (LOGENABLED(debug)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	} \
 }
 
 /// Log a Conditional Debug message and do Action if condition does not hold
 #define LCDA(cond, action, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	if (LOGENABLED(debug)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	} \
 	action; \
 }
 
 /// Log a Conditional Debug message and Return if condition does not hold
 #define LCDR(cond, ret, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	if (LOGENABLED(debug)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::debug, logbuf); \
+	} \
 	return ret; \
 }
 
@@ -88,59 +115,73 @@ if (!(cond)) { \
 /// Log an Informational message
 #define LI(fmtstr, ...) \
 { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	if (LOGENABLED(info)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	} \
 }
 
 /// Log a Conditional Informational message
 #define LCI(cond, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	if (LOGENABLED(info)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	} \
 }
 
 /// Log a Conditional Informational message and do Action if condition does not hold
 #define LCIA(cond, action, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	if (LOGENABLED(info)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	} \
 	action; \
 }
 
 /// Log a Conditional Informational message and Return if condition does not hold
 #define LCIR(cond, ret, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	if (LOGENABLED(info)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::info, logbuf); \
+	} \
 	return ret; \
 }
 
 /// Log a Notice message
 #define LN(fmtstr, ...) \
 { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::notice, logbuf); \
+	if (LOGENABLED(notice)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::notice, logbuf); \
+	} \
 }
 
 /// Log a Conditional Notice message
 #define LCN(cond, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::notice, logbuf); \
+	if (LOGENABLED(notice)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::notice, logbuf); \
+	} \
 }
 
 /// Log a Conditional Notice message and do Action if condition does not hold
 #define LCNA(cond, action, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::notice, logbuf); \
+	if (LOGENABLED(notice)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::notice, logbuf); \
+	} \
 	action; \
 }
 
@@ -151,34 +192,42 @@ if (!(cond)) { \
 /// Log a Warning message
 #define LW(fmtstr, ...) \
 { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	if (LOGENABLED(warning)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	} \
 }
 
 /// Log a Conditional Warning message
 #define LCW(cond, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	if (LOGENABLED(warning)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	} \
 }
 
 /// Log a Conditional Warning message and do Action if condition does not hold
 #define LCWA(cond, action, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	if (LOGENABLED(warning)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	} \
 	action; \
 }
 
 /// Log a Conditional Warning message and Return if condition does not hold
 #define LCWR(cond, ret, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	if (LOGENABLED(warning)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::warning, logbuf); \
+	} \
 	return ret; \
 }
 
@@ -195,34 +244,42 @@ if (!(cond)) { \
 /// Log an Error message
 #define LE(fmtstr, ...) \
 { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	if (LOGENABLED(error)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	} \
 }
 
 /// Log a Conditional Error message
 #define LCE(cond, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	if (LOGENABLED(error)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	} \
 }
 
 /// Log a Conditional Error message and do Action if condition does not hold
 #define LCEA(cond, action, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	if (LOGENABLED(error)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	} \
 	action; \
 }
 
 /// Log a Conditional Error message and Return if condition does not hold
 #define LCER(cond, ret, fmtstr, ...) \
 if (!(cond)) { \
-	char logbuf[BUFSIZ]; \
-	snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	if (LOGENABLED(error)) { \
+		char logbuf[BUFSIZ]; \
+		snprintf(logbuf, BUFSIZ, fmtstr, ##__VA_ARGS__); \
+		Fs2a::Logger::instance()->put(__FILE__, __LINE__, Fs2a::Logger::error, logbuf); \
+	} \
 	return ret; \
 }
 
@@ -237,44 +294,47 @@ if (!(cond)) { \
 }
 /** @} */
 
-/** @{ Easy logging macros that use libFmt formatting. */
+/** @{ Easy logging macros that use libFmt formatting. The message is
+ * formatted on the calling thread, the variants that do not throw format
+ * it straight into a queued entry in asynchronous mode, without
+ * allocating. */
 #ifndef NDEBUG
-#define FD(str, ...) Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::debug, fmt::format(str, ##__VA_ARGS__))
+#define FD(str, ...) (LOGENABLED(debug) ? Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::debug, str, ##__VA_ARGS__) : void())
 #else
 #define FD(str, ...) {}
 #endif
 
-#define FI(str, ...) Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, fmt::format(str, ##__VA_ARGS__))
-#define FCI(cond, str, ...) if (!(cond)) { Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, fmt::format(str, ##__VA_ARGS__)); }
+#define FI(str, ...) (LOGENABLED(info) ? Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::info, str, ##__VA_ARGS__) : void())
+#define FCI(cond, str, ...) if (!(cond)) { if (LOGENABLED(info)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::info, str, ##__VA_ARGS__); }
 #define FCIA(cond, action, str, ...) if (!(cond)) { \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::info, fmt::format(str, ##__VA_ARGS__)); \
+	if (LOGENABLED(info)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::info, str, ##__VA_ARGS__); \
 	action; \
 }
 
-#define FN(str, ...) Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::notice, fmt::format(str, ##__VA_ARGS__))
-#define FCN(cond, str, ...) if (!(cond)) { Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::notice, fmt::format(str, ##__VA_ARGS__)); }
+#define FN(str, ...) (LOGENABLED(notice) ? Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::notice, str, ##__VA_ARGS__) : void())
+#define FCN(cond, str, ...) if (!(cond)) { if (LOGENABLED(notice)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::notice, str, ##__VA_ARGS__); }
 #define FCNA(cond, action, str, ...) if (!(cond)) { \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::notice, fmt::format(str, ##__VA_ARGS__)); \
+	if (LOGENABLED(notice)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::notice, str, ##__VA_ARGS__); \
 	action; \
 }
 
-#define FW(str, ...) Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, fmt::format(str, ##__VA_ARGS__))
-#define FCW(cond, str, ...) if (!(cond)) { Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, fmt::format(str, ##__VA_ARGS__)); }
+#define FW(str, ...) (LOGENABLED(warning) ? Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::warning, str, ##__VA_ARGS__) : void())
+#define FCW(cond, str, ...) if (!(cond)) { if (LOGENABLED(warning)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::warning, str, ##__VA_ARGS__); }
 #define FCWA(cond, action, str, ...) if (!(cond)) { \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::warning, fmt::format(str, ##__VA_ARGS__)); \
+	if (LOGENABLED(warning)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::warning, str, ##__VA_ARGS__); \
 	action; \
 }
 
-#define FE(str, ...) Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, fmt::format(str, ##__VA_ARGS__))
+#define FE(str, ...) (LOGENABLED(error) ? Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::error, str, ##__VA_ARGS__) : void())
 #define FET(exc, str, ...) \
 	throw exc(Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, fmt::format(str, ##__VA_ARGS__))->c_str())
-#define FCE(cond, str, ...) if (!(cond)) { Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, fmt::format(str, ##__VA_ARGS__)); }
+#define FCE(cond, str, ...) if (!(cond)) { if (LOGENABLED(error)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::error, str, ##__VA_ARGS__); }
 #define FCEA(cond, action, str, ...) if (!(cond)) { \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, fmt::format(str, ##__VA_ARGS__)); \
+	if (LOGENABLED(error)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::error, str, ##__VA_ARGS__); \
 	action; \
 }
 #define FCER(cond, ret, str, ...) if (!(cond)) { \
-	Fs2a::Logger::instance()->log(__FILE__, __LINE__, Fs2a::Logger::error, fmt::format(str, ##__VA_ARGS__)); \
+	if (LOGENABLED(error)) Fs2a::Logger::instance()->logf(__FILE__, __LINE__, Fs2a::Logger::error, str, ##__VA_ARGS__); \
 	return ret; \
 }
 #define FCET(cond, exc, str, ...) if (!(cond)) { \
@@ -284,6 +344,15 @@ if (!(cond)) { \
 
 /** @} */
 
+/// Default number of entries of the ring buffer of a thread in asynchronous mode
+#define LOGRINGSIZE 1024
+
+/// Size of an entry of a ring buffer, longer messages are truncated
+#define LOGENTRYSIZE 512
+
+/// Number of milliseconds the writer thread of asynchronous mode waits between batches
+#define LOGINTERVAL 10
+
 class LoggerCheck;
 
 namespace Fs2a {
@@ -327,8 +396,8 @@ namespace Fs2a {
 			/// Textual syslog levels map.
 			std::map<loglevel_t, std::string> levels_;
 
-			/// Maximum log level to log.
-			std::atomic<loglevel_t> maxlevel_;
+			/// Maximum log level to log, static to check it without instance().
+			static std::atomic<loglevel_t> maxlevel_a;
 
 			/// Internal mutex to be MT safe
 			std::mutex mymux_;
@@ -342,6 +411,115 @@ namespace Fs2a {
 			/// True when logging to syslog, false when logging to stderr
 			bool syslog_;
 
+			/// Log entry queued for the writer thread
+			struct entry_t {
+				/// Moment of logging
+				struct timespec ts;
+
+				/// Thread that logged
+				std::thread::id tid;
+
+				/// Syslog priority level
+				loglevel_t priority;
+
+				/// Length of the file and line part of text
+				uint16_t split;
+
+				/// Number of characters in text
+				uint16_t len;
+
+				/// File and line, followed by the message, not terminated
+				char text[LOGENTRYSIZE - sizeof(struct timespec) - sizeof(std::thread::id) - 8];
+			};
+
+			/// Ring buffer of entries, filled by one thread and drained by the writer thread
+			struct ring_t {
+				/// Number of entries ever queued, only written by the owning thread
+				alignas(64) std::atomic<uint64_t> head;
+
+				/// Number of entries ever drained, only written by the writer thread
+				alignas(64) std::atomic<uint64_t> tail;
+
+				/// True while a thread owns the ring
+				std::atomic<bool> owned;
+
+				/// Entries, a power of two of them
+				std::vector<entry_t> entries;
+			};
+
+			/// Ring buffers of all threads that logged in asynchronous mode
+			std::vector<std::shared_ptr<ring_t>> rings_;
+
+			/// Mutex protecting rings_
+			std::mutex ringmux_;
+
+			/// Number of entries of new rings
+			size_t ringsize_;
+
+			/// Unique number of this instance, to tell rings of a previous instance apart
+			uint64_t generation_;
+
+			/// True in asynchronous mode
+			std::atomic<bool> async_;
+
+			/// Number of entries dropped because a ring was full
+			std::atomic<uint64_t> dropped_;
+
+			/// Number of dropped entries reported in the log so far
+			uint64_t reported_;
+
+			/// Background thread writing queued entries
+			std::thread writer_;
+
+			/// Mutex for waking up the writer thread
+			std::mutex wakemux_;
+
+			/// Condition to wake up the writer thread
+			std::condition_variable wake_;
+
+			/// True to stop the writer thread
+			bool stop_;
+
+			/** Get the ring buffer of the calling thread, claiming one first
+			 * if it does not have one yet.
+			 * @returns Ring buffer. */
+			ring_t *ring_();
+
+			/** Claim the next entry of the ring buffer of the calling thread.
+			 * @param priority_i Syslog priority level.
+			 * @returns Entry to fill and pass to post_(), or nullptr if the
+			 * ring is full and the entry is dropped. */
+			entry_t *reserve_(const loglevel_t priority_i);
+
+			/** Hand a filled entry over to the writer thread. */
+			void post_();
+
+			/** Write all queued entries, oldest first, in one batch. */
+			void drain_();
+
+			/** Queue a message for the writer thread, without allocating.
+			 * Messages longer than an entry are truncated.
+			 * @param file_i Filename we are logging from
+			 * @param line_i Line number at which we are logging
+			 * @param priority_i Syslog priority level
+			 * @param msg_i Formatted message, need not be terminated
+			 * @param len_i Number of characters of @p msg_i */
+			void queue_(const char *file_i, const size_t line_i, const loglevel_t priority_i,
+				const char *msg_i, const size_t len_i);
+
+			/** Format the file and line of an entry into it.
+			 * @param entry_io Entry to fill.
+			 * @param file_i Filename we are logging from
+			 * @param line_i Line number at which we are logging */
+			inline void where_(entry_t & entry_io, const char *file_i, const size_t line_i) const
+			{
+				size_t flen = strlen(file_i);
+
+				file_i += strip_ < flen ? strip_ : flen;
+				entry_io.split = fmt::format_to_n(entry_io.text, sizeof(entry_io.text), "{}:{} ", file_i, line_i).size;
+				if (entry_io.split > sizeof(entry_io.text)) entry_io.split = sizeof(entry_io.text);
+			}
+
 		public:
 
 			/** Check whether the current logging destination is syslog.
@@ -352,14 +530,18 @@ namespace Fs2a {
 				return syslog_;
 			}
 
-			/** Log a formatted message based on the given parameters.
-			 * Please use the convenience logging macros instead of this
-			 * method.
+			/** Log a formatted message based on the given parameters and
+			 * return it, for the logging macros that throw it. In
+			 * asynchronous mode the message is queued, and the returned
+			 * string lacks the time stamp, thread id and level that the
+			 * writer thread adds. Please use the convenience logging macros
+			 * instead of this method.
 			 * @param file_i Filename we are logging from
 			 * @param line_i Line number at which we are logging
 			 * @param priority_i Syslog priority level
 			 * @param msg_i Formatted message
-			 * @returns Unique pointer to logged string. */
+			 * @returns Unique pointer to logged string, empty if the level
+			 * is not logged. */
 			std::unique_ptr<std::string> log(
 				const std::string & file_i,
 				const size_t & line_i,
@@ -367,18 +549,93 @@ namespace Fs2a {
 				const std::string & msg_i
 			);
 
+			/** Log a formatted message without returning it. In asynchronous
+			 * mode it is copied into a queued entry, without taking the time
+			 * or allocating. Please use the convenience logging macros
+			 * instead of this method.
+			 * @param file_i Filename we are logging from
+			 * @param line_i Line number at which we are logging
+			 * @param priority_i Syslog priority level
+			 * @param msg_i Formatted message */
+			void put(const char *file_i, const size_t line_i, const loglevel_t priority_i, const char *msg_i);
+
+			/** Format and log a message. The caller formats it, in
+			 * asynchronous mode straight into a queued entry without
+			 * allocating, and the writer thread adds the time stamp, thread
+			 * id and level. Please use the convenience logging macros
+			 * instead of this method.
+			 * @param file_i Filename we are logging from
+			 * @param line_i Line number at which we are logging
+			 * @param priority_i Syslog priority level
+			 * @param fmt_i Format string
+			 * @param args_i Arguments of the format string */
+			template <typename... T>
+			inline void logf(
+				const char *file_i,
+				const size_t line_i,
+				const loglevel_t priority_i,
+				fmt::format_string<T...> fmt_i,
+				T &&... args_i
+			)
+			{
+				entry_t *e;
+				size_t len;
+
+				if (!enabled(priority_i)) return;
+
+				if (!async_.load(std::memory_order_acquire)) {
+					log(file_i, line_i, priority_i, fmt::format(fmt_i, std::forward<T>(args_i)...));
+					return;
+				}
+
+				e = reserve_(priority_i);
+				if (e == nullptr) return;
+				where_(*e, file_i, line_i);
+				len = fmt::format_to_n(e->text + e->split, sizeof(e->text) - e->split, fmt_i, std::forward<T>(args_i)...).size;
+				e->len = e->split + (len < sizeof(e->text) - e->split ? len : sizeof(e->text) - e->split);
+				post_();
+			}
+
+			/** Switch to asynchronous logging. Every thread queues its
+			 * entries in a lock-free ring buffer of its own, which a
+			 * background thread drains and writes in batches. Entries that
+			 * do not fit in a full ring are dropped and counted. Flush before
+			 * destroying the stream logged to.
+			 * @param entries_i Number of entries of a ring, rounded up to a
+			 * power of two. */
+			void async(const size_t entries_i = LOGRINGSIZE);
+
+			/** Write all entries queued so far. Does nothing in synchronous
+			 * mode. */
+			void flush();
+
+			/** Get the number of entries dropped because a ring was full.
+			 * @returns Number of dropped entries. */
+			inline uint64_t dropped() const
+			{
+				return dropped_.load(std::memory_order_relaxed);
+			}
+
+			/** Check whether a level is logged, without locking or formatting.
+			 * @param priority_i Syslog priority level.
+			 * @returns True if entries of @p priority_i are logged. */
+			static inline bool enabled(const loglevel_t priority_i)
+			{
+				return priority_i <= maxlevel_a.load(std::memory_order_relaxed);
+			}
+
 			/** Return the maximum log level which is logged.
 			 * @returns Maximum log level. */
 			inline loglevel_t maxlevel() const
 			{
-				return maxlevel_;
+				return maxlevel_a.load(std::memory_order_relaxed);
 			}
 
 			/** Set the maximum log level to log.
 			 * @param level_i New maximum log level. */
 			inline void maxlevel(const loglevel_t level_i)
 			{
-				maxlevel_ = level_i;
+				maxlevel_a.store(level_i, std::memory_order_relaxed);
 			}
 
 			/** Write all subsequent logs to stderr.
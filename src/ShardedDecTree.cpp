@@ -0,0 +1,157 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <stdexcept>
+#include "Logger.h"
+#include "ShardedDecTree.h"
+#include "commondefs.h"
+
+namespace SdH {
+
+	ShardedDecTree::ShardedDecTree(const uint8_t depth_i, const uint64_t reserve_i, const Arena::hugepages_t huge_i)
+	: depth_(depth_i)
+	{
+		FCET(depth_ >= 1 && depth_ <= SHARDDEPTH, std::invalid_argument,
+			"Shard depth {} is not in the range 1 through {}", depth_, SHARDDEPTH);
+
+		for (uint16_t i = 0; i < POW10[depth_]; i++) shards_.emplace_back(new DecTree(reserve_i, huge_i));
+		short_.resize(shortslot_(depth_), 0);
+		exact_.resize(POW10[depth_], 0);
+		fallback_.resize(POW10[depth_], 0);
+	}
+
+	void ShardedDecTree::validate_(const std::string & number_i, const char *what_i)
+	{
+		size_t pos;
+
+		FCET(number_i.size(), std::invalid_argument, "Number to {} is empty", what_i);
+		pos = number_i.find_first_not_of("0123456789");
+		FCET(pos == std::string::npos,
+			std::invalid_argument,
+			"Number \"{}\" to {} contains at least one non-digit at position {}",
+			number_i, what_i, pos
+		);
+	}
+
+	uint64_t ShardedDecTree::lookup(const std::string_view number_i) const
+	{
+		uint64_t dest, found = 0;
+		uint16_t idx;
+		size_t pos;
+
+		if (number_i.size() < depth_) {
+			pos = number_i.find_first_not_of("0123456789");
+			FCET(pos == std::string::npos,
+				std::invalid_argument,
+				"Number \"{}\" to lookup contains at least one non-digit at position {}",
+				number_i, pos
+			);
+			for (size_t l = 1; l <= number_i.size(); l++) {
+				dest = __atomic_load_n(&short_[shortslot_(l) + value_(number_i, l)], __ATOMIC_ACQUIRE);
+				if (dest) found = dest;
+			}
+			return found;
+		}
+
+		for (size_t i = 0; i < depth_; i++) {
+			FCET(number_i[i] >= '0' && number_i[i] <= '9',
+				std::invalid_argument,
+				"Number \"{}\" to lookup contains at least one non-digit at position {}",
+				number_i, i
+			);
+		}
+		idx = value_(number_i, depth_);
+		found = shards_[idx]->lookup(number_i.substr(depth_));
+		return found ? found : __atomic_load_n(&fallback_[idx], __ATOMIC_ACQUIRE);
+	}
+
+	uint64_t ShardedDecTree::setshort_(const std::string & number_i, const uint64_t destination_i)
+	{
+		const size_t len = number_i.size();
+		const uint16_t val = value_(number_i, len);
+		const uint16_t first = val * POW10[depth_ - len];
+		uint64_t *slot = len < depth_ ? &short_[shortslot_(len) + val] : &exact_[val];
+		uint64_t old = *slot, dest;
+
+		__atomic_store_n(slot, destination_i, __ATOMIC_RELEASE);
+
+		// Recompute the fallback of every shard below the prefix
+		for (uint16_t idx = first; idx < first + POW10[depth_ - len]; idx++) {
+			dest = exact_[idx];
+			for (size_t l = depth_ - 1; dest == 0 && l >= 1; l--) dest = short_[shortslot_(l) + idx / POW10[depth_ - l]];
+			__atomic_store_n(&fallback_[idx], dest, __ATOMIC_RELEASE);
+		}
+		return old;
+	}
+
+	void ShardedDecTree::operator()(const std::string & number_i, const uint64_t destination_i)
+	{
+		validate_(number_i, "set");
+
+		if (number_i.size() > depth_) {
+			(*shards_[value_(number_i, depth_)])(number_i.substr(depth_), destination_i);
+			return;
+		}
+
+		GRD(mux_);
+		setshort_(number_i, destination_i);
+	}
+
+	bool ShardedDecTree::erase(const std::string & number_i)
+	{
+		validate_(number_i, "erase");
+
+		if (number_i.size() > depth_) return shards_[value_(number_i, depth_)]->erase(number_i.substr(depth_));
+
+		GRD(mux_);
+		return setshort_(number_i, 0) != 0;
+	}
+
+	size_t ShardedDecTree::setRange(const std::string & from_i, const std::string & to_i, const uint64_t destination_i)
+	{
+		std::vector<std::string> prefixes = DecTree::cover(from_i, to_i);
+
+		for (const auto & p : prefixes) (*this)(p, destination_i);
+		return prefixes.size();
+	}
+
+	void ShardedDecTree::clear()
+	{
+		for (auto & s : shards_) s->clear();
+
+		GRD(mux_);
+		for (auto & d : short_) __atomic_store_n(&d, 0, __ATOMIC_RELEASE);
+		for (auto & d : exact_) __atomic_store_n(&d, 0, __ATOMIC_RELEASE);
+		for (auto & d : fallback_) __atomic_store_n(&d, 0, __ATOMIC_RELEASE);
+	}
+
+} // SdH namespace
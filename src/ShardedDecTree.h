@@ -0,0 +1,202 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet tw=120: */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DecTree.h"
+
+/// Maximum number of leading digits to shard on
+#define SHARDDEPTH     3
+
+namespace SdH {
+
+	/** Decimal tree split into shards by the leading digits of numbers.
+	 * Every combination of the first depth digits has a shard of its own,
+	 * with its own arena and writer lock, so modifications of different
+	 * parts of the numbering plan do not wait for each other. A shard
+	 * stores numbers without those leading digits, so a lookup indexes the
+	 * shard directly by them and walks a path that is shorter by as many
+	 * levels as it skipped.
+	 *
+	 * Prefixes of up to depth digits do not fit in a shard. They are kept
+	 * in small tables of the front-end instead, together with the
+	 * destination every shard falls back to when it has no longer match,
+	 * and are modified under a lock of the front-end. */
+	class ShardedDecTree
+	{
+		private:
+		/// Copy construction not allowed
+		ShardedDecTree(const ShardedDecTree & obj_i) = delete;
+
+		/// Assignment construction not allowed
+		ShardedDecTree & operator=(const ShardedDecTree & obj_i) = delete;
+
+		protected:
+		/// Powers of ten up to the maximum depth
+		static constexpr uint16_t POW10[SHARDDEPTH + 1] = { 1, 10, 100, 1000 };
+
+		/// Number of leading digits selecting a shard
+		uint8_t depth_;
+
+		/// Shards, indexed by the value of the leading digits
+		std::vector<std::unique_ptr<DecTree>> shards_;
+
+		/// Destinations of prefixes shorter than depth_, by length and value
+		std::vector<uint64_t> short_;
+
+		/// Destinations of prefixes of exactly depth_ digits, per shard
+		std::vector<uint64_t> exact_;
+
+		/// Destination of the longest prefix of at most depth_ digits, per shard
+		std::vector<uint64_t> fallback_;
+
+		/// Mutex to prevent simultaneous modifications of the front-end tables
+		std::mutex mux_;
+
+		/** Get the first slot of short_ for prefixes of a length.
+		 * @param digits_i Length of the prefixes, 1 up to depth_ - 1.
+		 * @returns Slot of the prefix with all digits 0. */
+		static inline size_t shortslot_(const size_t digits_i)
+		{
+			return (POW10[digits_i] - 10) / 9;
+		}
+
+		/** Compute the value of the first digits of a number.
+		 * @param number_i Number.
+		 * @param digits_i Number of digits.
+		 * @returns Value of the digits. */
+		static inline uint16_t value_(const std::string_view number_i, const size_t digits_i)
+		{
+			uint16_t v = 0;
+
+			for (size_t i = 0; i < digits_i; i++) v = v * 10 + (number_i[i] & 0xF);
+			return v;
+		}
+
+		/** Validate a number to modify.
+		 * @param number_i Number.
+		 * @param what_i Description of the modification, for error messages.
+		 * @throws std::invalid_argument if the number is empty or contains
+		 * non-digits. */
+		static void validate_(const std::string & number_i, const char *what_i);
+
+		/** Set a destination for a prefix of at most depth_ digits, 0 to
+		 * erase it, and update the fallbacks of the shards below it. Must be
+		 * called with mux_ held.
+		 * @param number_i Prefix.
+		 * @param destination_i Destination.
+		 * @returns Previous destination of the prefix. */
+		uint64_t setshort_(const std::string & number_i, const uint64_t destination_i);
+
+		public:
+		/** Constructor.
+		 * @param depth_i Number of leading digits to shard on, 1 up to
+		 * SHARDDEPTH, giving 10^depth_i shards.
+		 * @param reserve_i Number of bytes of address space to reserve for
+		 * the arena of each shard, default ARENARESERVE.
+		 * @param huge_i Huge page policy of the shards, default transparent.
+		 * @throws std::invalid_argument if @p depth_i is out of range. */
+		ShardedDecTree(const uint8_t depth_i = 1, const uint64_t reserve_i = ARENARESERVE,
+			const Arena::hugepages_t huge_i = Arena::transparent);
+
+		/** Get the number of leading digits shards are selected by.
+		 * @returns Shard depth. */
+		inline uint8_t depth() const { return depth_; }
+
+		/** Get the number of shards.
+		 * @returns Number of shards. */
+		inline size_t shards() const { return shards_.size(); }
+
+		/** Get a shard, e.g. to configure its strides or consolidate it.
+		 * Numbers in the shard lack the leading digits of the shard.
+		 * @param idx_i Value of the leading digits of the shard.
+		 * @returns The shard. */
+		inline DecTree & shard(const size_t idx_i) { return *shards_.at(idx_i); }
+
+		/** Enable or disable the per-thread lookup cache of all shards.
+		 * @param enable_i True to use the cache, false to always walk the
+		 * shards. */
+		inline void cache(const bool enable_i) { for (auto & s : shards_) s->cache(enable_i); }
+
+		/** Lookup a destination for a given number.
+		 * This method never blocks, not even while a modification is being
+		 * made.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		uint64_t lookup(const std::string_view number_i) const;
+
+		/** Lookup a destination for a given number.
+		 * @param number_i Number to lookup.
+		 * @returns Found destination, or 0 if not found.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		inline uint64_t operator()(const std::string & number_i) const { return lookup(std::string_view(number_i)); }
+
+		/** Set a destination for a number (range). Only the shard it belongs
+		 * to is locked, unless it has at most depth() digits.
+		 * @param number_i The number (range) to set.
+		 * @param destination_i The destination to set for this number (range).
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		void operator()(const std::string & number_i, const uint64_t destination_i);
+
+		/** Erase the destination of a number (range).
+		 * @param number_i The number (range) to erase.
+		 * @returns True if the number had a destination.
+		 * @throws std::invalid_argument if @p number_i does not consist of
+		 * only digits in the range 0 through 9. */
+		bool erase(const std::string & number_i);
+
+		/** Set a destination for a number range. The prefixes covering the
+		 * range are set shard by shard, so lookups may see part of the range
+		 * set before the rest.
+		 * @param from_i First number of the range.
+		 * @param to_i Last number of the range, of the same length.
+		 * @param destination_i The destination to set for the range.
+		 * @returns Number of prefixes set.
+		 * @throws std::invalid_argument if the numbers are empty, differ in
+		 * length, contain non-digits or @p to_i is lower than @p from_i. */
+		size_t setRange(const std::string & from_i, const std::string & to_i, const uint64_t destination_i);
+
+		/// Clear all shards and prefixes of at most depth() digits
+		void clear();
+	};
+
+} // SdH namespace
@@ -28,6 +28,7 @@ vim:set ts=4 sw=4 noexpandtab: */
 #pragma once
 
 #include <stdlib.h>
+#include <atomic>
 #include <memory>
 #include "commondefs.h"
 
@@ -73,8 +74,8 @@ namespace Fs2a {
 	template <class T>
 	class Singleton {
 		private:
-			/// Internal pointer to instance
-			static T *instance_a;
+			/// Internal pointer to instance, read without locking once set
+			static std::atomic<T *> instance_a;
 
 			/// Mutex to prevent race conditions concerning instance_a
 			static std::mutex mux_a;
@@ -93,18 +94,25 @@ namespace Fs2a {
 			/** @} */
 
 		public:
-			/** Get the Singleton instance pointer.
+			/** Get the Singleton instance pointer. Only the first calls lock,
+			 * once constructed this is a single load.
 			 * @returns a pointer to the singleton instance. */
 			static inline T *instance()
 			{
+				T *inst = instance_a.load(std::memory_order_acquire);
+
+				if (inst != nullptr) return inst;
+
 				GRD(mux_a);
 
-				if (instance_a == nullptr) {
-					instance_a = new T();
+				inst = instance_a.load(std::memory_order_relaxed);
+				if (inst == nullptr) {
+					inst = new T();
+					instance_a.store(inst, std::memory_order_release);
 					atexit(Singleton<T>::close);
 				}
 
-				return instance_a;
+				return inst;
 			}
 
 			/** Explicitly close the singleton */
@@ -112,22 +120,22 @@ namespace Fs2a {
 			{
 				GRD(mux_a);
 
-				if (instance_a != nullptr) {
-					delete instance_a;
-					instance_a = nullptr;
+				T *inst = instance_a.load(std::memory_order_relaxed);
+
+				if (inst != nullptr) {
+					delete inst;
+					instance_a.store(nullptr, std::memory_order_release);
 				}
 			}
 
 			static inline bool is_constructed()
 			{
-				GRD(mux_a);
-
-				return instance_a != nullptr;
+				return instance_a.load(std::memory_order_acquire) != nullptr;
 			}
 
 	};
 
-	template <class T> T *Singleton<T>::instance_a = nullptr;
+	template <class T> std::atomic<T *> Singleton<T>::instance_a(nullptr);
 	template <class T> std::mutex Singleton<T>::mux_a;
 
 } // Fs2a namespace
@@ -0,0 +1,158 @@
+/* BSD 3-Clause License
+ *
+ * Copyright (c) 2020, Simon de Hartog <simon@dehartog.name>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * vim:set ts=4 sw=4 noet: */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+#include "DecTree.h"
+#include "DecTreeBuilder.h"
+#include "Logger.h"
+
+using namespace SdH;
+
+/** Show usage information.
+ * @param name_i Name of the executable. */
+static void usage(const char *name_i)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <plan> <header>\n"
+		"Compiles a numbering plan into a C++ header with a FrozenDecTree.\n"
+		"  --image       The plan is an image written by DecTree::save() instead of\n"
+		"                a CSV file with one \"prefix,destination\" per line\n"
+		"  --name N      Name of the arena and tree type, default plan\n"
+		"  --strides S   Strides of the top levels, e.g. 2,3, for a CSV plan\n",
+		name_i);
+}
+
+/** Load a CSV plan, in any order.
+ * @param path_i Path of the plan.
+ * @param tree_io Tree to fill.
+ * @returns Number of entries. */
+static size_t loadcsv(const std::string & path_i, DecTree & tree_io)
+{
+	std::ifstream in(path_i);
+	std::vector<std::string> lines;
+	std::stringstream sorted;
+	std::string line;
+	DecTreeBuilder builder;
+
+	FCET(in.good(), std::runtime_error, "Unable to open plan {}", path_i);
+	while (std::getline(in, line)) {
+		if (!line.empty()) lines.push_back(line);
+	}
+
+	// The separator sorts below digits, so shorter prefixes come first
+	std::sort(lines.begin(), lines.end());
+	for (const auto & l : lines) sorted << l << '\n';
+	builder.addCSV(sorted);
+	builder.build(tree_io);
+	return builder.size();
+}
+
+/** Generates the header.
+ * @returns 0 on success, 1 on invalid arguments or errors. */
+int main(int argc, char *argv[])
+{
+	std::string name = "plan", plan, header;
+	std::vector<uint8_t> strides;
+	std::vector<uint64_t> words;
+	std::ofstream out;
+	bool image = false;
+	size_t entries = 0;
+	DecTree tree;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--image") == 0) image = true;
+		else if (i + 1 < argc && strcmp(argv[i], "--name") == 0) name = argv[++i];
+		else if (i + 1 < argc && strcmp(argv[i], "--strides") == 0) {
+			std::stringstream ss(argv[++i]);
+			std::string s;
+
+			while (std::getline(ss, s, ',')) strides.push_back(static_cast<uint8_t>(strtoul(s.c_str(), nullptr, 10)));
+		}
+		else if (plan.empty() && argv[i][0] != '-') plan = argv[i];
+		else if (header.empty() && argv[i][0] != '-') header = argv[i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (plan.empty() || header.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+	Fs2a::Logger::instance()->stderror();
+
+	try {
+		if (image) {
+			tree.load(plan);
+			tree.consolidate();
+		} else {
+			tree.strides(strides);
+			entries = loadcsv(plan, tree);
+		}
+		words = tree.words();
+		// An empty tree still needs an array, with only an empty stride profile
+		if (words.empty()) words.push_back(0);
+
+		out.open(header);
+		FCET(out.good(), std::runtime_error, "Unable to write header {}", header);
+		out << fmt::format(
+			"/* Generated by dectreegen from {}, do not edit.\n"
+			" * {} bytes of arena{}. */\n"
+			"\n"
+			"#pragma once\n"
+			"\n"
+			"#include <cstdint>\n"
+			"#include \"FrozenDecTree.h\"\n"
+			"\n"
+			"/// Arena of the frozen tree {}\n"
+			"alignas(64) inline constexpr uint64_t {}_arena[] = {{",
+			plan, words.size() * sizeof(uint64_t), image ? "" : fmt::format(" for {} entries", entries), name, name);
+		for (size_t i = 0; i < words.size(); i++) {
+			out << (i % 4 ? " " : "\n\t") << fmt::format("UINT64_C(0x{:016x}),", words[i]);
+		}
+		out << fmt::format("\n}};\n\n/// Frozen tree {}\ntypedef SdH::FrozenDecTree<{}_arena, {}> {}_t;\n",
+			name, name, words.size(), name);
+		out.close();
+		FCET(out.good(), std::runtime_error, "Unable to write header {}", header);
+	} catch (const std::exception &) {
+		return 1;
+	}
+	return 0;
+}